@@ -0,0 +1,78 @@
+import struct
+import sys
+
+# Converte um arquivo binário do datalogger (ex.: adc_data.bin) para .csv.
+# O layout dos frames é lido do descritor no início do arquivo (ver lib/datalog.h),
+# então o decodificador acompanha automaticamente qualquer mudança no esquema.
+#
+# Uso: python decode_log.py adc_data.bin [saida.csv]
+
+FILE_MAGIC = 0x31474C44   # "DLG1"
+BLOCK_MAGIC = 0x304B4C42  # "BLK0"
+
+FILE_HEADER = struct.Struct('<IHHHHB3x24s')
+CHANNEL = struct.Struct('<24sBBH')
+BLOCK_HEADER = struct.Struct('<IHHIIQQ')
+
+# channel_type_t -> formato do struct
+CHANNEL_FORMATS = {0: 'h', 1: 'H', 2: 'i'}
+
+
+def c_string(raw):
+    return raw.split(b'\0', 1)[0].decode()
+
+
+def decode(path, out):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, version, header_size, num_channels, frame_size, _timestamp, source = FILE_HEADER.unpack_from(data, 0)
+    if magic != FILE_MAGIC:
+        sys.exit(f"Erro: '{path}' não é um arquivo do datalogger.")
+    if version != 1:
+        sys.exit(f"Erro: versão {version} do formato não suportada.")
+
+    names = []
+    fmt = '<'
+    pos = FILE_HEADER.size
+    for _ in range(num_channels):
+        name, ch_type, _size, _offset = CHANNEL.unpack_from(data, pos)
+        names.append(c_string(name))
+        fmt += CHANNEL_FORMATS[ch_type]
+        pos += CHANNEL.size
+    frame = struct.Struct(fmt)
+    if frame.size != frame_size:
+        sys.exit("Erro: descritor inconsistente com o tamanho do frame.")
+
+    print(f"Fonte {c_string(source)}: {num_channels} canais", file=sys.stderr)
+    out.write('num_amostra,t_us,' + ','.join(names) + '\n')
+
+    pos = header_size
+    dropped_total = 0
+    while pos + BLOCK_HEADER.size <= len(data):
+        magic, num_frames, block_frame_size, period_ns, dropped, first_index, t0_us = BLOCK_HEADER.unpack_from(data, pos)
+        if magic != BLOCK_MAGIC or block_frame_size != frame_size:
+            print(f"Aviso: bloco inválido na posição {pos}, leitura interrompida.", file=sys.stderr)
+            break
+        pos += BLOCK_HEADER.size
+        if pos + num_frames * frame_size > len(data):
+            print("Aviso: último bloco incompleto descartado.", file=sys.stderr)
+            break
+        dropped_total += dropped
+        for i, values in enumerate(frame.iter_unpack(data[pos:pos + num_frames * frame_size])):
+            t_us = t0_us + (i * period_ns) // 1000
+            out.write(f"{first_index + i + 1},{t_us}," + ','.join(map(str, values)) + '\n')
+        pos += num_frames * frame_size
+
+    if dropped_total:
+        print(f"Aviso: {dropped_total} frames perdidos durante a captura.", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.exit("Uso: python decode_log.py <arquivo.bin> [saida.csv]")
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], 'w') as out:
+            decode(sys.argv[1], out)
+    else:
+        decode(sys.argv[1], sys.stdout)
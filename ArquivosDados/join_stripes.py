@@ -0,0 +1,149 @@
+import binascii
+import os
+import struct
+import sys
+
+# Remonta um arquivo gravado em vários cartões (ver lib/stripe_log.h).
+# O manifesto (ex.: adc_data.bin.man, gravado em cada cartão) lista os arquivos
+# de cada cartão; copie-os para a mesma pasta do manifesto.
+# Em faixas: a faixa k está no arquivo k % num_cartoes, na posição
+# (k // num_cartoes) * faixa.
+# Espelhado: a faixa k está em todos os arquivos, na posição k * faixa, com um
+# trailer (número da faixa e CRC16); vale a primeira cópia íntegra, e as cópias
+# ruins ou divergentes são relatadas. Basta um dos arquivos estar presente.
+# Uma captura maior que a reserva continua em trechos: adc_data.bin.1.man,
+# adc_data.bin.2.man..., emendados aqui na ordem a partir do primeiro.
+#
+# Uso: python join_stripes.py adc_data.bin.man [saida.bin]
+# Depois: python decode_log.py saida.bin
+
+MANIFEST_MAGIC = 0x31525453  # "STR1"
+MANIFEST = struct.Struct('<IHHIBxHQ')
+TRAILER_MAGIC = 0x3152494D   # "MIR1"
+TRAILER = struct.Struct('<IIHH4x')
+MODE_STRIPED, MODE_MIRRORED = 0, 1
+PART_NAME_LEN = 32
+MANIFEST_PARTS = 4
+
+
+def c_string(raw):
+    return raw.split(b'\0', 1)[0].decode()
+
+
+def read_manifest(manifest_path):
+    with open(manifest_path, 'rb') as f:
+        data = f.read()
+    magic, version, num_cards, unit_bytes, mode, extent, total_bytes = MANIFEST.unpack_from(data, 0)
+    if magic != MANIFEST_MAGIC:
+        sys.exit(f"Erro: '{manifest_path}' não é um manifesto de faixas.")
+    if version != 1:
+        sys.exit(f"Erro: versão {version} do manifesto não suportada.")
+    names = [c_string(data[MANIFEST.size + i * PART_NAME_LEN:MANIFEST.size + (i + 1) * PART_NAME_LEN])
+             for i in range(min(num_cards, MANIFEST_PARTS))]
+    return names, unit_bytes, mode, extent, total_bytes
+
+
+def join(manifest_path, out_path):
+    """Emenda o trecho do manifesto e os seguintes; devolve o total de bytes."""
+    written = 0
+    with open(out_path, 'wb') as out:
+        while True:
+            names, unit_bytes, mode, extent, total_bytes = read_manifest(manifest_path)
+            folder = os.path.dirname(manifest_path)
+            if mode == MODE_MIRRORED:
+                n = join_mirrored(folder, names, unit_bytes, total_bytes, out)
+            else:
+                n = join_striped(folder, names, unit_bytes, total_bytes, out)
+            written += n
+            if n < total_bytes:
+                break
+            # Próximo trecho: <nome>.man, <nome>.1.man, <nome>.2.man...
+            base = manifest_path[:-len('.man')]
+            if extent:
+                base = base[:-len(f'.{extent}')]
+            manifest_path = f'{base}.{extent + 1}.man'
+            if not os.path.exists(manifest_path):
+                break
+            print(f"Trecho {extent + 1}: '{manifest_path}'.")
+    print(f"{written} bytes em '{out_path}'.")
+    return written
+
+
+def join_striped(folder, names, unit_bytes, total_bytes, out):
+    parts = [open(os.path.join(folder, name), 'rb') for name in names]
+    written = 0
+    stripe = 0
+    while written < total_bytes:
+        chunk = parts[stripe % len(parts)].read(min(unit_bytes, total_bytes - written))
+        if not chunk:
+            print(f"Aviso: faixa {stripe} ausente; arquivo remontado incompleto.", file=sys.stderr)
+            break
+        out.write(chunk)
+        written += len(chunk)
+        stripe += 1
+    for p in parts:
+        p.close()
+    print(f"{written} bytes de {len(parts)} cartões.")
+    return written
+
+
+def valid_copy(unit, seq, payload_bytes):
+    """Dados da faixa se a cópia estiver íntegra, senão None."""
+    if len(unit) < payload_bytes + TRAILER.size:
+        return None
+    magic, unit_seq, length, crc = TRAILER.unpack_from(unit, payload_bytes)
+    if magic != TRAILER_MAGIC or unit_seq != seq or length > payload_bytes:
+        return None
+    data = unit[:length]
+    return data if binascii.crc_hqx(data, 0) == crc else None
+
+
+def join_mirrored(folder, names, unit_bytes, total_bytes, out):
+    copies = {}
+    for name in names:
+        path = os.path.join(folder, name)
+        if os.path.exists(path):
+            with open(path, 'rb') as f:
+                copies[name] = f.read()
+        else:
+            print(f"Aviso: cópia '{name}' ausente.", file=sys.stderr)
+    if not copies:
+        sys.exit("Erro: nenhuma cópia encontrada.")
+
+    payload_bytes = unit_bytes - TRAILER.size
+    written = 0
+    seq = 0
+    bad = {name: 0 for name in copies}
+    diverged = 0
+    while written < total_bytes:
+        good = {}
+        for name, raw in copies.items():
+            data = valid_copy(raw[seq * unit_bytes:(seq + 1) * unit_bytes], seq, payload_bytes)
+            if data is None:
+                bad[name] += 1
+            else:
+                good[name] = data
+        if not good:
+            print(f"Aviso: faixa {seq} sem cópia íntegra; arquivo remontado incompleto.", file=sys.stderr)
+            break
+        versions = set(good.values())
+        if len(versions) > 1:
+            diverged += 1
+            print(f"Aviso: faixa {seq} diverge entre as cópias íntegras {sorted(good)}.", file=sys.stderr)
+        data = next(iter(good.values()))
+        out.write(data)
+        written += len(data)
+        seq += 1
+    for name, n in bad.items():
+        if n:
+            print(f"Aviso: {n} faixas ruins em '{name}' (usada a outra cópia).", file=sys.stderr)
+    print(f"{written} bytes, {seq} faixas espelhadas ({diverged} divergentes).")
+    return written
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.exit("Uso: python join_stripes.py <arquivo.man> [saida]")
+    manifest = sys.argv[1]
+    default = manifest[:-4] if manifest.endswith('.man') else manifest + '.bin'
+    join(manifest, sys.argv[2] if len(sys.argv) > 2 else os.path.basename(default))
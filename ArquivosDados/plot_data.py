@@ -15,17 +15,24 @@ except Exception as e:
     exit()
 
 
+# Usa o primeiro sensor do arquivo (colunas "mpuN_accel_x", ...); arquivos
+# antigos, com um único sensor, não têm prefixo
+prefixo = next((c[:-len('accel_x')] for c in df.columns if c.endswith('accel_x')), '')
+
 # Cria coluna de tempo (em segundos)
-df['tempo'] = df['num_amostra'] / SAMPLING_RATE
+if 't_us' in df.columns:
+    df['tempo'] = (df['t_us'] - df['t_us'].iloc[0]) / 1e6
+else:
+    df['tempo'] = df['num_amostra'] / SAMPLING_RATE
 
 # Configuração dos gráficos
 plt.figure(figsize=(12, 8))
 
 # Gráfico de Aceleração
 plt.subplot(2, 1, 1)
-plt.plot(df['tempo'], df['accel_x'], 'r-', label='Accel X', alpha=0.8)
-plt.plot(df['tempo'], df['accel_y'], 'g-', label='Accel Y', alpha=0.8)
-plt.plot(df['tempo'], df['accel_z'], 'b-', label='Accel Z', alpha=0.8)
+plt.plot(df['tempo'], df[prefixo + 'accel_x'], 'r-', label='Accel X', alpha=0.8)
+plt.plot(df['tempo'], df[prefixo + 'accel_y'], 'g-', label='Accel Y', alpha=0.8)
+plt.plot(df['tempo'], df[prefixo + 'accel_z'], 'b-', label='Accel Z', alpha=0.8)
 
 plt.title('Aceleração nos Eixos XYZ')
 plt.ylabel('Aceleração (raw)')
@@ -35,9 +42,9 @@ plt.tight_layout(pad=3.0)
 
 # Gráfico de Giroscópio
 plt.subplot(2, 1, 2)
-plt.plot(df['tempo'], df['gyro_x'], 'r-', label='Gyro X', alpha=0.8)
-plt.plot(df['tempo'], df['gyro_y'], 'g-', label='Gyro Y', alpha=0.8)
-plt.plot(df['tempo'], df['gyro_z'], 'b-', label='Gyro Z', alpha=0.8)
+plt.plot(df['tempo'], df[prefixo + 'gyro_x'], 'r-', label='Gyro X', alpha=0.8)
+plt.plot(df['tempo'], df[prefixo + 'gyro_y'], 'g-', label='Gyro Y', alpha=0.8)
+plt.plot(df['tempo'], df[prefixo + 'gyro_z'], 'b-', label='Gyro Z', alpha=0.8)
 
 plt.title('Giroscópio nos Eixos XYZ')
 plt.xlabel('Tempo (s)')
@@ -13,24 +13,22 @@
 #include "hardware/pwm.h"
 #include "pico/bootrom.h"
 #include "ssd1306.h"
+#include "sensor_source.h"
+#include "datalog.h"
+#include "storage_bench.h"
 
 #include "ff.h"
 #include "diskio.h"
+#include "disk_cache.h"
 #include "f_util.h"
 #include "hw_config.h"
 #include "my_debug.h"
 #include "rtc.h"
 #include "sd_card.h"
 
-/**
- * Definições de I2C para comunicação com o sensor 
- */
-#define I2C_PORT i2c0
-#define I2C_SDA 0
-#define I2C_SCL 1
-
 /**
  * Definições de I2C para comunicação com o display 
+ * (os barramentos e endereços dos sensores ficam em hw_config.c)
  */
 #define I2C_PORT_DISP i2c1
 #define SDA_DISP 14
@@ -57,24 +55,48 @@ uint slice;
 #define DEBOUNCE_TIME_MS 500
 absolute_time_t current_time, last_time = 0;
 
-//Endereço do sensor MPU6050
-static int addr = 0x68;
-
 //Flags para controle de ações com arquivos 
 bool mount_sd_card = false; 
 bool capturing_data = false;
 bool show_file = false;
 bool open_file = false;
 bool mounted = false;
-//ID para as amostras
-uint data_index = 0;
 
 ssd1306_t ssd;
+static char last_message[32]; //Última mensagem desenhada no display
 
-static FIL file_global;
-
+//Arquivo exibido pelo botão do joystick (dados brutos dos MPU6050)
 static char filename[20] = "mpu_data.csv";
 
+//Período de amostragem durante a captura (100 Hz); a cada período todas as fontes são lidas
+#define SAMPLE_PERIOD_US 10000
+static absolute_time_t next_sample_time;
+
+//Estatísticas do driver do SD (comando 'd' no terminal), acrescentadas a cada gravação
+#define STATS_FILE "sd_stats.txt"
+
+//Relatório CSV do benchmark de gravação (comando 'b' no terminal), acrescentado a cada execução
+#define BENCH_FILE "bench.csv"
+
+/**
+ * Remoção e reinserção do cartão durante a captura: o pino de detecção (ou, sem ele, um
+ * erro de escrita) desmonta os cartões e a captura segue na RAM (datalog_suspend); com o
+ * cartão de volta, ele é remontado e a captura continua em um novo segmento de arquivos
+ */
+typedef enum {
+    CARD_OK,        //Cartões presentes (montados ou não)
+    CARD_REMOVED,   //Aguardando a reinserção
+    CARD_SETTLING,  //Reinserido: aguarda os contatos se estabilizarem antes de montar
+} card_state_t;
+static card_state_t card_state = CARD_OK;
+static volatile bool card_event = false;    //Borda em um pino de detecção (interrupção)
+static absolute_time_t card_inserted_at;
+static absolute_time_t next_card_probe;
+#define CARD_SETTLE_MS 250 //Após a inserção, antes de inicializar o cartão
+#define CARD_PROBE_MS 500  //Sem pino de detecção: intervalo entre testes de comunicação
+#define CARD_RECOVERY_MAX 3 //Remontagens por captura após erros que o driver não recuperou
+static int card_recoveries;
+
 /**
  * Protótipos de funções
  */
@@ -99,40 +121,6 @@ void init_leds()
     gpio_set_dir(BLUE, GPIO_OUT);
 }
 
-static void mpu6050_reset()
-{
-    uint8_t buf[] = {0x6B, 0x80};
-    i2c_write_blocking(I2C_PORT, addr, buf, 2, false);
-    sleep_ms(100);
-    buf[1] = 0x00;
-    i2c_write_blocking(I2C_PORT, addr, buf, 2, false);
-    sleep_ms(10);
-}
-
-/**
- * @brief Faz a leitura do sensor MPU6050
- */
-static void mpu6050_read_raw(int16_t accel[3], int16_t gyro[3], int16_t *temp)
-{
-    uint8_t buffer[6];
-    uint8_t val = 0x3B;
-    i2c_write_blocking(I2C_PORT, addr, &val, 1, true);
-    i2c_read_blocking(I2C_PORT, addr, buffer, 6, false);
-    for (int i = 0; i < 3; i++)
-        accel[i] = (buffer[i * 2] << 8) | buffer[(i * 2) + 1];
-
-    val = 0x43;
-    i2c_write_blocking(I2C_PORT, addr, &val, 1, true);
-    i2c_read_blocking(I2C_PORT, addr, buffer, 6, false);
-    for (int i = 0; i < 3; i++)
-        gyro[i] = (buffer[i * 2] << 8) | buffer[(i * 2) + 1];
-
-    val = 0x41;
-    i2c_write_blocking(I2C_PORT, addr, &val, 1, true);
-    i2c_read_blocking(I2C_PORT, addr, buffer, 2, false);
-    *temp = (buffer[0] << 8) | buffer[1];
-}
-
 static sd_card_t *sd_get_by_name(const char *const name)
 {
     for (size_t i = 0; i < sd_get_num(); ++i)
@@ -153,38 +141,34 @@ static FATFS *sd_get_fs_by_name(const char *name)
 /**
  * @brief Monta o cartão SD
  */
-static void run_mount()
+static bool run_mount(const char *arg1)
 {
-    const char *arg1 = strtok(NULL, " ");
-    if (!arg1)
-        arg1 = sd_get_by_num(0)->pcName;
     FATFS *p_fs = sd_get_fs_by_name(arg1);
     if (!p_fs)
     {
         printf("Unknown logical drive number: \"%s\"\n", arg1);
-        return;
+        return false;
     }
     FRESULT fr = f_mount(p_fs, arg1, 1);
     if (FR_OK != fr)
     {
         start_stop_buzzer(true);
         printf("f_mount error: %s (%d)\n", FRESULT_str(fr), fr);
-        return;
+        return false;
     }
     sd_card_t *pSD = sd_get_by_name(arg1);
     myASSERT(pSD);
     pSD->mounted = true;
     printf("Processo de montagem do SD ( %s ) concluído\n", pSD->pcName);
+    sd_print_cmd_stats();
+    return true;
 }
 
 /**
  * @brief Desmonta o cartão SD
  */
-static void run_unmount()
+static void run_unmount(const char *arg1)
 {
-    const char *arg1 = strtok(NULL, " ");
-    if (!arg1)
-        arg1 = sd_get_by_num(0)->pcName;
     FATFS *p_fs = sd_get_fs_by_name(arg1);
     if (!p_fs)
     {
@@ -206,22 +190,220 @@ static void run_unmount()
 }
 
 /**
- * @brief Captura os dados do MPU6050 e os escreve no arquivo .csv
+ * @brief Cartão no soquete: pelo pino de detecção ou, sem ele, por um comando ao cartão
  */
-FRESULT capture_data()
+static bool card_present(sd_card_t *pSD)
 {
-    FRESULT res;
+    if (pSD->use_card_detect)
+        return gpio_get(pSD->card_detect_gpio) == pSD->card_detected_true;
+    return pSD->sd_test_com(pSD);
+}
 
-    int16_t aceleracao[3], gyro[3], temp;
-    mpu6050_read_raw(aceleracao, gyro, &temp);
-    char buffer[1024];
-    data_index++;
-    sprintf(buffer, "%d,%d,%d,%d,%d,%d,%d,%d\n", data_index, 
-            aceleracao[0], aceleracao[1], aceleracao[2], 
-            gyro[0], gyro[1], gyro[2], temp);
-    UINT bw;
-    res = f_write(&file_global, buffer, strlen(buffer), &bw);
-    return res;
+static bool all_cards_present()
+{
+    for (size_t i = 0; i < sd_get_num(); ++i)
+        if (!card_present(sd_get_by_num(i)))
+            return false;
+    return true;
+}
+
+/**
+ * @brief Cartão removido (ou com erro): a captura segue na RAM e os cartões são desmontados sem acessá-los
+ */
+static void card_removed(const char *reason)
+{
+    if (open_file)
+        datalog_suspend();
+    for (size_t i = 0; i < sd_get_num(); ++i)
+    {
+        sd_card_t *pSD = sd_get_by_num(i);
+        if (!pSD->mounted)
+            continue;
+        f_unmount(pSD->pcName); //Só libera o volume; dados ainda não gravados se perdem
+        pSD->mounted = false;
+        pSD->m_Status |= STA_NOINIT;
+    }
+    mounted = false;
+    mount_sd_card = false;
+    card_state = CARD_REMOVED;
+    next_card_probe = make_timeout_time_ms(CARD_PROBE_MS);
+    start_stop_buzzer(true);
+    printf("\n[AVISO] Cartão SD %s%s\n", reason, open_file ? ": captura continua na RAM até a remontagem" : "");
+    show_message("SD indisponivel");
+}
+
+/**
+ * @brief Acompanha a remoção e a reinserção dos cartões; chamada a cada iteração do laço principal
+ */
+static void card_monitor()
+{
+    bool event = card_event;
+    card_event = false;
+    switch (card_state)
+    {
+    case CARD_OK:
+        if (!event)
+            break;
+        if (!all_cards_present())
+            card_removed("removido");
+        else if (!mounted)
+            mount_sd_card = true; //Cartão inserido sem captura pendente: monta automaticamente
+        break;
+    case CARD_REMOVED:
+        //Com pino de detecção espera a interrupção; sem ele, testa o cartão periodicamente
+        if (!event && !time_reached(next_card_probe))
+            break;
+        next_card_probe = make_timeout_time_ms(CARD_PROBE_MS);
+        if (all_cards_present())
+        {
+            card_inserted_at = get_absolute_time();
+            card_state = CARD_SETTLING;
+            show_message("SD inserido");
+        }
+        break;
+    case CARD_SETTLING:
+        if (event && !all_cards_present())
+        {
+            card_state = CARD_REMOVED; //Removido de novo antes de montar
+            break;
+        }
+        if (absolute_time_diff_us(card_inserted_at, get_absolute_time()) < CARD_SETTLE_MS * 1000)
+            break;
+        printf("\nCartão SD reinserido. Remontando...\n");
+        bool ok = true;
+        for (size_t i = 0; i < sd_get_num(); ++i)
+            ok &= run_mount(sd_get_by_num(i)->pcName);
+        FRESULT res = FR_OK;
+        if (ok && open_file)
+            res = datalog_resume();
+        if (!ok || res != FR_OK)
+        {
+            if (res != FR_OK)
+                printf("[ERRO] Não foi possível retomar a captura: %s\n", FRESULT_str(res));
+            card_removed("com erro na remontagem");
+            break;
+        }
+        mounted = true;
+        mount_sd_card = true;
+        card_state = CARD_OK;
+        printf("Cartão SD %s em %lu ms após a reinserção\n", open_file ? "gravando de novo" : "montado",
+               (unsigned long)(absolute_time_diff_us(card_inserted_at, get_absolute_time()) / 1000));
+        show_message(open_file ? "Captura retomada" : "SD montado");
+        break;
+    }
+}
+
+static void put_file_line(void *context, const char *line)
+{
+    f_puts(line, context);
+    f_putc('\n', context);
+}
+
+/**
+ * @brief Acrescenta as estatísticas do driver (latências, espera de cartão ocupado, uso do SPI) a STATS_FILE
+ */
+static void dump_stats()
+{
+    FIL file;
+    FRESULT res = f_open(&file, STATS_FILE, FA_WRITE | FA_OPEN_APPEND);
+    if (res != FR_OK)
+    {
+        printf("[ERRO] Não foi possível abrir %s: %s. Monte o Cartao.\n", STATS_FILE, FRESULT_str(res));
+        return;
+    }
+    //Instante da gravação: separa as execuções no mesmo arquivo
+    f_printf(&file, "# %lu ms\n", (unsigned long)to_ms_since_boot(get_absolute_time()));
+    sd_stats_report(put_file_line, &file);
+    res = f_close(&file);
+    if (res != FR_OK)
+        printf("[ERRO] Falha ao gravar %s: %s\n", STATS_FILE, FRESULT_str(res));
+    else
+        printf("Estatísticas acrescentadas a %s\n", STATS_FILE);
+}
+
+static void put_bench_line(void *context, const char *line)
+{
+    printf("%s\n", line);
+    if (context)
+        put_file_line(context, line);
+}
+
+/**
+ * @brief Executa o benchmark de gravação (storage_bench.h) no primeiro cartão. O CSV vai para o
+ * terminal, entre as linhas "# bench begin" e "# bench end", e é acrescentado a BENCH_FILE
+ */
+static void run_bench()
+{
+    if (!mounted || open_file || card_state != CARD_OK)
+    {
+        printf("[ERRO] Benchmark: monte o cartão e encerre a captura antes.\n");
+        return;
+    }
+    FIL file;
+    bool saved = f_open(&file, BENCH_FILE, FA_WRITE | FA_OPEN_APPEND) == FR_OK;
+    show_message("Benchmark...");
+    printf("# bench begin\n");
+    FRESULT res = storage_bench_run(sd_get_by_num(0), "rp2040", put_bench_line, saved ? &file : NULL);
+    printf("# bench end\n");
+    if (saved)
+        f_close(&file);
+    if (res != FR_OK)
+        printf("[ERRO] Benchmark: %s\n", FRESULT_str(res));
+    else
+        printf("Benchmark concluído%s\n", saved ? "; relatório acrescentado a " BENCH_FILE : "");
+    show_message("SD montado");
+}
+
+/**
+ * @brief Apaga (TRIM) o espaço livre dos cartões montados, para que eles não precisem fazer
+ * isso durante a próxima captura. Pode levar segundos em um cartão grande: fica fora da
+ * montagem e só roda com a captura parada
+ */
+static void run_trim_free()
+{
+    if (!mounted || open_file || card_state != CARD_OK)
+    {
+        printf("[ERRO] TRIM: monte o cartão e encerre a captura antes.\n");
+        return;
+    }
+    show_message("Apagando livre");
+    for (size_t i = 0; i < sd_get_num(); ++i)
+    {
+        const char *name = sd_get_by_num(i)->pcName;
+        printf("Apagando o espaço livre de %s. Aguarde....\n", name);
+        DWORD ntrim;
+        absolute_time_t t0 = get_absolute_time();
+        FRESULT fr = f_trim_free(name, &ntrim);
+        if (FR_OK != fr)
+            printf("[ERRO] TRIM em %s: %s (%d)\n", name, FRESULT_str(fr), fr);
+        else
+            printf("Espaço livre de %s apagado: %lu clusters em %lu ms\n", name, (unsigned long)ntrim,
+                   (unsigned long)(absolute_time_diff_us(t0, get_absolute_time()) / 1000));
+    }
+    show_message("SD montado");
+}
+
+/**
+ * @brief Comandos de uma letra pelo terminal USB: 's' exibe as estatísticas do driver,
+ * 'd' as grava no cartão, 'r' as zera, 'b' executa o benchmark de gravação e 't' apaga
+ * (TRIM) o espaço livre dos cartões
+ */
+static void serial_command()
+{
+    int c = getchar_timeout_us(0);
+    if (c == 's')
+        sd_print_stats();
+    else if (c == 'd')
+        dump_stats();
+    else if (c == 'r')
+    {
+        sd_reset_stats();
+        printf("Estatísticas zeradas\n");
+    }
+    else if (c == 'b')
+        run_bench();
+    else if (c == 't')
+        run_trim_free();
 }
 
 /**
@@ -255,6 +437,17 @@ void read_file(const char *filename)
  */
 void gpio_irq_handler(uint gpio, uint32_t events)
 {
+    //Pinos de detecção de cartão: sem debounce aqui, card_monitor() lê o pino depois
+    for (size_t i = 0; i < sd_get_num(); ++i)
+    {
+        sd_card_t *pSD = sd_get_by_num(i);
+        if (pSD->use_card_detect && gpio == pSD->card_detect_gpio)
+        {
+            card_event = true;
+            return;
+        }
+    }
+
     current_time = to_ms_since_boot(get_absolute_time());
 
     //Realiza o debounce para tratamento dos acionamentos dos botões
@@ -298,6 +491,16 @@ int main()
     init_leds();
     init_buzzer();
 
+    //Detecção de cartão por interrupção nos soquetes que têm o pino (hw_config.c)
+    sd_init_driver();
+    for (size_t i = 0; i < sd_get_num(); ++i)
+    {
+        sd_card_t *pSD = sd_get_by_num(i);
+        if (pSD->use_card_detect)
+            gpio_set_irq_enabled_with_callback(pSD->card_detect_gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true,
+                                               &gpio_irq_handler);
+    }
+
     sleep_ms(5000);
     time_init();
 
@@ -319,16 +522,14 @@ int main()
     ssd1306_send_data(&ssd);
 
     /**
-     * Inicialização do I2C para comunicação com o sensor
+     * Inicialização das fontes de dados (registro em hw_config.c)
      */
-    i2c_init(I2C_PORT, 400 * 1000);
-    gpio_set_function(I2C_SDA, GPIO_FUNC_I2C);
-    gpio_set_function(I2C_SCL, GPIO_FUNC_I2C);
-    gpio_pull_up(I2C_SDA);
-    gpio_pull_up(I2C_SCL);
-
-    bi_decl(bi_2pins_with_func(I2C_SDA, I2C_SCL, GPIO_FUNC_I2C));
-    mpu6050_reset();
+    sensor_source_init_all();
+    if (!mpu6050_source.initialized)
+    {
+        start_stop_buzzer(true);
+        printf("[ERRO] Nenhum MPU6050 encontrado.\n");
+    }
 
     printf("Iniciando Programa...\n");
     printf("\033[2J\033[H"); // Limpa tela
@@ -340,20 +541,31 @@ int main()
         //Acende o led Verde caso o cartão SD esteja montado (pode salvar dados) vermelho caso contrário
         (mounted && !capturing_data) ? on_off_leds(false, true, false) : on_off_leds(true, false, false);
         
+        card_monitor();
+        serial_command();
+
         /**
          * Monta ou Desmonta o cartão SD, quando o botão A é pressionado
          */
-        if (mount_sd_card == true && !mounted)
+        if (card_state != CARD_OK)
+        {
+            //Remoção em andamento: card_monitor() remonta os cartões
+        }else if (mount_sd_card == true && !mounted)
         {
             show_message("Montando sd");
             printf("\nIniciando Montagem do Cartão SD. Aguarde....\n");
-            run_mount();
+            //Todos os cartões configurados; com mais de um, a fonte binária é gravada em faixas (stripe_log.h)
+            for (size_t i = 0; i < sd_get_num(); ++i)
+                run_mount(sd_get_by_num(i)->pcName);
             mounted = true;
         }else if (mount_sd_card == false && mounted)
         {
             show_message("Desmontando sd");
             printf("\nIniciando Desmontagem do Cartão SD. Aguarde....\n");
-            run_unmount();
+            for (size_t i = 0; i < sd_get_num(); ++i)
+                run_unmount(sd_get_by_num(i)->pcName);
+            disk_cache_print_stats();
+            sd_print_stats();
             mounted = false;
         }
 
@@ -364,55 +576,64 @@ int main()
         {
             show_message("Abrindo Arquivo");
             printf("\nCriando Arquivo...\n");
-            FRESULT res = f_open(&file_global, filename, FA_WRITE | FA_CREATE_ALWAYS);
+            FRESULT res = datalog_open();
             if (res != FR_OK)
             {
                 start_stop_buzzer(true);
-                printf("\n[ERRO] Não foi possível abrir o arquivo para escrita. Monte o Cartao.\n");
+                printf("\n[ERRO] Não foi possível criar os arquivos de captura: %s. Monte o Cartao.\n", FRESULT_str(res));
                 capturing_data = false;
                 show_message("Erro ao abrir");
             }else {
                 open_file = true;
-                 /**
-                 * Escreve o cabeçalho do arquivo
-                 */
-                UINT bw;
-                char buffer[500];
-                sprintf(buffer, "num_amostra,accel_x,accel_y,accel_z,gyro_x,gyro_y,gyro_z,temp\n");
-                res = f_write(&file_global, buffer, strlen(buffer), &bw);
-                
-                if (res != FR_OK)
-                {
-                    start_stop_buzzer(true);
-                    printf("\n[ERRO] Não foi possível escrever no arquivo. Monte o Cartao.\n");
-                    f_close(&file_global);
-                    capturing_data = false;
-                    open_file = false;
-                    show_message("Erro ao escrever");
-                }
+                card_recoveries = 0;
                 show_message("Arquivo Aberto");
+                printf("\nCapturando dados. Pressione o botão B para finalizar...\n");
+                next_sample_time = get_absolute_time();
             }
 
         }else if (capturing_data && open_file) {
-            printf("\nCapturando dados do MPU6050. Pressione o botão B para finalizar...\n");
-            FRESULT res = capture_data();
-            if (res != FR_OK)
+            FRESULT res = datalog_poll();
+            bool present = res == FR_OK || card_state != CARD_OK || all_cards_present();
+            if (res != FR_OK && card_state == CARD_OK && !present)
+            {
+                //Erro de escrita com o cartão fora do soquete: segue na RAM até a reinserção
+                card_removed("removido");
+            }else if (res != FR_OK && card_state == CARD_OK && card_recoveries < CARD_RECOVERY_MAX)
+            {
+                //O driver esgotou as tentativas (repetição, clock menor, reinicialização): remonta o
+                //cartão e segue em um novo segmento, em vez de encerrar a captura
+                ++card_recoveries;
+                printf("\n[AVISO] Erro de escrita: %s. Remontando (%d de %d)\n", FRESULT_str(res), card_recoveries,
+                       CARD_RECOVERY_MAX);
+                card_removed("com erro");
+            }else if (res != FR_OK)
             {
                 start_stop_buzzer(true);
                 printf("[ERRO] Não foi possível escrever no arquivo. Monte o Cartao.\n");
-                f_close(&file_global);
+                datalog_close();
                 capturing_data = false;
                 open_file = false;
                 show_message("Erro ao Escrever");
             }
-            show_message("Capturando dados");
+            if (card_state == CARD_OK)
+                show_message("Capturando dados");
             on_off_leds(true, true, false);
         }else if (!capturing_data && open_file)
         {
-            f_close(&file_global);
-            printf("\nDados do MPU6050 salvos no arquivo %s.\n\n", filename);    
+            FRESULT res = datalog_close();
+            if (res != FR_OK)
+                printf("\n[ERRO] Falha ao salvar os arquivos de captura: %s\n", FRESULT_str(res));
+            for (size_t i = 0; i < sensor_source_get_num() && res != FR_NOT_READY; ++i)
+            {
+                sensor_source_t *src = sensor_source_get_by_num(i);
+                if (src->initialized)
+                    printf("\nDados da fonte %s salvos no arquivo %s.", src->name, src->log_name);
+            }
+            printf("\n");
+            orientation_source_print_stats();
+            sd_print_stats();
+            printf("\n");
             open_file = false;
-            data_index = 0;
             show_message("Dados Salvos");
         }
 
@@ -426,7 +647,19 @@ int main()
             show_file = false;
 
         }
-        sleep_ms(500);
+
+        //Durante a captura o laço segue o período de amostragem; fora dela, verifica os botões a cada 500 ms
+        if (capturing_data && open_file)
+        {
+            next_sample_time = delayed_by_us(next_sample_time, SAMPLE_PERIOD_US);
+            if (absolute_time_diff_us(next_sample_time, get_absolute_time()) > SAMPLE_PERIOD_US)
+                next_sample_time = get_absolute_time(); //Atrasado demais: não tenta recuperar as amostras perdidas
+            sleep_until(next_sample_time);
+        }
+        else
+        {
+            sleep_ms(500);
+        }
     }
     return 0;
 }
@@ -436,6 +669,11 @@ int main()
  */
 void show_message(char *text)
 {
+    //O display compartilha o i2c1 com sensores: só redesenha se a mensagem mudar
+    if (strncmp(last_message, text, sizeof last_message) == 0)
+        return;
+    strncpy(last_message, text, sizeof last_message - 1);
+
     ssd1306_fill(&ssd, false);                            // Limpa o display
     ssd1306_rect(&ssd, 3, 3, 122, 60, true, false);        // Desenha um retângulo
     ssd1306_draw_string(&ssd, text, 14, 31);           // Escreve o texto no display  
@@ -447,6 +685,7 @@ void show_message(char *text)
  */
 void clear_display()
 {
+    last_message[0] = '\0';
     ssd1306_fill(&ssd, false);
     ssd1306_send_data(&ssd);
 }
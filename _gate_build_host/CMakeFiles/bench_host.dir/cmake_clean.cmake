@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_host.dir/bench_host.c.o"
+  "CMakeFiles/bench_host.dir/bench_host.c.o.d"
+  "bench_host"
+  "bench_host.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench_host.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
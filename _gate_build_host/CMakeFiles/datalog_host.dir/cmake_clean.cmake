@@ -0,0 +1,41 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/datalog_host.dir/host_cards.c.o"
+  "CMakeFiles/datalog_host.dir/host_cards.c.o.d"
+  "CMakeFiles/datalog_host.dir/host_support.c.o"
+  "CMakeFiles/datalog_host.dir/host_support.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/ff15/source/ff.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/ff15/source/ff.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/ff15/source/ffsystem.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/ff15/source/ffsystem.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/ff15/source/ffunicode.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/ff15/source/ffunicode.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/sd_driver/crc.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/sd_driver/crc.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/src/f_util.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/src/f_util.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/src/ff_stdio.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/src/ff_stdio.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/src/glue.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/FatFs_SPI/src/glue.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/datalog.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/datalog.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/sensor_source.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/sensor_source.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/storage_bench.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/storage_bench.c.o.d"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/stripe_log.c.o"
+  "CMakeFiles/datalog_host.dir/root/repo/lib/stripe_log.c.o.d"
+  "CMakeFiles/datalog_host.dir/sd_host.c.o"
+  "CMakeFiles/datalog_host.dir/sd_host.c.o.d"
+  "CMakeFiles/datalog_host.dir/sd_model.c.o"
+  "CMakeFiles/datalog_host.dir/sd_model.c.o.d"
+  "CMakeFiles/datalog_host.dir/source_sim.c.o"
+  "CMakeFiles/datalog_host.dir/source_sim.c.o.d"
+  "libdatalog_host.a"
+  "libdatalog_host.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/datalog_host.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "libdatalog_host.a"
+)
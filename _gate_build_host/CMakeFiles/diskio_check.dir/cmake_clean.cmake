@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/diskio_check.dir/diskio_check.c.o"
+  "CMakeFiles/diskio_check.dir/diskio_check.c.o.d"
+  "diskio_check"
+  "diskio_check.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/diskio_check.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
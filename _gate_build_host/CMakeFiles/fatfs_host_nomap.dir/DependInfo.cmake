@@ -0,0 +1,29 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/host/host_cards.c" "CMakeFiles/fatfs_host_nomap.dir/host_cards.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/host_cards.c.o.d"
+  "/root/repo/host/host_support.c" "CMakeFiles/fatfs_host_nomap.dir/host_support.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/host_support.c.o.d"
+  "/root/repo/lib/FatFs_SPI/ff15/source/ff.c" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ff.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ff.c.o.d"
+  "/root/repo/lib/FatFs_SPI/ff15/source/ffsystem.c" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffsystem.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffsystem.c.o.d"
+  "/root/repo/lib/FatFs_SPI/ff15/source/ffunicode.c" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffunicode.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffunicode.c.o.d"
+  "/root/repo/lib/FatFs_SPI/sd_driver/crc.c" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/sd_driver/crc.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/sd_driver/crc.c.o.d"
+  "/root/repo/lib/FatFs_SPI/src/f_util.c" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/f_util.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/f_util.c.o.d"
+  "/root/repo/lib/FatFs_SPI/src/ff_stdio.c" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/ff_stdio.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/ff_stdio.c.o.d"
+  "/root/repo/lib/FatFs_SPI/src/glue.c" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/glue.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/glue.c.o.d"
+  "/root/repo/host/sd_host.c" "CMakeFiles/fatfs_host_nomap.dir/sd_host.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/sd_host.c.o.d"
+  "/root/repo/host/sd_model.c" "CMakeFiles/fatfs_host_nomap.dir/sd_model.c.o" "gcc" "CMakeFiles/fatfs_host_nomap.dir/sd_model.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,31 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/fatfs_host_nomap.dir/host_cards.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/host_cards.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/host_support.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/host_support.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ff.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ff.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffsystem.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffsystem.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffunicode.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/ff15/source/ffunicode.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/sd_driver/crc.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/sd_driver/crc.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/f_util.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/f_util.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/ff_stdio.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/ff_stdio.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/glue.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/root/repo/lib/FatFs_SPI/src/glue.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/sd_host.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/sd_host.c.o.d"
+  "CMakeFiles/fatfs_host_nomap.dir/sd_model.c.o"
+  "CMakeFiles/fatfs_host_nomap.dir/sd_model.c.o.d"
+  "libfatfs_host_nomap.a"
+  "libfatfs_host_nomap.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/fatfs_host_nomap.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
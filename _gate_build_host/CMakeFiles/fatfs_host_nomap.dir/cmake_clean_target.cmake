@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "libfatfs_host_nomap.a"
+)
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/freemap_check_nomap.dir/freemap_check.c.o"
+  "CMakeFiles/freemap_check_nomap.dir/freemap_check.c.o.d"
+  "freemap_check_nomap"
+  "freemap_check_nomap.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/freemap_check_nomap.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/logger_host.dir/logger_host.c.o"
+  "CMakeFiles/logger_host.dir/logger_host.c.o.d"
+  "logger_host"
+  "logger_host.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/logger_host.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/host
+# Build directory: /root/repo/_gate_build_host
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(diskio_check "/root/repo/_gate_build_host/diskio_check")
+set_tests_properties(diskio_check PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/host/CMakeLists.txt;73;add_test;/root/repo/host/CMakeLists.txt;0;")
+add_test(freemap_trace_nomap "/root/repo/_gate_build_host/freemap_check_nomap" "freemap_nomap.txt")
+set_tests_properties(freemap_trace_nomap PROPERTIES  FIXTURES_SETUP "freemap_trace" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/host/CMakeLists.txt;80;add_test;/root/repo/host/CMakeLists.txt;0;")
+add_test(freemap_check "/root/repo/_gate_build_host/freemap_check" "freemap.txt" "freemap_nomap.txt")
+set_tests_properties(freemap_check PROPERTIES  FIXTURES_REQUIRED "freemap_trace" TIMEOUT "60" _BACKTRACE_TRIPLES "/root/repo/host/CMakeLists.txt;82;add_test;/root/repo/host/CMakeLists.txt;0;")
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "disk_cache.h"
+#include "f_util.h"
+#include "host_cards.h"
+#include "hw_config.h"
+#include "storage_bench.h"
+
+/**
+ * Benchmark do caminho de gravação no Linux (lib/storage_bench.c) sobre um
+ * cartão simulado; com -t ou -p os números são os do cartão modelado.
+ *
+ *   bench_host [opções dos cartões] [-o relatório.csv] [-l plataforma]
+ *
+ * O relatório CSV vai para o arquivo ou, sem -o, para a saída padrão.
+ */
+
+static void put_line(void *context, const char *line)
+{
+    FILE *out = context;
+    fprintf(out, "%s\n", line);
+    fflush(out);
+}
+
+static void usage(const char *prog)
+{
+    printf("uso: %s " HOST_CARDS_USAGE " [-o relatório.csv] [-l plataforma]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    host_cards_opt_t cards;
+    host_cards_defaults(&cards);
+    const char *report = NULL, *platform = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, HOST_CARDS_OPTIONS "o:l:")) != -1) {
+        switch (opt) {
+        case 'o': report = optarg; break;
+        case 'l': platform = optarg; break;
+        default:
+            if (!host_cards_option(&cards, opt, optarg))
+                usage(argv[0]);
+        }
+    }
+    if (!platform)
+        platform = cards.timed ? "host-model" : "host";
+    FILE *out = report ? fopen(report, "w") : stdout;
+    if (!out) {
+        perror(report);
+        return 1;
+    }
+    if (!host_cards_mount(&cards))
+        return 1;
+
+    FRESULT fr = storage_bench_run(sd_get_by_num(0), platform, put_line, out);
+    if (fr != FR_OK)
+        printf("storage_bench_run error: %s (%d)\n", FRESULT_str(fr), fr);
+    if (out != stdout)
+        fclose(out);
+    disk_cache_print_stats();
+    host_cards_print_stats();
+
+    host_cards_unmount();
+    return fr == FR_OK ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "disk_cache.h"
+#include "host_cards.h"
+#include "hw_config.h"
+
+/**
+ * Verificações de coerência do glue.c (cache de setores e leitura
+ * antecipada) com sequências de disk_read/disk_write/disk_ioctl sobre um
+ * cartão na RAM. Retorna 0 se todas passam; roda no ctest do build do host.
+ */
+
+#define SECTOR 512
+#define S 20000 // Longe da FAT e dos diretórios do volume formatado
+
+static int failures;
+
+static void fill(BYTE *buf, UINT count, BYTE tag)
+{
+    for (UINT i = 0; i < count * SECTOR; ++i)
+        buf[i] = (BYTE)(tag + i / SECTOR);
+}
+
+static void check_dr(const char *what, DRESULT dr)
+{
+    if (dr != RES_OK) {
+        printf("FALHA %s: DRESULT %d\n", what, dr);
+        ++failures;
+    }
+}
+
+static void check_data(const char *what, const BYTE *got, BYTE tag)
+{
+    BYTE want[SECTOR];
+    fill(want, 1, tag);
+    if (memcmp(got, want, SECTOR) != 0) {
+        printf("FALHA %s: setor com 0x%02x, esperado 0x%02x\n", what, got[0], tag);
+        ++failures;
+    }
+}
+
+// O setor S fica com tag (setor S + 1 com tag + 1) no cartão, com o cache e
+// a leitura antecipada vazios de S
+static void reset(BYTE tag)
+{
+    BYTE buf[2 * SECTOR];
+    fill(buf, 2, tag);
+    check_dr("reset", disk_write(0, buf, S, 2)); // Várias: direto para o cartão
+    check_dr("reset sync", disk_ioctl(0, CTRL_SYNC, NULL));
+}
+
+// Leituras sequenciais que terminam logo antes de S: a leitura antecipada
+// busca uma sequência que cobre S
+static void read_up_to_s()
+{
+    BYTE buf[SECTOR];
+    for (LBA_t s = S - 3; s < S; ++s)
+        check_dr("leitura antes de S", disk_read(0, buf, s, 1));
+}
+
+// Setor sujo no cache enquanto a sequência é lida, depois gravado por CTRL_SYNC
+static void dirty_then_sync()
+{
+    BYTE buf[2 * SECTOR];
+    reset(0x10);
+    fill(buf, 1, 0x40);
+    check_dr("escrita de S", disk_write(0, buf, S, 1));
+    read_up_to_s();
+    check_dr("sync", disk_ioctl(0, CTRL_SYNC, NULL));
+    check_dr("leitura de S, 2", disk_read(0, buf, S, 2));
+    check_data("sujo + sync, leitura de 2 setores: S", buf, 0x40);
+    check_data("sujo + sync, leitura de 2 setores: S + 1", buf + SECTOR, 0x11);
+}
+
+// O mesmo, mas S sai do cache por substituição
+static void dirty_then_evict()
+{
+    BYTE buf[SECTOR];
+    reset(0x20);
+    fill(buf, 1, 0x50);
+    check_dr("escrita de S", disk_write(0, buf, S, 1));
+    read_up_to_s();
+    for (LBA_t s = 0; s < DISK_CACHE_SECTORS; ++s)
+        check_dr("escrita de outro setor", disk_write(0, buf, S + 1000 + s, 1));
+    check_dr("leitura de S", disk_read(0, buf, S, 1));
+    check_data("sujo + substituído, leitura de 1 setor", buf, 0x50);
+}
+
+// Escrita de vários setores sobre uma sequência já lida
+static void bulk_write_over_run()
+{
+    BYTE buf[2 * SECTOR];
+    reset(0x30);
+    read_up_to_s();
+    fill(buf, 2, 0x60);
+    check_dr("escrita de S, 2", disk_write(0, buf, S, 2));
+    check_dr("leitura de S, 2", disk_read(0, buf, S, 2));
+    check_data("escrita sobre a sequência: S", buf, 0x60);
+    check_data("escrita sobre a sequência: S + 1", buf + SECTOR, 0x61);
+}
+
+// Leituras e escritas de vários setores passam pelo driver do cartão: a
+// escrita aparece no cartão sem CTRL_SYNC, e a leitura traz o que está nele
+static void bulk_reaches_card()
+{
+    sd_card_t *sd = sd_get_by_num(0);
+    BYTE buf[4 * SECTOR];
+    fill(buf, 4, 0x70);
+    check_dr("escrita de 4 setores", disk_write(0, buf, S + 100, 4));
+    memset(buf, 0, sizeof buf);
+    check_dr("leitura do cartão", sd->read_blocks(sd, buf, S + 100, 4) ? RES_ERROR : RES_OK);
+    check_data("escrita de vários setores no cartão", buf + 3 * SECTOR, 0x73);
+
+    fill(buf, 4, 0x80);
+    check_dr("escrita no cartão", sd->write_blocks(sd, buf, S + 200, 4) ? RES_ERROR : RES_OK);
+    memset(buf, 0, sizeof buf);
+    check_dr("leitura de 4 setores", disk_read(0, buf, S + 200, 4));
+    check_data("leitura de vários setores do cartão", buf + 3 * SECTOR, 0x83);
+}
+
+int main()
+{
+    host_cards_opt_t cards;
+    host_cards_defaults(&cards);
+    cards.size_mb = 32;
+    if (!host_cards_mount(&cards))
+        return 1;
+
+    dirty_then_sync();
+    dirty_then_evict();
+    bulk_write_over_run();
+    bulk_reaches_card();
+
+    host_cards_unmount();
+    if (failures) {
+        printf("%d verificações falharam\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "f_util.h"
+#include "ff.h"
+#include "host_cards.h"
+#include "hw_config.h"
+
+/**
+ * Verificação do mapa de clusters livres (FF_USE_FREEMAP em ffconf.h): num
+ * volume FAT32 quase cheio e fragmentado, create_chain e f_expand têm de
+ * escolher os mesmos clusters com e sem o mapa. O programa é compilado com o
+ * mapa (freemap_check) e sem ele (freemap_check_nomap); cada um grava a
+ * sequência de passos em um arquivo, e o ctest compara a do primeiro com a
+ * do segundo:
+ *
+ *   freemap_check rastro.txt [referência.txt]
+ *
+ * Cada passo registra quantos clusters foram alocados, o primeiro, o último,
+ * um hash da sequência e os clusters livres. Os casos que o mapa trata à
+ * parte: a busca que passa do fim da FAT (n_fatent) e recomeça em 2, a que
+ * começa dentro de um grupo cheio e o grupo que volta a ter cluster livre
+ * depois de um f_unlink.
+ */
+
+#define CLUSTER 512 // Um setor por cluster: bem mais grupos de mapa que setores da FAT
+
+static FILE *trace;
+static int failures;
+static BYTE data[CLUSTER];
+static const char *drive;
+
+typedef struct {
+    const char *name;
+    unsigned long count;
+    DWORD first, last;
+    uint32_t hash;
+} step_t;
+
+static void check(const char *what, FRESULT fr)
+{
+    if (fr != FR_OK) {
+        printf("FALHA %s: %s (%d)\n", what, FRESULT_str(fr), fr);
+        ++failures;
+    }
+}
+
+static void step_begin(step_t *st, const char *name)
+{
+    *st = (step_t){.name = name, .hash = 2166136261u};
+}
+
+static void step_add(step_t *st, DWORD clst)
+{
+    if (!st->count++)
+        st->first = clst;
+    st->last = clst;
+    for (int i = 0; i < 4; ++i)
+        st->hash = (st->hash ^ (BYTE)(clst >> 8 * i)) * 16777619u; // FNV-1a
+}
+
+static DWORD free_clusters()
+{
+    DWORD nclst = 0;
+    FATFS *fs;
+    check("f_getfree", f_getfree(drive, &nclst, &fs));
+    return nclst;
+}
+
+static void step_end(const step_t *st, FRESULT fr)
+{
+    fprintf(trace, "%s res=%d n=%lu primeiro=%lu ultimo=%lu hash=%08lx livres=%lu\n", st->name, fr,
+            st->count, (unsigned long)st->first, (unsigned long)st->last, (unsigned long)st->hash,
+            (unsigned long)free_clusters());
+}
+
+// Mais um cluster no fim do arquivo (create_chain); 0 se o volume está cheio
+static DWORD append(FIL *fp)
+{
+    UINT bw;
+    check("f_write", f_write(fp, data, CLUSTER, &bw));
+    return bw == CLUSTER ? fp->clust : 0;
+}
+
+static void open_new(FIL *fp, const char *name)
+{
+    check(name, f_open(fp, name, FA_WRITE | FA_CREATE_ALWAYS));
+}
+
+// Arquivo contíguo de n clusters (ou até encher o volume, se n == 0);
+// devolve o último
+static DWORD fill_file(const char *name, unsigned long n)
+{
+    FIL fil;
+    step_t st;
+    step_begin(&st, name);
+    open_new(&fil, name);
+    for (DWORD c; (!n || st.count < n) && (c = append(&fil));)
+        step_add(&st, c);
+    check(name, f_close(&fil));
+    step_end(&st, FR_OK);
+    return st.last;
+}
+
+// Dois arquivos com clusters intercalados, n de cada: metade livre ao apagar
+// um; devolve o último cluster
+static DWORD fill_interleaved(const char *name1, const char *name2, unsigned long n)
+{
+    FIL f1, f2;
+    step_t st;
+    step_begin(&st, name1);
+    open_new(&f1, name1);
+    open_new(&f2, name2);
+    for (unsigned long i = 0; i < n; ++i) {
+        step_add(&st, append(&f1));
+        step_add(&st, append(&f2));
+    }
+    check(name1, f_close(&f1));
+    check(name2, f_close(&f2));
+    step_end(&st, FR_OK);
+    return st.last;
+}
+
+// f_expand de n clusters em um arquivo novo
+static void expand(const char *name, unsigned long n)
+{
+    FIL fil;
+    step_t st;
+    step_begin(&st, name);
+    open_new(&fil, name);
+    FRESULT fr = f_expand(&fil, (FSIZE_t)n * CLUSTER, 1);
+    if (fr == FR_OK) {
+        step_add(&st, fil.obj.sclust);
+        step_add(&st, fil.obj.sclust + n - 1);
+    } else if (fr != FR_DENIED) {
+        check(name, fr);
+    }
+    check(name, f_close(&fil));
+    step_end(&st, fr);
+}
+
+static void unlink_file(const char *name)
+{
+    step_t st;
+    step_begin(&st, name);
+    FRESULT fr = f_unlink(name);
+    check(name, fr);
+    step_end(&st, fr);
+}
+
+// Grupos do mapa marcados como cheios (com FF_USE_FREEMAP). O f_getfree só
+// devolve o FATFS: a contagem de livres é conhecida, e a FAT não é lida
+static unsigned full_groups()
+{
+    unsigned n = 0;
+#if FF_USE_FREEMAP
+    DWORD nclst;
+    FATFS *fs;
+    f_getfree(drive, &nclst, &fs);
+    for (DWORD c = 0; fs->fmap_grp && c < fs->n_fatent; c += fs->fmap_grp)
+        n += !(fs->fmap[c / fs->fmap_grp / 8] & (1 << (c / fs->fmap_grp % 8)));
+#endif
+    return n;
+}
+
+// Entradas da FAT por bit do mapa, a mesma conta de fmap_init (ff.c), feita
+// aqui para que o volume tenha o mesmo arranjo com e sem o mapa
+static DWORD group_size()
+{
+    DWORD nclst;
+    FATFS *fs;
+    check("f_getfree", f_getfree(drive, &nclst, &fs));
+    DWORD grp = (fs->n_fatent + FF_FREEMAP_BYTES * 8 - 1) / (FF_FREEMAP_BYTES * 8);
+    return (grp + 127) / 128 * 128;
+}
+
+static void scenario()
+{
+    unsigned long n = free_clusters();
+    DWORD grp = group_size();
+
+    // Volume: [a e b intercalados][c][h][c2][g][d e e intercalados][f até encher]
+    // g começa no topo de um grupo, precedido por um grupo só de c2, e h fica
+    // no grupo anterior: a busca chega ao grupo cheio lendo a FAT e o pula
+    // até o topo do grupo de g
+    DWORD next = fill_interleaved("a", "b", n / 8) + 1;
+    DWORD g_top = (next + n / 4 + grp - 1) / grp * grp;
+    DWORD h = g_top - grp - grp / 2;
+    fill_file("c", h - next);
+    fill_file("h", 1);
+    fill_file("c2", g_top - h - 1);
+    fill_file("g", 3);
+    fill_interleaved("d", "e", n / 16);
+    fill_file("f", 0);
+
+    // Um cluster livre a cada dois no início do volume; a última alocação foi no fim
+    unlink_file("a");
+    // Começa no grupo cheio do fim, passa de n_fatent e volta a 2
+    FIL w;
+    step_t st;
+    step_begin(&st, "w1");
+    open_new(&w, "w1");
+    for (int i = 0; i < 5; ++i)
+        step_add(&st, append(&w));
+    check("w1", f_close(&w));
+    step_end(&st, FR_OK);
+    // Nenhum bloco contíguo de 4: a volta inteira marca os grupos cheios no
+    // mapa, e as buscas seguintes os pulam
+    expand("x1", 4);
+    unsigned full = full_groups();
+    printf("%lu clusters, %u grupos cheios no mapa\n", n, full);
+    if (FF_USE_FREEMAP && !full) {
+        printf("FALHA: nenhum grupo marcado como cheio\n");
+        ++failures;
+    }
+    expand("x2", 1);
+
+    // Os grupos de h e de g voltam a ter clusters livres, cercados de grupos cheios
+    unlink_file("g");
+    unlink_file("h");
+    fill_file("w2", 0); // O resto do início do volume, h, g, e cheio
+    expand("x3", 1);
+
+    // c inteiro livre: f_expand a partir do grupo de g, cheio de novo
+    unlink_file("c");
+    expand("x4", n / 8);
+    expand("x5", n / 4); // Não cabe
+    unlink_file("b");
+    fill_file("w3", 0);
+}
+
+// Compara o rastro com o de referência, linha a linha
+static void compare(const char *path, const char *ref_path)
+{
+    FILE *f = fopen(path, "r"), *ref = fopen(ref_path, "r");
+    if (!f || !ref) {
+        printf("FALHA: não abriu %s\n", f ? ref_path : path);
+        ++failures;
+    } else {
+        char line[160], ref_line[160];
+        for (int i = 1;; ++i) {
+            char *l = fgets(line, sizeof line, f), *r = fgets(ref_line, sizeof ref_line, ref);
+            if (!l && !r)
+                break;
+            if (!l || !r || strcmp(line, ref_line)) {
+                printf("FALHA na linha %d:\n  %s  esperado (%s):\n  %s", i, l ? line : "(fim)\n",
+                       ref_path, r ? ref_line : "(fim)\n");
+                ++failures;
+                break;
+            }
+        }
+    }
+    if (f)
+        fclose(f);
+    if (ref)
+        fclose(ref);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("uso: %s rastro.txt [referência.txt]\n", argv[0]);
+        return 2;
+    }
+    host_cards_opt_t cards;
+    host_cards_defaults(&cards);
+    cards.size_mb = 64;
+    if (!host_cards_mount(&cards))
+        return 1;
+    sd_card_t *sd = sd_get_by_num(0);
+    drive = sd->pcName;
+
+    // FAT32 com clusters de um setor, no lugar do formato escolhido pelo f_mkfs
+    static BYTE work[FF_MAX_SS];
+    MKFS_PARM opt = {.fmt = FM_FAT32, .au_size = CLUSTER};
+    check("f_mkfs", f_mkfs(drive, &opt, work, sizeof work));
+    check("f_mount", f_mount(&sd->fatfs, drive, 1));
+    if (failures)
+        return 1;
+    memset(data, 0x5A, sizeof data);
+
+    trace = fopen(argv[1], "w");
+    if (!trace) {
+        printf("FALHA: não criou %s\n", argv[1]);
+        return 1;
+    }
+    scenario();
+    fclose(trace);
+    host_cards_unmount();
+
+    if (argc > 2)
+        compare(argv[1], argv[2]);
+    if (failures) {
+        printf("%d verificações falharam\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
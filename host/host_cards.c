@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "f_util.h"
+#include "hw_config.h"
+#include "host_cards.h"
+
+static sd_card_t sd_cards[FF_VOLUMES] = {
+    {.pcName = "0:"},
+#if FF_VOLUMES > 1
+    {.pcName = "1:"},
+#endif
+};
+static size_t num_cards;
+static sd_model_t sd_models[FF_VOLUMES];
+
+size_t sd_get_num() { return num_cards; }
+sd_card_t *sd_get_by_num(size_t num) { return num < num_cards ? &sd_cards[num] : NULL; }
+
+void host_cards_defaults(host_cards_opt_t *opt)
+{
+    *opt = (host_cards_opt_t){.num_cards = 1, .size_mb = 256, .fmt = FM_ANY, .model = sd_model_default};
+}
+
+bool host_cards_option(host_cards_opt_t *opt, int c, const char *arg)
+{
+    switch (c) {
+    case 'i':
+        if (opt->num_images == FF_VOLUMES)
+            return false;
+        opt->images[opt->num_images++] = arg;
+        return true;
+    case 'n': opt->num_cards = strtoul(arg, NULL, 0); return opt->num_cards && opt->num_cards <= FF_VOLUMES;
+    case 'm': opt->size_mb = strtoul(arg, NULL, 0); return opt->size_mb;
+    case 'f': opt->format = true; return true;
+    case 'x': opt->fmt = FM_EXFAT; return true;
+    case 't': opt->timed = true; return true;
+    case 'p': return opt->timed = sd_model_load(&opt->model, arg);
+    default: return false;
+    }
+}
+
+static bool mount_card(sd_card_t *sd, bool format, BYTE fmt)
+{
+    FRESULT fr = format ? FR_NO_FILESYSTEM : f_mount(&sd->fatfs, sd->pcName, 1);
+    if (fr == FR_NO_FILESYSTEM) {
+        static BYTE work[FF_MAX_SS * 8];
+        MKFS_PARM opt = {.fmt = fmt};
+        fr = f_mkfs(sd->pcName, &opt, work, sizeof work);
+        if (fr != FR_OK) {
+            printf("%s: f_mkfs error: %s (%d)\n", sd->pcName, FRESULT_str(fr), fr);
+            return false;
+        }
+        fr = f_mount(&sd->fatfs, sd->pcName, 1);
+    }
+    if (fr != FR_OK) {
+        printf("%s: f_mount error: %s (%d)\n", sd->pcName, FRESULT_str(fr), fr);
+        return false;
+    }
+    sd->mounted = true;
+    printf("%s: %lu MB, %s\n", sd->pcName, (unsigned long)(sd->sectors / 2048),
+           sd->fatfs.fs_type == FS_EXFAT ? "exFAT" : sd->fatfs.fs_type == FS_FAT32 ? "FAT32" : "FAT");
+    return true;
+}
+
+bool host_cards_mount(const host_cards_opt_t *opt)
+{
+    num_cards = opt->num_images > opt->num_cards ? opt->num_images : opt->num_cards;
+    if (opt->timed)
+        sd_model_print_params(&opt->model);
+    bool ok = true;
+    for (size_t i = 0; i < num_cards; ++i) {
+        sd_card_t *sd = &sd_cards[i];
+        sd_host_ctor(sd);
+        sd->image_path = opt->images[i];
+        sd->sectors = (uint64_t)opt->size_mb * 2048;
+        if (opt->timed) {
+            sd_model_init(&sd_models[i], &opt->model);
+            sd->model = &sd_models[i];
+        }
+        ok &= mount_card(sd, opt->format || !sd->image_path, opt->fmt);
+        sd_model_reset_stats(&sd_models[i]);
+    }
+    return ok;
+}
+
+void host_cards_unmount()
+{
+    for (size_t i = 0; i < num_cards; ++i) {
+        f_unmount(sd_cards[i].pcName);
+        sd_cards[i].mounted = false;
+        sd_host_release(&sd_cards[i]);
+    }
+}
+
+void host_cards_print_stats()
+{
+    for (size_t i = 0; i < num_cards; ++i)
+        if (sd_cards[i].model)
+            sd_model_print_stats(sd_cards[i].model, sd_cards[i].pcName);
+}
@@ -0,0 +1,48 @@
+#ifndef HOST_CARDS_H
+#define HOST_CARDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ff.h"
+#include "sd_model.h"
+
+/**
+ * Cartões simulados dos programas do host (hw_config: sd_get_num e
+ * sd_get_by_num) e as opções de linha de comando que os configuram:
+ *
+ *   -i imagem   cartão em um arquivo de imagem (repetível, um por cartão)
+ *   -n cartões  quantos cartões (padrão: 1 ou o número de imagens)
+ *   -m MB       tamanho de um cartão na RAM ou de uma imagem nova (256)
+ *   -f          formata mesmo as imagens que já têm sistema de arquivos
+ *   -x          formata em exFAT (padrão: o que o f_mkfs escolher)
+ *   -t          tempo de um cartão real (sd_model.h, parâmetros padrão)
+ *   -p perfil   tempo do perfil (ver sd_profile_example.txt); implica -t
+ *
+ * Cartões na RAM são sempre formatados.
+ */
+
+#define HOST_CARDS_OPTIONS "i:n:m:fxtp:"
+#define HOST_CARDS_USAGE "[-i imagem]... [-n cartões] [-m MB] [-f] [-x] [-t] [-p perfil]"
+
+typedef struct {
+    const char *images[FF_VOLUMES];
+    size_t num_images;
+    size_t num_cards;
+    unsigned long size_mb;
+    bool format;
+    BYTE fmt;
+    bool timed;
+    sd_model_params_t model;
+} host_cards_opt_t;
+
+void host_cards_defaults(host_cards_opt_t *opt);
+// Trata uma opção de HOST_CARDS_OPTIONS; false se o argumento é inválido
+bool host_cards_option(host_cards_opt_t *opt, int c, const char *arg);
+
+// Cria e monta os cartões; a formatação não entra nas estatísticas do modelo
+bool host_cards_mount(const host_cards_opt_t *opt);
+void host_cards_unmount();
+void host_cards_print_stats(); // Do modelo de tempo, se houver
+
+#endif
@@ -0,0 +1,42 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+
+#include "ff.h"
+#include "my_debug.h"
+
+/**
+ * Build no host: o que my_debug.c e rtc.c fornecem no RP2040.
+ */
+
+uint64_t host_clock_offset_us;
+
+void my_printf(const char *pcFormat, ...)
+{
+    va_list xArgs;
+    va_start(xArgs, pcFormat);
+    vprintf(pcFormat, xArgs);
+    va_end(xArgs);
+    fflush(stdout);
+}
+
+void my_assert_func(const char *file, int line, const char *func, const char *pred)
+{
+    printf("assertion \"%s\" failed: file \"%s\", line %d, function: %s\n", pred, file, line, func);
+    fflush(stdout);
+    abort();
+}
+
+// Data e hora local no formato do FatFs
+DWORD get_fattime(void)
+{
+    time_t now = time(NULL);
+    struct tm t;
+    if (!localtime_r(&now, &t) || t.tm_year < 80)
+        return 0;
+    return (DWORD)(t.tm_year - 80) << 25 | (DWORD)(t.tm_mon + 1) << 21 | (DWORD)t.tm_mday << 16 |
+           (DWORD)t.tm_hour << 11 | (DWORD)t.tm_min << 5 | (DWORD)(t.tm_sec / 2);
+}
@@ -0,0 +1,17 @@
+#ifndef HOST_HW_CONFIG_H
+#define HOST_HW_CONFIG_H
+
+/**
+ * Build no host: a tabela de cartões (sem barramentos SPI), definida pelo
+ * programa (ver logger_host.c).
+ */
+
+#include <stddef.h>
+
+#include "ff.h"
+#include "sd_card.h"
+
+size_t sd_get_num();
+sd_card_t *sd_get_by_num(size_t num);
+
+#endif
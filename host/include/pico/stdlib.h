@@ -0,0 +1,54 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+/**
+ * Build no host: o subconjunto de pico/stdlib.h usado pelo código portável
+ * (datalog.c, glue.c...), com o tempo medido em CLOCK_MONOTONIC.
+ *
+ * O relógio pode ser adiantado (host_clock_advance_us): o modelo de tempo do
+ * cartão (sd_model.h) soma a ele a duração de cada operação em vez de
+ * esperar, e tudo que mede tempo (o datalog, os benchmarks) a enxerga.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef count_of
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+typedef uint64_t absolute_time_t; // us
+
+extern uint64_t host_clock_offset_us; // host_support.c
+
+static inline void host_clock_advance_us(uint64_t us) { host_clock_offset_us += us; }
+
+static inline uint64_t time_us_64(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u + host_clock_offset_us;
+}
+
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+static inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000u); }
+static inline absolute_time_t make_timeout_time_us(uint64_t us) { return time_us_64() + us; }
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return time_us_64() + ms * 1000ull; }
+static inline bool time_reached(absolute_time_t t) { return time_us_64() >= t; }
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to - from);
+}
+
+static inline void sleep_us(uint64_t us)
+{
+    struct timespec ts = {.tv_sec = (time_t)(us / 1000000u), .tv_nsec = (long)(us % 1000000u) * 1000};
+    nanosleep(&ts, NULL);
+}
+static inline void sleep_ms(uint32_t ms) { sleep_us(ms * 1000ull); }
+static inline void tight_loop_contents(void) {}
+
+#endif
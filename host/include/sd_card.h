@@ -0,0 +1,88 @@
+#ifndef HOST_SD_CARD_H
+#define HOST_SD_CARD_H
+
+/**
+ * Build no host: substitui o sd_card.h do driver. A "classe" sd_card_t mantém
+ * os campos e operações que glue.c e o pipeline de gravação usam, mas o
+ * cartão é um buffer na RAM ou um arquivo de imagem mapeado com mmap
+ * (sd_host.c). Os códigos de erro são os do driver. Com um modelo de tempo
+ * (sd_model.h) cada operação custa o que custaria em um cartão real.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "ff.h"
+
+typedef struct sd_card_t sd_card_t;
+struct sd_model_t;
+
+// Fim de uma transferência assíncrona; chamada por sd_async_busy/sd_async_wait ao vencer busy_until
+typedef void (*sd_async_callback_t)(sd_card_t *sd_card_p, int status, void *context);
+
+struct sd_card_t {
+    const char *pcName;
+    // Meio: arquivo de imagem (criado com sectors setores se não existir ou
+    // estiver vazio) ou, se NULL, RAM
+    const char *image_path;
+    uint64_t sectors;       // Tamanho do cartão; uma imagem existente define o seu
+    uint32_t au_sectors;    // Unidade de alocação informada ao FatFs (GET_BLOCK_SIZE); do modelo, se houver
+    struct sd_model_t *model; // Tempo das operações; NULL: instantâneas
+
+    // Estado
+    int m_Status;
+    uint8_t *data;          // Conteúdo do cartão (mmap da imagem ou anônimo)
+    int fd;
+    FATFS fatfs;
+    bool mounted;
+    uint64_t busy_until;    // Relógio do host em que o cartão termina a operação atual
+    struct {
+        bool pending;       // Escrita ou leitura assíncrona até busy_until
+        int status;
+        sd_async_callback_t callback;
+        void *context;
+    } async;
+
+    int (*init)(sd_card_t *sd_card_p);
+    int (*write_blocks)(sd_card_t *sd_card_p, const uint8_t *buffer,
+                        uint64_t ulSectorNumber, uint32_t blockCnt);
+    int (*read_blocks)(sd_card_t *sd_card_p, uint8_t *buffer, uint64_t ulSectorNumber,
+                       uint32_t ulSectorCount);
+    int (*trim_blocks)(sd_card_t *sd_card_p, uint64_t ulSectorNumber,
+                       uint64_t ulSectorCount);
+    // Os dados são copiados na hora; o cartão fica ocupado até busy_until
+    int (*write_blocks_async)(sd_card_t *sd_card_p, const uint8_t *buffer,
+                              uint64_t ulSectorNumber, uint32_t blockCnt,
+                              sd_async_callback_t callback, void *context);
+    int (*read_blocks_async)(sd_card_t *sd_card_p, uint8_t *buffer,
+                             uint64_t ulSectorNumber, uint32_t ulSectorCount,
+                             sd_async_callback_t callback, void *context);
+};
+
+#define SD_BLOCK_DEVICE_ERROR_NONE 0
+#define SD_BLOCK_DEVICE_ERROR_WOULD_BLOCK -5001
+#define SD_BLOCK_DEVICE_ERROR_UNSUPPORTED -5002
+#define SD_BLOCK_DEVICE_ERROR_PARAMETER -5003
+#define SD_BLOCK_DEVICE_ERROR_NO_INIT -5004
+#define SD_BLOCK_DEVICE_ERROR_NO_DEVICE -5005
+#define SD_BLOCK_DEVICE_ERROR_WRITE_PROTECTED -5006
+#define SD_BLOCK_DEVICE_ERROR_UNUSABLE -5007
+#define SD_BLOCK_DEVICE_ERROR_NO_RESPONSE -5008
+#define SD_BLOCK_DEVICE_ERROR_CRC -5009
+#define SD_BLOCK_DEVICE_ERROR_ERASE -5010
+#define SD_BLOCK_DEVICE_ERROR_WRITE -5011
+
+// Prepara um cartão da tabela (hw_config): operações e estado iniciais
+void sd_host_ctor(sd_card_t *sd_card_p);
+// Grava a imagem no arquivo (msync) e libera o meio; o cartão volta a STA_NOINIT
+void sd_host_release(sd_card_t *sd_card_p);
+
+bool sd_card_detect(sd_card_t *sd_card_p);
+uint64_t sd_sectors(sd_card_t *sd_card_p);
+bool sd_init_driver();
+
+bool sd_async_busy(sd_card_t *sd_card_p);
+int sd_async_wait(sd_card_t *sd_card_p);
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+
+#include "datalog.h"
+#include "disk_cache.h"
+#include "f_util.h"
+#include "ff.h"
+#include "host_cards.h"
+#include "sensor_source.h"
+#include "source_sim.h"
+
+/**
+ * Datalogger no Linux: monta cartões simulados (RAM ou arquivos de imagem,
+ * ver sd_host.c), grava a fonte "sim" pelo mesmo pipeline do firmware
+ * (datalog.c, stripe_log.c, glue.c e o FatFs) e mede a vazão.
+ *
+ *   logger_host [opções dos cartões] [-c] [-r Hz] [-b frames] [-s segundos]
+ *
+ * As opções dos cartões estão em host_cards.h. Uma imagem pode depois ser
+ * montada no Linux (mount -o loop) ou lida pelos scripts de ArquivosDados.
+ * Com o modelo de tempo (-t ou -p), a vazão passa a ser a do cartão modelado.
+ */
+
+static sensor_source_t *sensor_sources[] = {&sim_source};
+
+size_t sensor_source_get_num() { return count_of(sensor_sources); }
+sensor_source_t *sensor_source_get_by_num(size_t num)
+{
+    return num < sensor_source_get_num() ? sensor_sources[num] : NULL;
+}
+
+static void usage(const char *prog)
+{
+    printf("uso: %s " HOST_CARDS_USAGE " [-c] [-r Hz] [-b frames] [-s segundos]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    host_cards_opt_t cards;
+    host_cards_defaults(&cards);
+    uint32_t rate_hz = 20000, batch = 256, seconds = 60;
+    int opt;
+    while ((opt = getopt(argc, argv, HOST_CARDS_OPTIONS "cr:b:s:")) != -1) {
+        switch (opt) {
+        case 'c': sim_source.log_format = LOG_FORMAT_CSV; sim_source.log_name = "sim_data.csv"; break;
+        case 'r': rate_hz = strtoul(optarg, NULL, 0); break;
+        case 'b': batch = strtoul(optarg, NULL, 0); break;
+        case 's': seconds = strtoul(optarg, NULL, 0); break;
+        default:
+            if (!host_cards_option(&cards, opt, optarg))
+                usage(argv[0]);
+        }
+    }
+    if (!rate_hz)
+        usage(argv[0]);
+    if (!host_cards_mount(&cards))
+        return 1;
+
+    sim_source_configure(rate_hz, batch, (uint64_t)rate_hz * seconds);
+    sensor_source_init_all();
+
+    uint64_t start = time_us_64();
+    FRESULT fr = datalog_open();
+    unsigned long polls = 0;
+    uint64_t logged = 0;
+    while (fr == FR_OK) {
+        fr = datalog_poll();
+        ++polls;
+        if (sim_source_frames() == logged)
+            break; // Fonte esgotada
+        logged = sim_source_frames();
+    }
+    if (fr != FR_OK)
+        printf("datalog_poll error: %s (%d)\n", FRESULT_str(fr), fr);
+    FRESULT fc = datalog_close();
+    if (fc != FR_OK)
+        printf("datalog_close error: %s (%d)\n", FRESULT_str(fc), fc);
+    uint64_t elapsed = time_us_64() - start;
+
+    double bytes = (double)logged * sensor_source_frame_size(&sim_source);
+    printf("%llu frames (%.1f s de captura a %lu Hz), %.2f MB em %.3f s: %.1f MB/s, %lu ciclos\n",
+           (unsigned long long)logged, (double)logged / rate_hz, (unsigned long)rate_hz,
+           bytes / 1e6, elapsed / 1e6, elapsed ? bytes / elapsed : 0.0, polls);
+    disk_cache_print_stats();
+    host_cards_print_stats();
+
+    host_cards_unmount();
+    return fr == FR_OK && fc == FR_OK ? 0 : 1;
+}
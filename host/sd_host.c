@@ -0,0 +1,256 @@
+#define _GNU_SOURCE // fallocate
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "sd_card.h"
+#include "sd_model.h"
+
+/**
+ * Cartão SD do build no host: os setores ficam em um mapeamento de memória,
+ * do arquivo de imagem (MAP_SHARED, as escritas chegam ao arquivo) ou
+ * anônimo (disco na RAM, zerado sob demanda pelo kernel). As operações têm
+ * as mesmas assinaturas e códigos de erro do driver, de modo que glue.c, o
+ * FatFs e o pipeline de gravação rodam sem alteração.
+ *
+ * Com um modelo de tempo (sd->model), cada operação ocupa o cartão pelo tempo
+ * que o modelo calcula: as bloqueantes adiantam o relógio do host até o fim
+ * dela; as assíncronas só marcam busy_until, e o relógio só é adiantado por
+ * quem espera (sd_async_wait ou a próxima operação no mesmo cartão), o que
+ * permite ver o ganho de sobrepor escritas em cartões diferentes.
+ */
+
+#define SECTOR_SIZE 512
+
+static bool in_range(sd_card_t *sd, uint64_t sector, uint64_t count)
+{
+    return sector < sd->sectors && count <= sd->sectors - sector;
+}
+
+// Termina a transferência assíncrona se o relógio já passou do seu fim
+static void finish_async(sd_card_t *sd)
+{
+    if (!sd->async.pending || time_us_64() < sd->busy_until)
+        return;
+    sd->async.pending = false;
+    if (sd->async.callback)
+        sd->async.callback(sd, sd->async.status, sd->async.context);
+}
+
+// Espera (no relógio do host) o cartão terminar o que está fazendo
+static void wait_ready(sd_card_t *sd)
+{
+    uint64_t now = time_us_64();
+    if (sd->busy_until > now)
+        host_clock_advance_us(sd->busy_until - now);
+    finish_async(sd);
+}
+
+// Ocupa o cartão por us a partir de agora; bloqueante: espera o fim
+static void occupy(sd_card_t *sd, uint32_t us, bool blocking)
+{
+    wait_ready(sd);
+    sd->busy_until = time_us_64() + us;
+    if (blocking)
+        wait_ready(sd);
+}
+
+static int host_init(sd_card_t *sd)
+{
+    if (!(sd->m_Status & STA_NOINIT))
+        return sd->m_Status;
+    if (!sd->sectors && !sd->image_path) {
+        printf("%s: tamanho do disco não definido\n", sd->pcName);
+        return sd->m_Status;
+    }
+    uint8_t *data;
+    if (sd->image_path) {
+        int fd = open(sd->image_path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            perror(sd->image_path);
+            return sd->m_Status;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size >= SECTOR_SIZE)
+            sd->sectors = (uint64_t)st.st_size / SECTOR_SIZE;
+        else if (!sd->sectors || ftruncate(fd, (off_t)(sd->sectors * SECTOR_SIZE)) != 0) {
+            printf("%s: não foi possível criar a imagem %s\n", sd->pcName, sd->image_path);
+            close(fd);
+            return sd->m_Status;
+        }
+        data = mmap(NULL, sd->sectors * SECTOR_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(sd->image_path);
+            close(fd);
+            return sd->m_Status;
+        }
+        sd->fd = fd;
+    } else {
+        data = mmap(NULL, sd->sectors * SECTOR_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (data == MAP_FAILED) {
+            perror(sd->pcName);
+            return sd->m_Status;
+        }
+    }
+    sd->data = data;
+    if (sd->model)
+        sd->au_sectors = sd->model->p.au_sectors;
+    if (!sd->au_sectors)
+        sd->au_sectors = 4 * 1024 * 1024 / SECTOR_SIZE; // AU típica de cartões SDHC
+    sd->m_Status &= ~STA_NOINIT;
+    return sd->m_Status;
+}
+
+static int host_read_blocks(sd_card_t *sd, uint8_t *buffer, uint64_t sector, uint32_t count)
+{
+    if (sd->m_Status & STA_NOINIT)
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!in_range(sd, sector, count))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    memcpy(buffer, sd->data + sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+    occupy(sd, sd->model ? sd_model_read_us(sd->model, sector, count) : 0, true);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int host_write_blocks(sd_card_t *sd, const uint8_t *buffer, uint64_t sector, uint32_t count)
+{
+    if (sd->m_Status & STA_NOINIT)
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!in_range(sd, sector, count))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    memcpy(sd->data + sector * SECTOR_SIZE, buffer, (size_t)count * SECTOR_SIZE);
+    occupy(sd, sd->model ? sd_model_write_us(sd->model, sector, count) : 0, true);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int start_async(sd_card_t *sd, uint32_t us, sd_async_callback_t callback, void *context)
+{
+    occupy(sd, us, false);
+    sd->async.pending = true;
+    sd->async.status = SD_BLOCK_DEVICE_ERROR_NONE;
+    sd->async.callback = callback;
+    sd->async.context = context;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int host_write_blocks_async(sd_card_t *sd, const uint8_t *buffer, uint64_t sector,
+                                   uint32_t count, sd_async_callback_t callback, void *context)
+{
+    if (sd->m_Status & STA_NOINIT)
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!in_range(sd, sector, count))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    wait_ready(sd); // Como no driver: uma transferência por vez em cada cartão
+    memcpy(sd->data + sector * SECTOR_SIZE, buffer, (size_t)count * SECTOR_SIZE);
+    return start_async(sd, sd->model ? sd_model_write_us(sd->model, sector, count) : 0, callback,
+                       context);
+}
+
+static int host_read_blocks_async(sd_card_t *sd, uint8_t *buffer, uint64_t sector, uint32_t count,
+                                  sd_async_callback_t callback, void *context)
+{
+    if (sd->m_Status & STA_NOINIT)
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!in_range(sd, sector, count))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    wait_ready(sd);
+    memcpy(buffer, sd->data + sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+    return start_async(sd, sd->model ? sd_model_read_us(sd->model, sector, count) : 0, callback,
+                       context);
+}
+
+// Setores apagados leem como zero, como na maioria dos cartões (DATA_STAT_AFTER_ERASE = 0)
+static int host_trim_blocks(sd_card_t *sd, uint64_t sector, uint64_t count)
+{
+    if (sd->m_Status & STA_NOINIT)
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    if (!in_range(sd, sector, count))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    occupy(sd, sd->model ? sd_model_trim_us(sd->model, sector, count) : 0, true);
+    uint8_t *p = sd->data + sector * SECTOR_SIZE;
+    size_t bytes = (size_t)count * SECTOR_SIZE;
+    // Devolve as páginas inteiras ao kernel (na imagem, abre um buraco no arquivo)
+    if (sd->image_path) {
+        if (fallocate(sd->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      (off_t)(sector * SECTOR_SIZE), (off_t)bytes) == 0)
+            return SD_BLOCK_DEVICE_ERROR_NONE;
+    } else {
+        uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t first = ((uintptr_t)p + page - 1) & ~(page - 1);
+        uintptr_t last = ((uintptr_t)p + bytes) & ~(page - 1);
+        if (first < last && madvise((void *)first, last - first, MADV_DONTNEED) == 0) {
+            memset(p, 0, first - (uintptr_t)p);
+            memset((void *)last, 0, (uintptr_t)p + bytes - last);
+            return SD_BLOCK_DEVICE_ERROR_NONE;
+        }
+    }
+    memset(p, 0, bytes);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+void sd_host_ctor(sd_card_t *sd)
+{
+    sd->m_Status = STA_NOINIT;
+    sd->data = NULL;
+    sd->fd = -1;
+    sd->mounted = false;
+    sd->busy_until = 0;
+    sd->async.pending = false;
+    sd->init = host_init;
+    sd->read_blocks = host_read_blocks;
+    sd->write_blocks = host_write_blocks;
+    sd->trim_blocks = host_trim_blocks;
+    sd->write_blocks_async = host_write_blocks_async;
+    sd->read_blocks_async = host_read_blocks_async;
+}
+
+void sd_host_release(sd_card_t *sd)
+{
+    wait_ready(sd);
+    if (sd->data) {
+        if (sd->image_path)
+            msync(sd->data, sd->sectors * SECTOR_SIZE, MS_SYNC);
+        munmap(sd->data, sd->sectors * SECTOR_SIZE);
+        sd->data = NULL;
+    }
+    if (sd->fd >= 0) {
+        close(sd->fd);
+        sd->fd = -1;
+    }
+    sd->m_Status |= STA_NOINIT;
+}
+
+bool sd_card_detect(sd_card_t *sd)
+{
+    return true;
+}
+
+uint64_t sd_sectors(sd_card_t *sd)
+{
+    return sd->sectors;
+}
+
+bool sd_init_driver()
+{
+    return true;
+}
+
+bool sd_async_busy(sd_card_t *sd)
+{
+    finish_async(sd);
+    return sd->async.pending;
+}
+
+int sd_async_wait(sd_card_t *sd)
+{
+    bool pending = sd->async.pending;
+    wait_ready(sd);
+    return pending ? sd->async.status : SD_BLOCK_DEVICE_ERROR_NONE;
+}
@@ -0,0 +1,352 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sd_model.h"
+
+const sd_model_params_t sd_model_default = {
+    .spi_hz = 12500000,
+    .cmd_us = 30,
+    .read_access_us = 150,
+    .write_busy_us = 700,
+    .block_busy_us = 80,
+    .stop_busy_us = 300,
+    .au_sectors = 8192,
+    .open_aus = 2,
+    .au_open_us = 5000,
+    .gc_every_kb = 4096,
+    .gc_min_us = 100000,
+    .gc_max_us = 400000,
+    .erase_us = 2000,
+    .seed = 1,
+};
+
+static const struct {
+    const char *key;
+    size_t offset;
+} model_keys[] = {
+#define KEY(f) {#f, offsetof(sd_model_params_t, f)}
+    KEY(spi_hz), KEY(cmd_us), KEY(read_access_us), KEY(write_busy_us), KEY(block_busy_us),
+    KEY(stop_busy_us), KEY(au_sectors), KEY(open_aus), KEY(au_open_us), KEY(gc_every_kb),
+    KEY(gc_min_us), KEY(gc_max_us), KEY(erase_us), KEY(seed),
+#undef KEY
+};
+
+#define STATS_BUCKETS 16        // SD_STATS_BUCKETS do driver: balde b < 16 << b us
+#define STALL_BUCKET 11         // Primeiro balde >= 16 ms: coleta de lixo
+
+// Bytes na linha por bloco: token, dados, CRC16 e (na escrita) a resposta
+#define WIRE_READ_BYTES (1 + 512 + 2)
+#define WIRE_WRITE_BYTES (1 + 512 + 2 + 1)
+#define WIRE_CMD_BYTES 8        // Comando, R1 e enchimento
+
+static uint32_t wire_us(const sd_model_params_t *p, uint64_t bytes)
+{
+    return (uint32_t)(bytes * 8 * 1000000 / p->spi_hz);
+}
+
+static uint32_t next_rand(sd_model_t *m)
+{
+    // xorshift32
+    m->rng ^= m->rng << 13;
+    m->rng ^= m->rng >> 17;
+    m->rng ^= m->rng << 5;
+    return m->rng;
+}
+
+static uint32_t rand_between(sd_model_t *m, uint32_t lo, uint32_t hi)
+{
+    return hi > lo ? lo + next_rand(m) % (hi - lo + 1) : lo;
+}
+
+static void arm_gc(sd_model_t *m)
+{
+    // Entre metade e uma vez e meia a média
+    uint32_t kb = m->p.gc_every_kb;
+    m->gc_countdown = (int64_t)rand_between(m, kb / 2, kb + kb / 2) * 1024;
+}
+
+void sd_model_init(sd_model_t *m, const sd_model_params_t *p)
+{
+    memset(m, 0, sizeof *m);
+    m->p = *p;
+    if (!m->p.spi_hz)
+        m->p.spi_hz = sd_model_default.spi_hz;
+    if (!m->p.au_sectors)
+        m->p.au_sectors = sd_model_default.au_sectors;
+    if (m->p.open_aus < 1)
+        m->p.open_aus = 1;
+    if (m->p.open_aus > SD_MODEL_MAX_OPEN_AUS)
+        m->p.open_aus = SD_MODEL_MAX_OPEN_AUS;
+    m->rng = m->p.seed ? m->p.seed : 1;
+    if (m->p.gc_every_kb)
+        arm_gc(m);
+}
+
+static uint32_t account(sd_model_t *m, uint32_t us, uint32_t wire)
+{
+    m->ops++;
+    m->total_us += us;
+    m->transfer_us += wire;
+    return us;
+}
+
+uint32_t sd_model_read_us(sd_model_t *m, uint64_t lba, uint32_t count)
+{
+    uint32_t wire = wire_us(&m->p, WIRE_CMD_BYTES * (count > 1 ? 2 : 1) + (uint64_t)WIRE_READ_BYTES * count);
+    return account(m, m->p.cmd_us * (count > 1 ? 2 : 1) + count * m->p.read_access_us + wire, wire);
+}
+
+// Custo de abrir a AU, se ela não estiver entre as abertas; a aberta vai para a frente
+static uint32_t touch_au(sd_model_t *m, uint64_t au)
+{
+    uint32_t i = 0;
+    while (i < m->num_open && m->open[i] != au)
+        ++i;
+    bool was_open = i < m->num_open;
+    if (!was_open)
+        i = m->num_open < m->p.open_aus ? m->num_open++ : m->num_open - 1; // Fecha a mais antiga
+    memmove(&m->open[1], &m->open[0], i * sizeof m->open[0]);
+    m->open[0] = au;
+    if (was_open)
+        return 0;
+    m->au_opens++;
+    return m->p.au_open_us;
+}
+
+uint32_t sd_model_write_us(sd_model_t *m, uint64_t lba, uint32_t count)
+{
+    const sd_model_params_t *p = &m->p;
+    uint32_t wire, us;
+    if (count > 1) {
+        // CMD25: comando, blocos e Stop Tran, programação de cada bloco
+        wire = wire_us(p, WIRE_CMD_BYTES + (uint64_t)WIRE_WRITE_BYTES * count + 2);
+        us = p->cmd_us + wire + count * p->block_busy_us + p->stop_busy_us;
+    } else {
+        wire = wire_us(p, WIRE_CMD_BYTES + WIRE_WRITE_BYTES);
+        us = p->cmd_us + wire + p->write_busy_us;
+    }
+    for (uint64_t au = lba / p->au_sectors; au <= (lba + count - 1) / p->au_sectors; ++au)
+        us += touch_au(m, au);
+    if (p->gc_every_kb) {
+        m->gc_countdown -= (int64_t)count * 512;
+        if (m->gc_countdown <= 0) {
+            uint32_t stall = rand_between(m, p->gc_min_us, p->gc_max_us);
+            us += stall;
+            m->gc_stalls++;
+            m->gc_us += stall;
+            arm_gc(m);
+        }
+    }
+    return account(m, us, wire);
+}
+
+uint32_t sd_model_trim_us(sd_model_t *m, uint64_t lba, uint64_t count)
+{
+    // CMD32, CMD33 e CMD38, e o apagamento
+    uint32_t wire = wire_us(&m->p, 3 * WIRE_CMD_BYTES);
+    return account(m, 3 * m->p.cmd_us + wire + m->p.erase_us, wire);
+}
+
+/* Perfil */
+
+static char *trim(char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        ++s;
+    char *e = s + strlen(s);
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n'))
+        *--e = '\0';
+    return s;
+}
+
+// Aplica as linhas "chave = valor"; card recebe o cartão escolhido. false se há chave desconhecida.
+static bool apply_keys(FILE *fp, sd_model_params_t *p, char *card, size_t card_size)
+{
+    char line[256];
+    bool ok = true;
+    rewind(fp);
+    while (fgets(line, sizeof line, fp)) {
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char *eq = strchr(line, '=');
+        if (!eq || !strncmp(trim(line), "SD ", 3))
+            continue;
+        *eq = '\0';
+        char *key = trim(line), *value = trim(eq + 1);
+        if (!strcmp(key, "card")) {
+            snprintf(card, card_size, "%s", value);
+            continue;
+        }
+        size_t k = 0;
+        while (k < sizeof model_keys / sizeof model_keys[0] && strcmp(key, model_keys[k].key))
+            ++k;
+        if (k == sizeof model_keys / sizeof model_keys[0]) {
+            printf("Perfil: chave desconhecida \"%s\"\n", key);
+            ok = false;
+            continue;
+        }
+        *(uint32_t *)((char *)p + model_keys[k].offset) = (uint32_t)strtoul(value, NULL, 0);
+    }
+    return ok;
+}
+
+// Uma linha de operação do relatório do driver
+typedef struct {
+    unsigned long count, errors, avg_us, max_us;
+    unsigned long hist[STATS_BUCKETS];
+} report_op_t;
+
+enum { OP17, OP18, OP24, OP25, REPORT_OPS };
+
+// Operações que foram coletas de lixo (>= 16 ms) e o tempo estimado delas
+static unsigned long stalls(const report_op_t *o, double *stall_us, unsigned long *lowest_us)
+{
+    unsigned long n = 0;
+    for (unsigned b = STALL_BUCKET; b < STATS_BUCKETS; ++b) {
+        if (!o->hist[b])
+            continue;
+        unsigned long lo = 8ul << b, hi = b == STATS_BUCKETS - 1 ? o->max_us : 16ul << b;
+        if (hi < lo)
+            hi = lo;
+        n += o->hist[b];
+        *stall_us += (double)o->hist[b] * (lo + hi) / 2;
+        if (lo < *lowest_us)
+            *lowest_us = lo;
+    }
+    return n;
+}
+
+// Média das operações sem as coletas de lixo
+static double normal_avg(const report_op_t *o, unsigned long n_stalls, double stall_us)
+{
+    if (o->count <= n_stalls)
+        return 0;
+    double avg = ((double)o->avg_us * o->count - stall_us) / (o->count - n_stalls);
+    return avg > 0 ? avg : 0;
+}
+
+static uint32_t positive(double us)
+{
+    return us > 0 ? (uint32_t)(us + 0.5) : 0;
+}
+
+// Ajusta os parâmetros ao relatório das estatísticas do driver. false se não há relatório.
+static bool fit_report(FILE *fp, sd_model_params_t *p, char *card, size_t card_size)
+{
+    static const char *const names[REPORT_OPS] = {"CMD17", "CMD18", "CMD24", "CMD25"};
+    report_op_t ops[REPORT_OPS] = {0};
+    unsigned long hz = 0, kb_read = 0, kb_written = 0;
+    char line[256], name[32], op[8];
+    bool found = false;
+    rewind(fp);
+    while (fgets(line, sizeof line, fp)) {
+        unsigned long a, b, c, d;
+        if (sscanf(line, "SD %31s %lu Hz, %lu KB read, %lu KB written", name, &a, &b, &c) == 4) {
+            if (!card[0])
+                snprintf(card, card_size, "%s", name);
+            if (strcmp(name, card))
+                continue;
+            hz = a, kb_read = b, kb_written = c;
+            found = true;
+            memset(ops, 0, sizeof ops); // Vários relatórios no arquivo: vale o último
+            continue;
+        }
+        int n;
+        if (sscanf(line, "SD %31s %7s %lu %lu %lu %lu |%n", name, op, &a, &b, &c, &d, &n) != 6 ||
+            strcmp(name, card))
+            continue;
+        for (unsigned i = 0; i < REPORT_OPS; ++i) {
+            if (strcmp(op, names[i]))
+                continue;
+            report_op_t *o = &ops[i];
+            o->count = a, o->errors = b, o->avg_us = c, o->max_us = d;
+            char *s = line + n;
+            for (unsigned h = 0; h < STATS_BUCKETS; ++h)
+                o->hist[h] = strtoul(s, &s, 10);
+        }
+    }
+    if (!found)
+        return false;
+    if (hz)
+        p->spi_hz = (uint32_t)hz;
+
+    // Escritas: separa as coletas de lixo da programação normal
+    double stall_us = 0, s24 = 0, s25 = 0;
+    unsigned long lowest = ~0ul;
+    unsigned long n24 = stalls(&ops[OP24], &s24, &lowest), n25 = stalls(&ops[OP25], &s25, &lowest);
+    stall_us = s24 + s25;
+    if (ops[OP24].count > n24)
+        p->write_busy_us = positive(normal_avg(&ops[OP24], n24, s24) - p->cmd_us -
+                                    wire_us(p, WIRE_CMD_BYTES + WIRE_WRITE_BYTES));
+    double blocks = (double)kb_written * 2 - ops[OP24].count;
+    if (ops[OP25].count > n25 && blocks > ops[OP25].count) {
+        double per_op = blocks / ops[OP25].count;
+        double busy = normal_avg(&ops[OP25], n25, s25) - p->cmd_us - p->stop_busy_us -
+                      wire_us(p, WIRE_CMD_BYTES + (uint64_t)(WIRE_WRITE_BYTES * per_op));
+        p->block_busy_us = positive(busy / per_op);
+    }
+    if (n24 + n25) {
+        p->gc_every_kb = kb_written / (n24 + n25) ? (uint32_t)(kb_written / (n24 + n25)) : 1;
+        p->gc_min_us = (uint32_t)lowest;
+        p->gc_max_us = (uint32_t)(ops[OP24].max_us > ops[OP25].max_us ? ops[OP24].max_us : ops[OP25].max_us);
+        if (p->gc_max_us < p->gc_min_us)
+            p->gc_max_us = p->gc_min_us;
+    } else if (ops[OP24].count + ops[OP25].count) {
+        p->gc_every_kb = 0; // O cartão não parou nenhuma vez
+    }
+
+    // Leituras: tempo de acesso por bloco
+    if (ops[OP17].count)
+        p->read_access_us = positive(ops[OP17].avg_us - p->cmd_us -
+                                     wire_us(p, WIRE_CMD_BYTES + WIRE_READ_BYTES));
+    else if (ops[OP18].count && kb_read * 2 > ops[OP18].count) {
+        double per_op = (double)kb_read * 2 / ops[OP18].count;
+        double access = ops[OP18].avg_us - 2.0 * p->cmd_us -
+                        wire_us(p, 2 * WIRE_CMD_BYTES + (uint64_t)(WIRE_READ_BYTES * per_op));
+        p->read_access_us = positive(access / per_op);
+    }
+    printf("Perfil: ajustado ao relatório do cartão %s (%lu KB escritos, %lu paradas de %.0f ms em média)\n",
+           card, kb_written, n24 + n25, n24 + n25 ? stall_us / (n24 + n25) / 1000 : 0.0);
+    return true;
+}
+
+bool sd_model_load(sd_model_params_t *p, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    char card[32] = "";
+    // As chaves explícitas valem para o ajuste (cmd_us, stop_busy_us...) e depois dele
+    bool ok = apply_keys(fp, p, card, sizeof card);
+    fit_report(fp, p, card, sizeof card);
+    apply_keys(fp, p, card, sizeof card);
+    fclose(fp);
+    return ok;
+}
+
+void sd_model_print_params(const sd_model_params_t *p)
+{
+    for (size_t k = 0; k < sizeof model_keys / sizeof model_keys[0]; ++k)
+        printf("%s%s = %lu", k ? ", " : "Modelo: ", model_keys[k].key,
+               (unsigned long)*(const uint32_t *)((const char *)p + model_keys[k].offset));
+    printf("\n");
+}
+
+void sd_model_print_stats(const sd_model_t *m, const char *name)
+{
+    printf("Modelo %s: %llu operações, %.3f s ocupado (%.3f s de dados na linha), "
+           "%llu AUs abertas, %llu coletas de lixo (%.3f s)\n",
+           name, (unsigned long long)m->ops, m->total_us / 1e6, m->transfer_us / 1e6,
+           (unsigned long long)m->au_opens, (unsigned long long)m->gc_stalls, m->gc_us / 1e6);
+}
+
+void sd_model_reset_stats(sd_model_t *m)
+{
+    m->ops = m->total_us = m->transfer_us = 0;
+    m->au_opens = m->gc_stalls = m->gc_us = 0;
+}
@@ -0,0 +1,79 @@
+#ifndef SD_MODEL_H
+#define SD_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Modelo de tempo de um cartão SD em SPI, para o build no host: quanto dura
+ * cada leitura, escrita ou apagamento de blocos. sd_host.c soma a duração ao
+ * relógio do host (host_clock_advance_us, em pico/stdlib.h) em vez de
+ * esperar, e mantém o cartão ocupado até lá nas escritas assíncronas; assim
+ * as vazões medidas refletem o cartão, não a RAM, e estratégias de buffer e
+ * de escrita em paralelo podem ser comparadas.
+ *
+ * Modelado: clock do SPI (bytes na linha), custo fixo por comando, tempo de
+ * acesso na leitura, programação por bloco (CMD24 e CMD25) e o ocupado após
+ * o Stop Tran, abertura de AU (o cartão mantém poucas AUs abertas para
+ * escrita; escrever fora delas custa caro), coletas de lixo de centenas de ms
+ * a cada tantos KB escritos, e apagamento. Um barramento por cartão.
+ */
+
+#define SD_MODEL_MAX_OPEN_AUS 8
+
+typedef struct {
+    uint32_t spi_hz;          // SCK
+    uint32_t cmd_us;          // Por comando: quadro, resposta e software, sem os dados
+    uint32_t read_access_us;  // Até o token de cada bloco lido (Nac)
+    uint32_t write_busy_us;   // Programação de um bloco isolado (CMD24)
+    uint32_t block_busy_us;   // Programação de cada bloco de um CMD25
+    uint32_t stop_busy_us;    // Ocupado após o Stop Tran do CMD25
+    uint32_t au_sectors;      // Unidade de alocação
+    uint32_t open_aus;        // AUs abertas para escrita ao mesmo tempo (1..SD_MODEL_MAX_OPEN_AUS)
+    uint32_t au_open_us;      // Ocupado extra ao escrever em uma AU que não está aberta
+    uint32_t gc_every_kb;     // KB escritos entre coletas de lixo, em média; 0: sem coletas
+    uint32_t gc_min_us;       // Duração de uma coleta: uniforme entre min e max
+    uint32_t gc_max_us;
+    uint32_t erase_us;        // Apagamento de um trecho (CMD32/33/38)
+    uint32_t seed;            // Sorteios determinísticos
+} sd_model_params_t;
+
+typedef struct sd_model_t {
+    sd_model_params_t p;
+    uint32_t rng;
+    uint64_t open[SD_MODEL_MAX_OPEN_AUS]; // AUs abertas, da mais recente para a mais antiga
+    uint32_t num_open;
+    int64_t gc_countdown;     // Bytes até a próxima coleta
+
+    // Estatísticas
+    uint64_t ops;
+    uint64_t total_us;
+    uint64_t transfer_us;     // Dados na linha
+    uint64_t au_opens;
+    uint64_t gc_stalls;
+    uint64_t gc_us;
+} sd_model_t;
+
+// Cartão classe 10 típico em SPI a 12,5 MHz
+extern const sd_model_params_t sd_model_default;
+
+/* Lê um perfil: linhas "chave = valor" com os nomes dos campos de
+ * sd_model_params_t (# inicia comentário) e/ou o relatório das estatísticas
+ * do driver capturado em um cartão real (sd_stats.txt, comando 'd' no
+ * terminal). Do relatório saem o clock, o tempo de acesso, a programação por
+ * bloco e as coletas de lixo (operações de escrita de 16 ms ou mais), do
+ * cartão "card = <nome>" ou do primeiro que aparecer; as chaves explícitas
+ * prevalecem. As AUs não aparecem no relatório e vêm do perfil. */
+bool sd_model_load(sd_model_params_t *p, const char *path);
+
+void sd_model_init(sd_model_t *m, const sd_model_params_t *p);
+// Duração de cada operação, em us
+uint32_t sd_model_read_us(sd_model_t *m, uint64_t lba, uint32_t count);
+uint32_t sd_model_write_us(sd_model_t *m, uint64_t lba, uint32_t count);
+uint32_t sd_model_trim_us(sd_model_t *m, uint64_t lba, uint64_t count);
+
+void sd_model_print_params(const sd_model_params_t *p);
+void sd_model_print_stats(const sd_model_t *m, const char *name);
+void sd_model_reset_stats(sd_model_t *m); // O estado do cartão (AUs abertas, coleta) continua
+
+#endif
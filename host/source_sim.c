@@ -0,0 +1,95 @@
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+
+#include "source_sim.h"
+
+#define SIM_MAX_BATCH 4096
+
+typedef struct {
+    int16_t ax, ay, az;
+    uint16_t seq;
+} sim_frame_t;
+
+static const channel_desc_t sim_channels[] = {
+    {"ax", CHANNEL_INT16},
+    {"ay", CHANNEL_INT16},
+    {"az", CHANNEL_INT16},
+    {"seq", CHANNEL_UINT16},
+};
+
+static sim_frame_t sim_buffer[SIM_MAX_BATCH];
+static uint32_t sim_rate_hz = 10000;
+static uint32_t sim_batch = 256;
+static uint64_t sim_total = 100000;
+static uint64_t sim_index;
+static uint64_t sim_t0_us;
+
+void sim_source_configure(uint32_t rate_hz, uint32_t frames_per_batch, uint64_t total_frames)
+{
+    sim_rate_hz = rate_hz ? rate_hz : 1;
+    sim_batch = frames_per_batch < 1 ? 1 : frames_per_batch > SIM_MAX_BATCH ? SIM_MAX_BATCH : frames_per_batch;
+    sim_total = total_frames;
+}
+
+uint64_t sim_source_frames()
+{
+    return sim_index;
+}
+
+// Onda triangular de período p amostras e amplitude a
+static int16_t triangle(uint64_t n, uint32_t p, int32_t a)
+{
+    int32_t x = (int32_t)(n % p) * 4 * a / (int32_t)p; // 0..4a
+    return (int16_t)(x < 2 * a ? x - a : 3 * a - x);
+}
+
+static bool sim_source_init(sensor_source_t *src)
+{
+    src->channels = sim_channels;
+    src->num_channels = count_of(sim_channels);
+    return true;
+}
+
+static void sim_source_start(sensor_source_t *src)
+{
+    sim_index = 0;
+    sim_t0_us = time_us_64();
+}
+
+static void sim_source_stop(sensor_source_t *src)
+{
+}
+
+static size_t sim_source_read_batch(sensor_source_t *src, sensor_batch_t *batch)
+{
+    if (sim_index >= sim_total)
+        return 0;
+    size_t n = sim_total - sim_index < sim_batch ? (size_t)(sim_total - sim_index) : sim_batch;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t k = sim_index + i;
+        sim_buffer[i].ax = triangle(k, 1000, 16000);
+        sim_buffer[i].ay = triangle(k, 777, 8000);
+        sim_buffer[i].az = (int16_t)(triangle(k, 50, 2000) + 16384);
+        sim_buffer[i].seq = (uint16_t)k;
+    }
+    batch->first_index = sim_index;
+    batch->t0_us = sim_t0_us + sim_index * 1000000u / sim_rate_hz;
+    batch->period_ns = 1000000000u / sim_rate_hz;
+    batch->dropped = 0;
+    batch->num_frames = n;
+    batch->data = sim_buffer;
+    sim_index += n;
+    return n;
+}
+
+sensor_source_t sim_source = {
+    .name = "sim",
+    .log_name = "sim_data.bin",
+    .log_format = LOG_FORMAT_BINARY,
+    .timestamp = TIMESTAMP_SAMPLE_CLOCK,
+    .init = sim_source_init,
+    .start = sim_source_start,
+    .stop = sim_source_stop,
+    .read_batch = sim_source_read_batch,
+};
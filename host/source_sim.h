@@ -0,0 +1,20 @@
+#ifndef SOURCE_SIM_H
+#define SOURCE_SIM_H
+
+#include <stdint.h>
+
+#include "sensor_source.h"
+
+/**
+ * Fonte "sim" do build no host: frames sintéticos e determinísticos (três
+ * ondas triangulares e um contador), sem hardware. Cada leitura entrega um
+ * lote de tamanho fixo até completar o total configurado, o mais rápido que
+ * o pipeline consumir; os instantes seguem o relógio de amostragem simulado.
+ */
+
+extern sensor_source_t sim_source;
+
+void sim_source_configure(uint32_t rate_hz, uint32_t frames_per_batch, uint64_t total_frames);
+uint64_t sim_source_frames(); // Frames entregues desde start()
+
+#endif
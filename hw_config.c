@@ -9,6 +9,9 @@
 #include "ff.h" /* Obtains integer types */
 //
 #include "diskio.h" /* Declarations of disk functions */
+//
+#include "mpu6050.h"
+#include "sensor_source.h"
 
 /* 
 This example assumes the following hardware configuration:
@@ -23,6 +26,13 @@ This example assumes the following hardware configuration:
 | GND   |       |       | 18,23 |           | GND       | Ground                 |
 | 3v3   |       |       | 36    |           | 3v3       | 3.3 volt power         |
 
+Card detect stays off on this board: GPIO 22 is the joystick button.
+
+GPIOs used by this firmware (Tarefa12.c, the tables below): 0-1 (i2c0),
+5-6 (buttons A and B), 10 (buzzer), 11-13 (RGB LED), 14-15 (i2c1, display),
+16-19 (this card), 22 (joystick button), 26-27 (joystick, ADC capture).
+Free for the examples below: 2-4, 7-9, 20-21 and 28.
+
 */
 
 // Hardware Configuration of SPI "objects"
@@ -35,9 +45,10 @@ static spi_t spis[] = {  // One for each SPI.
         .mosi_gpio = 19,
         .sck_gpio = 18,
 
-        // .baud_rate = 1000 * 1000
-        .baud_rate = 1000 * 1000
-        // .baud_rate = 25 * 1000 * 1000 // Actual frequency: 20833333.
+        // Upper bound: each card steps up to the lower of this and its CSD
+        // TRAN_SPEED, keeping the fastest rate that passes CRC-checked test
+        // reads (see sd_negotiate_baud_rate in sd_card.c).
+        .baud_rate = 25 * 1000 * 1000 // Actual frequency: 20833333.
     }};
 
 // Hardware Configuration of the SD Card "objects"
@@ -51,6 +62,106 @@ static sd_card_t sd_cards[] = {  // One for each SD card
         .card_detected_true = -1  // What the GPIO read returns when a card is
                                  // present.
     }};
+/* Other backends (see sd_card_sdio.c and spi.c):
+
+4-bit SD mode, on PIO state machines. CLK must be the GPIO two below D0 and
+D0-D3 consecutive; SS and SPI aren't used. This board has no four consecutive
+free GPIOs: the wiring below replaces the SPI card (16-19) and needs GPIO 22,
+which is BUTTON_J here, so the joystick button has to be moved or left out
+(Tarefa12.c) before using it:
+    static sdio_if_t sdio_if = {
+        .pio = pio0,      // Command/clock; the data state machines use pio1
+        .CMD_gpio = 19,
+        .D0_gpio = 20,    // D1 = 21, D2 = 22 (BUTTON_J!), D3 = 23; CLK = 18
+        .baud_rate = 25 * 1000 * 1000 // Default speed
+    };
+    ... in sd_cards[]:
+        .type = SD_IF_SDIO,
+        .sdio_if = &sdio_if,
+
+A second card on its own bus, for striped logging (see lib/stripe_log.h):
+each bus has its own DMA channels, so both cards write at the same time.
+Every SCK option of spi1 (GPIO 10, 14, 26) is taken on this board, so the
+second bus is SPI on PIO, which runs on any GPIOs:
+    ... in spis[]:
+    {
+        .pio = pio1,      // hw_inst is then ignored
+        .miso_gpio = 4, .mosi_gpio = 3, .sck_gpio = 2,
+        .baud_rate = 25 * 1000 * 1000 // Actual frequency: 20833333 (sys 125 MHz)
+    }
+    ... in sd_cards[]:
+    {
+        .pcName = "1:",
+        .spi = &spis[1],
+        .ss_gpio = 8,
+        .use_card_detect = false
+    }
+
+On a board where they are free, spi1 itself works the same way, e.g.
+    .hw_inst = spi1, .miso_gpio = 12, .mosi_gpio = 11, .sck_gpio = 10
+with .ss_gpio = 13 (here the buzzer and the RGB LED).
+*/
+
+/* 
+Sensores MPU6050: até dois por barramento (pino AD0 em nível baixo = 0x68,
+em nível alto = 0x69). O display SSD1306 (0x3C) compartilha o i2c1.
+
+|       | I2C   | GPIO  | Pin   | Description            |
+| ----- | ----  | ----- | ---   | ---------------------- |
+| SDA   | i2c0  | 0     | 1     | mpu0, mpu1             |
+| SCL   | i2c0  | 1     | 2     |                        |
+| SDA   | i2c1  | 14    | 19    | mpu2, mpu3, display    |
+| SCL   | i2c1  | 15    | 20    |                        |
+
+*/
+
+// Hardware Configuration of the I2C buses used by the sensors
+static i2c_bus_t i2c_buses[] = {  // One for each I2C.
+    {
+        .hw_inst = i2c0,
+        .sda_gpio = 0,
+        .scl_gpio = 1,
+        .baud_rate = 400 * 1000
+    },
+    {
+        .hw_inst = i2c1,
+        .sda_gpio = 14,
+        .scl_gpio = 15,
+        .baud_rate = 400 * 1000
+    }};
+
+// Hardware Configuration of the MPU6050 "objects"
+// Sensors that don't answer at startup are skipped, so unused entries are harmless.
+static mpu6050_t mpu_sensors[] = {  // One for each MPU6050
+    {
+        .name = "mpu0",
+        .bus = &i2c_buses[0],
+        .addr = MPU6050_ADDR_AD0_LOW
+    },
+    {
+        .name = "mpu1",
+        .bus = &i2c_buses[0],
+        .addr = MPU6050_ADDR_AD0_HIGH
+    },
+    {
+        .name = "mpu2",
+        .bus = &i2c_buses[1],
+        .addr = MPU6050_ADDR_AD0_LOW
+    },
+    {
+        .name = "mpu3",
+        .bus = &i2c_buses[1],
+        .addr = MPU6050_ADDR_AD0_HIGH
+    }};
+
+// Data sources logged during a capture, each to its own file.
+// Order matters: a source may depend on one initialized before it
+// (orientation is computed from the mpu6050 readings).
+static sensor_source_t *sensor_sources[] = {
+    &mpu6050_source,
+    &orientation_source,
+    &adc_source
+};
 
 /* ********************************************************************** */
 size_t sd_get_num() { return count_of(sd_cards); }
@@ -72,4 +183,24 @@ spi_t *spi_get_by_num(size_t num) {
     }
 }
 
+size_t mpu_get_num() { return count_of(mpu_sensors); }
+mpu6050_t *mpu_get_by_num(size_t num) {
+    assert(num < mpu_get_num());
+    if (num < mpu_get_num()) {
+        return &mpu_sensors[num];
+    } else {
+        return NULL;
+    }
+}
+
+size_t sensor_source_get_num() { return count_of(sensor_sources); }
+sensor_source_t *sensor_source_get_by_num(size_t num) {
+    assert(num < sensor_source_get_num());
+    if (num < sensor_source_get_num()) {
+        return sensor_sources[num];
+    } else {
+        return NULL;
+    }
+}
+
 /* [] END OF FILE */
@@ -1231,6 +1231,81 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 
 
 
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Free cluster map                                       */
+/*-----------------------------------------------------------------------*/
+/* A cleared bit in fs->fmap[] tells that every cluster in its group of
+/  fs->fmap_grp FAT entries is in use, so that a search for free clusters can
+/  skip the group without reading the FAT. The bits are set at mount and when
+/  a cluster is freed (put_fat), and cleared when a sequential scan has seen a
+/  whole group in use (fmap_scan). */
+
+static void fmap_init (
+	FATFS* fs		/* Filesystem object with n_fatent and fs_type set */
+)
+{
+	DWORD grp;
+
+
+	fs->fmap_grp = 0;
+	if (fs->fs_type == FS_EXFAT) return;	/* exFAT has its own allocation bitmap */
+	grp = (fs->n_fatent + FF_FREEMAP_BYTES * 8 - 1) / (FF_FREEMAP_BYTES * 8);	/* Entries per bit */
+	fs->fmap_grp = (grp + 127) / 128 * 128;	/* In whole FAT32 sectors */
+	memset(fs->fmap, 0xFF, sizeof fs->fmap);
+}
+
+
+static int fmap_full (	/* 1:Every cluster of the group is in use, 0:Unknown */
+	FATFS* fs,		/* Filesystem object with a map */
+	DWORD clst		/* A cluster of the group */
+)
+{
+	DWORD g = clst / fs->fmap_grp;
+
+	return !(fs->fmap[g / 8] & (1 << (g % 8)));
+}
+
+
+static void fmap_set (
+	FATFS* fs,		/* Filesystem object with a map */
+	DWORD clst,		/* A cluster of the group */
+	int free		/* 1:The group has a free cluster, 0:It has not */
+)
+{
+	DWORD g = clst / fs->fmap_grp;
+
+	if (free) {
+		fs->fmap[g / 8] |= (BYTE)(1 << (g % 8));
+	} else {
+		fs->fmap[g / 8] &= (BYTE)~(1 << (g % 8));
+	}
+}
+
+
+/* Note a FAT entry seen by a scan in ascending order. *seen must be 1 at the
+/  start of the scan and is kept by the caller; it stays 1 until the scan
+/  reaches the top of a group, so that a group entered halfway is not judged. */
+static void fmap_scan (
+	FATFS* fs,		/* Filesystem object with a map */
+	DWORD clst,		/* FAT entry just read */
+	int free,		/* It is free */
+	int* seen		/* A free cluster was seen in the group */
+)
+{
+	if (clst % fs->fmap_grp == 0 || clst == 2) *seen = 0;	/* Top of a group (entries 0 and 1 are not clusters) */
+	if (free) *seen = 1;
+	if ((clst + 1) % fs->fmap_grp == 0 || clst + 1 == fs->n_fatent) {	/* Last entry of the group? */
+		if (!*seen) fmap_set(fs, clst, 0);
+		*seen = 1;
+	}
+}
+
+#endif /* !FF_FS_READONLY && FF_USE_FREEMAP */
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* FAT access - Change value of an FAT entry                             */
@@ -1248,6 +1323,9 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 
 
 	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
+#if FF_USE_FREEMAP
+		if (val == 0 && fs->fmap_grp) fmap_set(fs, clst, 1);	/* The group has a free cluster again */
+#endif
 		switch (fs->fs_type) {
 		case FS_FAT12:
 			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
@@ -1529,6 +1607,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 	DWORD cs, ncl, scl;
 	FRESULT res;
 	FATFS *fs = obj->fs;
+#if FF_USE_FREEMAP
+	int seen = 1;
+#endif
 
 
 	if (clst == 0) {	/* Create a new chain */
@@ -1591,9 +1672,20 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 					ncl = 2;
 					if (ncl > scl) return 0;	/* No free cluster found? */
 				}
+#if FF_USE_FREEMAP
+				if (fs->fmap_grp && (ncl % fs->fmap_grp == 0 || ncl == 2) && fmap_full(fs, ncl)) {	/* A group in use? */
+					cs = (ncl / fs->fmap_grp + 1) * fs->fmap_grp;	/* Top of the next group */
+					if (scl >= ncl && scl < cs) return 0;	/* Back in the group where the search started? */
+					ncl = cs - 1;				/* Skip the group */
+					continue;
+				}
+#endif
 				cs = get_fat(obj, ncl);			/* Get the cluster status */
 				if (cs == 0) break;				/* Found a free cluster? */
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+#if FF_USE_FREEMAP
+				if (fs->fmap_grp) fmap_scan(fs, ncl, 0, &seen);
+#endif
 				if (ncl == scl) return 0;		/* No free cluster found? */
 			}
 		}
@@ -3588,6 +3680,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type (the filesystem object gets valid) */
 	fs->id = ++Fsid;		/* Volume mount ID */
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+	fmap_init(fs);			/* Nothing known about free clusters yet */
+#endif
 #if FF_USE_LFN == 1
 	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
 #if FF_FS_EXFAT
@@ -4132,18 +4227,21 @@ FRESULT f_write (
 /* Synchronize the File                                                  */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_sync (
-	FIL* fp		/* Open file to be synced */
+static FRESULT sync_file (
+	FIL* fp,		/* Open file to be synced */
+	int at_fptr		/* Record the file pointer as the file size (1) or the size itself (0) */
 )
 {
 	FRESULT res;
 	FATFS *fs;
 	DWORD tm;
 	BYTE *dir;
+	FSIZE_t fsz;
 
 
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
 	if (res == FR_OK) {
+		fsz = at_fptr ? fp->fptr : fp->obj.objsize;	/* Size to be recorded in the directory entry */
 		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
 #if !FF_FS_TINY
 			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
@@ -4169,8 +4267,8 @@ FRESULT f_sync (
 						fs->dirbuf[XDIR_Attr] |= AM_ARC;				/* Set archive attribute to indicate that the file has been changed */
 						fs->dirbuf[XDIR_GenFlags] = fp->obj.stat | 1;	/* Update file allocation information */
 						st_dword(fs->dirbuf + XDIR_FstClus, fp->obj.sclust);		/* Update start cluster */
-						st_qword(fs->dirbuf + XDIR_FileSize, fp->obj.objsize);		/* Update file size */
-						st_qword(fs->dirbuf + XDIR_ValidFileSize, fp->obj.objsize);	/* (FatFs does not support Valid File Size feature) */
+						st_qword(fs->dirbuf + XDIR_FileSize, fsz);		/* Update file size */
+						st_qword(fs->dirbuf + XDIR_ValidFileSize, fsz);	/* (FatFs does not support Valid File Size feature) */
 						st_dword(fs->dirbuf + XDIR_ModTime, tm);		/* Update modified time */
 						fs->dirbuf[XDIR_ModTime10] = 0;
 						st_dword(fs->dirbuf + XDIR_AccTime, 0);
@@ -4190,7 +4288,7 @@ FRESULT f_sync (
 					dir = fp->dir_ptr;
 					dir[DIR_Attr] |= AM_ARC;						/* Set archive attribute to indicate that the file has been changed */
 					st_clust(fp->obj.fs, dir, fp->obj.sclust);		/* Update file allocation information  */
-					st_dword(dir + DIR_FileSize, (DWORD)fp->obj.objsize);	/* Update file size */
+					st_dword(dir + DIR_FileSize, (DWORD)fsz);	/* Update file size */
 					st_dword(dir + DIR_ModTime, tm);				/* Update modified time */
 					st_word(dir + DIR_LstAccDate, 0);
 					fs->wflag = 1;
@@ -4204,6 +4302,33 @@ FRESULT f_sync (
 	LEAVE_FF(fs, res);
 }
 
+
+FRESULT f_sync (
+	FIL* fp		/* Open file to be synced */
+)
+{
+	return sync_file(fp, 0);
+}
+
+
+#if FF_USE_EXPAND
+/*-----------------------------------------------------------------------*/
+/* Synchronize the File up to the File Pointer                           */
+/*-----------------------------------------------------------------------*/
+/* Same as f_sync, but the directory entry gets the file pointer as the file
+/  size, e.g. the end of what was written into a block allocated by f_expand.
+/  The file object keeps its size and clusters, so writing can go on into the
+/  rest of the block; f_truncate at the end releases what is left of it.
+/  Until then, that rest is allocated but beyond the recorded size. */
+
+FRESULT f_sync_tell (
+	FIL* fp		/* Open file to be synced */
+)
+{
+	return sync_file(fp, 1);
+}
+#endif
+
 #endif /* !FF_FS_READONLY */
 
 
@@ -4825,6 +4950,9 @@ FRESULT f_getfree (
 	LBA_t sect;
 	UINT i;
 	FFOBJID obj;
+#if FF_USE_FREEMAP
+	int seen = 1;
+#endif
 
 
 	/* Get logical drive */
@@ -4848,6 +4976,9 @@ FRESULT f_getfree (
 						res = FR_INT_ERR; break;
 					}
 					if (stat == 0) nfree++;
+#if FF_USE_FREEMAP
+					if (fs->fmap_grp) fmap_scan(fs, clst, stat == 0, &seen);
+#endif
 				} while (++clst < fs->n_fatent);
 			} else {
 #if FF_FS_EXFAT
@@ -4881,12 +5012,16 @@ FRESULT f_getfree (
 							if (res != FR_OK) break;
 						}
 						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
+							stat = ld_word(fs->win + i);
 							i += 2;
 						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
+							stat = ld_dword(fs->win + i) & 0x0FFFFFFF;
 							i += 4;
 						}
+						if (stat == 0) nfree++;
+#if FF_USE_FREEMAP
+						if (fs->fmap_grp) fmap_scan(fs, fs->n_fatent - clst, stat == 0, &seen);
+#endif
 						i %= SS(fs);
 					} while (--clst);
 				}
@@ -5571,6 +5706,9 @@ FRESULT f_expand (
 	FRESULT res;
 	FATFS *fs;
 	DWORD n, clst, stcl, scl, ncl, tcl, lclst;
+#if FF_USE_FREEMAP
+	int seen = 1;
+#endif
 
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
@@ -5600,9 +5738,38 @@ FRESULT f_expand (
 	} else
 #endif
 	{
+#if FF_EXPAND_ALIGN
+		DWORD align = 1;	/* Alignment of the block start in unit of sector */
+
+		if (disk_ioctl(fs->pdrv, GET_BLOCK_SIZE, &align) != RES_OK || align < 2 || (align & (align - 1))) align = 1;
+		if (align > 1 && fs->database % (align < fs->csize ? align : fs->csize) != 0) align = 1;	/* No cluster can be aligned */
+		for (;;) {
+#endif
 		scl = clst = stcl; ncl = 0;
+#if FF_USE_FREEMAP
+		seen = 1;
+#endif
 		for (;;) {	/* Find a contiguous cluster block */
+#if FF_USE_FREEMAP
+			if (fs->fmap_grp && (clst % fs->fmap_grp == 0 || clst == 2) && fmap_full(fs, clst)) {	/* A group in use? */
+				n = (clst / fs->fmap_grp + 1) * fs->fmap_grp;	/* Top of the next group */
+				if (stcl > clst && stcl < n) {	/* Back in the group where the search started? */
+					res = FR_DENIED; break;
+				}
+				scl = clst = (n >= fs->n_fatent) ? 2 : n; ncl = 0;	/* Skip the group */
+				if (clst == stcl) {
+					res = FR_DENIED; break;
+				}
+				continue;
+			}
+#endif
 			n = get_fat(&fp->obj, clst);
+#if FF_USE_FREEMAP
+			if (fs->fmap_grp && n != 1 && n != 0xFFFFFFFF) fmap_scan(fs, clst, n == 0, &seen);
+#endif
+#if FF_EXPAND_ALIGN
+			lclst = clst;	/* Cluster just tested */
+#endif
 			if (++clst >= fs->n_fatent) clst = 2;
 			if (n == 1) {
 				res = FR_INT_ERR; break;
@@ -5610,6 +5777,11 @@ FRESULT f_expand (
 			if (n == 0xFFFFFFFF) {
 				res = FR_DISK_ERR; break;
 			}
+#if FF_EXPAND_ALIGN
+			if (n == 0 && ncl == 0 && (fs->database + (LBA_t)(lclst - 2) * fs->csize) % align != 0) {
+				scl = clst;		/* A free cluster, but not at a boundary to start the block */
+			} else
+#endif
 			if (n == 0) {	/* Is it a free cluster? */
 				if (++ncl == tcl) break;	/* Break if a contiguous cluster block is found */
 			} else {
@@ -5619,6 +5791,12 @@ FRESULT f_expand (
 				res = FR_DENIED; break;
 			}
 		}
+#if FF_EXPAND_ALIGN
+		lclst = 0;
+		if (res != FR_DENIED || align == 1) break;
+		res = FR_OK; align = 1;		/* No aligned block, try any block */
+		}
+#endif
 		if (res == FR_OK) {	/* A contiguous free area is found */
 			if (opt) {		/* Allocate it now */
 				for (clst = scl, n = tcl; n; clst++, n--) {	/* Create a cluster chain on the FAT */
@@ -171,6 +171,10 @@ typedef struct {
 #endif
 	LBA_t	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+	DWORD	fmap_grp;		/* FAT entries per bit of fmap[] (0:no map) */
+	BYTE	fmap[FF_FREEMAP_BYTES];	/* Free cluster map (bit cleared: every cluster in the group is in use) */
+#endif
 } FATFS;
 
 
@@ -308,6 +312,7 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
+FRESULT f_sync_tell (FIL* fp);										/* Flush cached data, recording the file pointer as the size */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (DIR* dp);										/* Close an open directory */
 FRESULT f_readdir (DIR* dp, FILINFO* fno);							/* Read a directory item */
@@ -38,10 +38,31 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
+#define FF_USE_EXPAND	1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
+#define FF_EXPAND_ALIGN	1
+/* This option makes f_expand() on FAT volumes look first for a contiguous block
+/  starting on an erase block boundary, as reported by disk_ioctl(GET_BLOCK_SIZE).
+/  If there is none, any contiguous block is taken. (0:Disable or 1:Enable) */
+
+
+#ifndef FF_USE_FREEMAP
+#define FF_USE_FREEMAP	1
+#endif
+#define FF_FREEMAP_BYTES	512
+/* This option keeps in each filesystem object a map of the FAT in
+/  FF_FREEMAP_BYTES bytes, a bit per group of consecutive FAT entries, telling
+/  which groups are known to have no free cluster. The searches for a free
+/  cluster (cluster allocation and f_expand) on FAT volumes skip those groups
+/  instead of reading their FAT sectors. The map starts unknown at mount, is
+/  filled in by the searches and by f_getfree, and a group is marked again
+/  when one of its clusters is freed. exFAT volumes use their allocation
+/  bitmap instead. The choice of clusters is the same either way, which the
+/  host build checks (host/freemap_check.c). (0:Disable or 1:Enable) */
+
+
 #define FF_USE_CHMOD	0
 /* This option switches attribute manipulation functions, f_chmod() and f_utime().
 /  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option. */
@@ -213,7 +234,7 @@
 /  f_fdisk function. 0x100000000 max. This option has no effect when FF_LBA64 == 0. */
 
 
-#define FF_USE_TRIM		0
+#define FF_USE_TRIM		1
 /* This option switches support for ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable Trim function, also CTRL_TRIM command should be implemented to the
 /  disk_ioctl() function. */
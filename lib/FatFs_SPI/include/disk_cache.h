@@ -0,0 +1,60 @@
+/* disk_cache.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+/* Write-back sector cache between FatFs and the SD cards (see glue.c).
+ * Single sector requests (FAT, directory and partial data sectors) are
+ * served from RAM; dirty sectors reach the card on CTRL_SYNC (f_sync,
+ * f_close, ...) or when evicted. Multi-sector requests go straight to the
+ * card, keeping the cached copies coherent.
+ * Sequential reads are served from read-ahead buffers filled with multiple
+ * block reads (CMD18), the next run asynchronously while the current one is
+ * consumed. */
+#pragma once
+
+#include <stdint.h>
+//
+#include "ff.h"
+
+/* Number of cached sectors, shared by all drives: DISK_CACHE_SECTORS * 512
+ * bytes of RAM. 0 disables the cache. */
+#ifndef DISK_CACHE_SECTORS
+#define DISK_CACHE_SECTORS 8
+#endif
+
+/* Sectors per read-ahead run. Two buffers of DISK_READ_AHEAD_SECTORS * 512
+ * bytes; 0 disables read-ahead. */
+#ifndef DISK_READ_AHEAD_SECTORS
+#define DISK_READ_AHEAD_SECTORS 8
+#endif
+
+typedef struct {
+    uint32_t read_hits;
+    uint32_t read_misses;
+    uint32_t write_hits;    // Sector was already cached: write coalesced in RAM
+    uint32_t write_misses;
+    uint32_t write_backs;   // Sectors written to the card from the cache
+    uint32_t syncs;
+    uint32_t read_ahead_runs;  // Multiple block reads started by the read-ahead
+    uint32_t read_ahead_hits;  // Sectors served from the read-ahead buffers
+} disk_cache_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void disk_cache_get_stats(disk_cache_stats_t *stats);
+void disk_cache_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
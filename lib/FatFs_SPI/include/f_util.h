@@ -24,6 +24,10 @@ extern "C" {
         UINT sz_buff,   /* Size of path name buffer (items) */
         FILINFO* fno    /* Name read buffer */
     );
+    FRESULT f_trim_free (
+        const TCHAR* path,  /* Logical drive */
+        DWORD* ntrim        /* Number of clusters trimmed */
+    );
 
 #ifdef __cplusplus
 }
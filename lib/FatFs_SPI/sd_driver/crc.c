@@ -28,6 +28,8 @@ specific language governing permissions and limitations under the License.
  * limitations under the License.
  */
 
+#include <stdint.h>
+//
 #include "crc.h"
 
 static const char m_Crc7Table[] = {0x00, 0x09, 0x12, 0x1B, 0x24, 0x2D, 0x36,
@@ -96,21 +98,33 @@ char crc7(const char* data, int length)
 	return crc;
 }
 
-unsigned short crc16(const char* data, int length)
+/* Table driven, a byte at a time. The running CRC is kept in a 32-bit
+ * register and truncated only at the end, and the data is read as unsigned
+ * bytes, so the Cortex-M0+ doesn't spend instructions on sign and zero
+ * extensions inside the loop; the loop is unrolled by four. */
+static unsigned short crc16_run(unsigned short crc16, const unsigned char *p, size_t length)
 {
-	//Calculate the CRC16 checksum for the specified data block
-	unsigned short crc = 0;
-	for (int i = 0; i < length; i++) {
-		crc = (crc << 8) ^ m_Crc16Table[((crc >> 8) ^ data[i]) & 0x00FF];
+	uint32_t crc = crc16;
+	const unsigned char *end4 = p + (length & ~(size_t)3);
+	while (p < end4) {
+		crc = (crc << 8) ^ m_Crc16Table[(uint8_t)(crc >> 8) ^ p[0]];
+		crc = (crc << 8) ^ m_Crc16Table[(uint8_t)(crc >> 8) ^ p[1]];
+		crc = (crc << 8) ^ m_Crc16Table[(uint8_t)(crc >> 8) ^ p[2]];
+		crc = (crc << 8) ^ m_Crc16Table[(uint8_t)(crc >> 8) ^ p[3]];
+		p += 4;
 	}
+	for (size_t i = 0; i < (length & 3); i++)
+		crc = (crc << 8) ^ m_Crc16Table[(uint8_t)(crc >> 8) ^ p[i]];
+	return (unsigned short)crc;
+}
 
-	//Return the calculated checksum
-	return crc;
+unsigned short crc16(const char* data, int length)
+{
+	//Calculate the CRC16 checksum for the specified data block
+	return crc16_run(0, (const unsigned char *)data, length);
 }
 
 void update_crc16(unsigned short *pCrc16, const char data[], size_t length) {
-	for (size_t i = 0; i < length; i++) {
-		*pCrc16 = (*pCrc16 << 8) ^ m_Crc16Table[((*pCrc16 >> 8) ^ data[i]) & 0x00FF];
-	}    
+	*pCrc16 = crc16_run(*pCrc16, (const unsigned char *)data, length);
 }
 /* [] END OF FILE */
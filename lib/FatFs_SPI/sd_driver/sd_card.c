@@ -161,6 +161,7 @@ specific language governing permissions and limitations under the License.
 
 /* Standard includes. */
 #include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 //
 #include "pico/mutex.h"
@@ -184,6 +185,11 @@ specific language governing permissions and limitations under the License.
 static bool crc_on = true;
 #endif
 
+// Set to 0 to fall back to the block-by-block CMD25 loop (e.g. for A/B benchmarks)
+#ifndef SD_WRITE_PIPELINED
+#define SD_WRITE_PIPELINED 1
+#endif
+
 #define TRACE_PRINTF(fmt, args...)
 // #define TRACE_PRINTF printf
 
@@ -219,13 +225,7 @@ static bool crc_on = true;
 #define SSEL_ACTIVE (0)
 #define SSEL_INACTIVE (1)
 
-/** Represents the different SD/MMC card types  */
-// Types
-#define SDCARD_NONE 0  /**< No card is present */
-#define SDCARD_V1 1    /**< v1.x Standard Capacity */
-#define SDCARD_V2 2    /**< v2.x Standard capacity SD card */
-#define SDCARD_V2HC 3  /**< v2.x High capacity SD card */
-#define CARD_UNKNOWN 4 /**< Unknown or unsupported card */
+/** Card types: see card_type in sd_card.h */
 
 // Only HC block size is supported. Making this a static constant reduces code
 // size.
@@ -294,10 +294,7 @@ typedef enum {
 
 #define SPI_CMD(x) (0x40 | (x & 0x3f))
 
-static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
-    uint8_t response;
-    char cmdPacket[PACKET_SIZE];
-
+static void sd_cmd_packet(char *cmdPacket, cmdSupported cmd, uint32_t arg) {
     // Prepare the command packet
     cmdPacket[0] = SPI_CMD(cmd);
     cmdPacket[1] = (arg >> 24);
@@ -325,10 +322,15 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
                 break;
         }
     }
+}
+
+static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
+    uint8_t response;
+    char cmdPacket[PACKET_SIZE];
+
+    sd_cmd_packet(cmdPacket, cmd, arg);
     // send a command
-    for (int i = 0; i < PACKET_SIZE; i++) {
-        sd_spi_write(pSD, cmdPacket[i]);
-    }
+    sd_spi_transfer(pSD, (const uint8_t *)cmdPacket, NULL, PACKET_SIZE);
     // The received byte immediataly following CMD12 is a stuff byte,
     // it should be discarded before receive the response of the CMD12.
     if (CMD12_STOP_TRANSMISSION == cmd) {
@@ -346,30 +348,78 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
     return response;
 }
 
+#if SD_CMD_STATS
+// Histogram bucket: < 16 us, < 32 us, ... (see SD_STATS_BUCKETS)
+static uint sd_stat_bucket(uint32_t us) {
+    uint b = 0;
+    for (us >>= 4; us && b < SD_STATS_BUCKETS - 1; us >>= 1) ++b;
+    return b;
+}
+// One operation, started at start_us; bytes count only if it succeeded
+void sd_stat_op(sd_card_t *pSD, sd_stat_op_t op, uint32_t start_us, int status,
+                       uint32_t bytes) {
+    uint32_t elapsed = time_us_32() - start_us;
+    sd_op_stats_t *st = &pSD->stats.op[op];
+    st->count++;
+    st->total_us += elapsed;
+    if (elapsed > st->max_us) st->max_us = elapsed;
+    st->hist[sd_stat_bucket(elapsed)]++;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        st->errors++;
+    } else if (SD_STAT_CMD24 == op || SD_STAT_CMD25 == op) {
+        pSD->stats.bytes_written += bytes;
+    } else {
+        pSD->stats.bytes_read += bytes;
+    }
+}
+// The card held DO low (busy) from start_us until now
+static void sd_stat_busy(sd_card_t *pSD, uint32_t start_us) {
+    uint32_t elapsed = time_us_32() - start_us;
+    pSD->stats.busy_waits++;
+    pSD->stats.busy_us += elapsed;
+    if (elapsed > pSD->stats.busy_max_us) pSD->stats.busy_max_us = elapsed;
+}
+#else
+#define sd_stat_busy(pSD, start_us)
+#endif
+
 static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
     char resp;
+    uint32_t start = time_us_32();
+    bool busy = false;
 
     // Keep sending dummy clocks with DI held high until the card releases the
     // DO line
     absolute_time_t timeout_time = make_timeout_time_ms(timeout);
     do {
         resp = sd_spi_write(pSD, 0xFF);
+        // Other cards on the SPI can use it while this one is busy
+        if (resp == 0x00) {
+            busy = true;
+            sd_spi_yield(pSD);
+        }
     } while (resp == 0x00 &&
              0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
 
     if (resp == 0x00) DBG_PRINTF("%s failed\r\n", __FUNCTION__);
+    if (busy) sd_stat_busy(pSD, start);
 
     // Return success/failure
     return (resp > 0x00);
 }
 
 // An SD card can only do one thing at a time.
+// The card itself is held by async.sem, which an asynchronous transfer keeps
+// until it completes in interrupt context, where a mutex (which has an owner)
+// can't be released. The mutex only orders the callers in thread context.
 static void sd_lock(sd_card_t *pSD) {
     myASSERT(mutex_is_initialized(&pSD->mutex));
     mutex_enter_blocking(&pSD->mutex);
+    sem_acquire_blocking(&pSD->async.sem);
 }
 static void sd_unlock(sd_card_t *pSD) {
     myASSERT(mutex_is_initialized(&pSD->mutex));
+    sem_release(&pSD->async.sem);
     mutex_exit(&pSD->mutex);
 }
 
@@ -450,8 +500,8 @@ static const char *cmd2str(const cmdSupported cmd) {
 #define SD_COMMAND_RETRIES 3 /*!< Times SPI cmd is retried when there is no response */
 #define SD_COMMAND_TIMEOUT 2000 /*!< Timeout in ms for response */
 
-static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
-                  bool isAcmd, uint32_t *resp) {
+static int in_sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                     bool isAcmd, uint32_t *resp) {
     TRACE_PRINTF("%s(%s(0x%08lx)): ", __FUNCTION__, cmd2str(cmd), arg);
 
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
@@ -477,6 +527,7 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
         response = sd_cmd_spi(pSD, cmd, arg);
         if (R1_NO_RESPONSE == response) {
             DBG_PRINTF("No response CMD:%d\r\n", cmd);
+            if (i + 1 < SD_COMMAND_RETRIES) SD_COUNT(pSD, retries);
             continue;
         }
         break;
@@ -493,6 +544,7 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     }
     if (response & R1_COM_CRC_ERROR && ACMD23_SET_WR_BLK_ERASE_COUNT != cmd) {
         DBG_PRINTF("CRC error CMD:%d response 0x%" PRIx32 "\r\n", cmd, response);
+        SD_COUNT(pSD, crc_errors);
         return SD_BLOCK_DEVICE_ERROR_CRC;  // CRC error
     }
     if (response & R1_ILLEGAL_COMMAND) {
@@ -523,13 +575,14 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
             DBG_PRINTF("V2-Version Card\r\n");
             pSD->card_type = SDCARD_V2;  // fallthrough
             // Note: No break here, need to read rest of the response
-        case CMD58_READ_OCR:  // Response R3
-            response = (sd_spi_write(pSD, SPI_FILL_CHAR) << 24);
-            response |= (sd_spi_write(pSD, SPI_FILL_CHAR) << 16);
-            response |= (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
-            response |= sd_spi_write(pSD, SPI_FILL_CHAR);
+        case CMD58_READ_OCR: {  // Response R3
+            uint8_t r[4];
+            sd_spi_transfer(pSD, NULL, r, sizeof r);
+            response = (uint32_t)r[0] << 24 | (uint32_t)r[1] << 16 |
+                       (uint32_t)r[2] << 8 | r[3];
             DBG_PRINTF("R3/R7: 0x%" PRIx32 "\r\n", response);
             break;
+        }
         case CMD12_STOP_TRANSMISSION:  // Response R1b
         case CMD38_ERASE:
             sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
@@ -611,6 +664,144 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     return status;
 }
 
+#if SD_CMD_STATS
+/* Per-command overhead: time from sd_cmd() entry to the end of the response,
+ * including the wait for the card to be ready. Data phases are not included.
+ * Indexed by [isAcmd][cmd]. */
+typedef struct {
+    uint32_t count;
+    uint32_t errors;
+    uint64_t total_us;
+    uint32_t max_us;
+} sd_cmd_stat_t;
+static sd_cmd_stat_t sd_cmd_stats[2][64];
+
+static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
+                  bool isAcmd, uint32_t *resp) {
+    uint32_t start = time_us_32();
+    int status = in_sd_cmd(pSD, cmd, arg, isAcmd, resp);
+    uint32_t elapsed = time_us_32() - start;
+    sd_cmd_stat_t *st = &sd_cmd_stats[isAcmd ? 1 : 0][cmd & 0x3f];
+    st->count++;
+    st->total_us += elapsed;
+    if (elapsed > st->max_us) st->max_us = elapsed;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) st->errors++;
+    // CMD13 has no data phase: the command is the whole operation
+    if (CMD13_SEND_STATUS == cmd && !isAcmd) sd_stat_op(pSD, SD_STAT_CMD13, start, status, 0);
+    return status;
+}
+
+void sd_print_cmd_stats() {
+    printf("\n%-6s %8s %8s %8s %8s\n", "cmd", "count", "avg_us", "max_us",
+           "errors");
+    for (size_t a = 0; a < count_of(sd_cmd_stats); ++a) {
+        for (size_t c = 0; c < count_of(sd_cmd_stats[0]); ++c) {
+            const sd_cmd_stat_t *st = &sd_cmd_stats[a][c];
+            if (!st->count) continue;
+            printf("%sCMD%-3u %8lu %8lu %8lu %8lu\n", a ? "A" : " ", (unsigned)c,
+                   (unsigned long)st->count,
+                   (unsigned long)(st->total_us / st->count),
+                   (unsigned long)st->max_us, (unsigned long)st->errors);
+        }
+    }
+}
+#else
+#define sd_cmd in_sd_cmd
+
+void sd_print_cmd_stats() {}
+#endif
+
+/* Report of the driver statistics, for the terminal or a file: per card, the
+ * counters and a line per operation with its latency histogram; per SPI, the
+ * traffic and the share of time the bus was held. */
+void sd_stats_report(sd_stats_put_t put, void *context) {
+    static const char *const op_names[SD_STAT_OPS] = {"CMD17", "CMD18", "CMD24", "CMD25",
+                                                      "CMD13", "CMD38"};
+    char line[192], hist[SD_STATS_BUCKETS * 7 + 1];
+    int n = 0;
+    // Header: upper bound of each bucket
+    for (uint b = 0; b < SD_STATS_BUCKETS; ++b) {
+        char label[8];
+        uint32_t edge = 16u << b;
+        if (SD_STATS_BUCKETS - 1 == b)
+            snprintf(label, sizeof label, ">=%lum", (unsigned long)(edge / 2 / 1000));
+        else if (edge < 1000)
+            snprintf(label, sizeof label, "<%lu", (unsigned long)edge);
+        else
+            snprintf(label, sizeof label, "<%lum", (unsigned long)(edge / 1000));
+        n += snprintf(hist + n, sizeof hist - n, " %6s", label);
+    }
+    for (size_t i = 0; i < sd_get_num(); ++i) {
+        sd_card_t *pSD = sd_get_by_num(i);
+        const sd_stats_t *st = &pSD->stats;
+        // The SD mode clock isn't an SCK: "SDIO" keeps it apart (and out of the host's
+        // sd_model, which reads the SPI rate from this line)
+        snprintf(line, sizeof line,
+                 "SD %s %s%lu Hz, %lu KB read, %lu KB written, %lu retries, %lu CRC errors",
+                 pSD->pcName, SD_IF_SDIO == pSD->type ? "SDIO " : "",
+                 (unsigned long)pSD->baud_rate,
+                 (unsigned long)(st->bytes_read / 1024), (unsigned long)(st->bytes_written / 1024),
+                 (unsigned long)st->retries, (unsigned long)st->crc_errors);
+        put(context, line);
+        snprintf(line, sizeof line,
+                 "SD %s recovery %lu retried transfers, %lu recovered, %lu reinits, %lu unrecovered",
+                 pSD->pcName, (unsigned long)st->op_retries, (unsigned long)st->recovered,
+                 (unsigned long)st->reinits, (unsigned long)st->unrecovered);
+        put(context, line);
+        snprintf(line, sizeof line, "SD %s busy %lu waits, %lu ms total, %lu us max",
+                 pSD->pcName, (unsigned long)st->busy_waits,
+                 (unsigned long)(st->busy_us / 1000), (unsigned long)st->busy_max_us);
+        put(context, line);
+        snprintf(line, sizeof line, "SD %s %-5s %7s %6s %7s %7s |%s", pSD->pcName, "op",
+                 "count", "errors", "avg_us", "max_us", hist);
+        put(context, line);
+        for (size_t op = 0; op < SD_STAT_OPS; ++op) {
+            const sd_op_stats_t *o = &st->op[op];
+            if (!o->count) continue;
+            n = snprintf(line, sizeof line, "SD %s %-5s %7lu %6lu %7lu %7lu |", pSD->pcName,
+                         op_names[op], (unsigned long)o->count, (unsigned long)o->errors,
+                         (unsigned long)(o->total_us / o->count), (unsigned long)o->max_us);
+            for (uint b = 0; b < SD_STATS_BUCKETS && n < (int)sizeof line; ++b)
+                n += snprintf(line + n, sizeof line - n, " %6lu", (unsigned long)o->hist[b]);
+            put(context, line);
+        }
+    }
+    for (size_t i = 0; i < spi_get_num(); ++i) {
+        spi_t *spi = spi_get_by_num(i);
+        if (!spi->initialized) continue;
+        const spi_stats_t *st = &spi->stats;
+        uint64_t window = time_us_64() - st->since_us;
+        uint32_t permille = window ? st->held_us * 1000 / window : 0;
+        snprintf(line, sizeof line,
+                 "SPI %u: %lu.%lu%% held, %lu KB, %lu DMA + %lu polled transfers, "
+                 "%lu of %lu grants waited (%lu ms)",
+                 (unsigned)i, (unsigned long)(permille / 10), (unsigned long)(permille % 10),
+                 (unsigned long)(st->bytes / 1024), (unsigned long)st->dma_transfers,
+                 (unsigned long)st->polled_transfers, (unsigned long)st->waits,
+                 (unsigned long)st->grants, (unsigned long)(st->wait_us / 1000));
+        put(context, line);
+    }
+}
+
+static void sd_stats_put_stdout(void *context, const char *line) {
+    (void)context;
+    printf("%s\n", line);
+}
+void sd_print_stats() {
+    printf("\n");
+    sd_stats_report(sd_stats_put_stdout, NULL);
+}
+
+void sd_reset_stats() {
+    for (size_t i = 0; i < sd_get_num(); ++i)
+        memset(&sd_get_by_num(i)->stats, 0, sizeof(sd_stats_t));
+    for (size_t i = 0; i < spi_get_num(); ++i)
+        spi_reset_stats(spi_get_by_num(i));
+#if SD_CMD_STATS
+    memset(sd_cmd_stats, 0, sizeof sd_cmd_stats);
+#endif
+}
+
 /* Return non-zero if the SD-card is present. */
 bool sd_card_detect(sd_card_t *pSD) {
     TRACE_PRINTF("> %s\r\n", __FUNCTION__);
@@ -697,22 +888,40 @@ static uint32_t ext_bits(unsigned char *data, int msb, int lsb) {
 
 static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length);
 
-static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
-    uint32_t c_size, c_size_mult, read_bl_len;
-    uint32_t block_len, mult, blocknr;
-    uint32_t hc_c_size;
-    uint64_t blocks = 0, capacity = 0;
-
-    // CMD9, Response R2 (R1 byte + 16-byte block read)
+// CMD9, Response R2 (R1 byte + 16-byte block read)
+static int sd_read_csd(sd_card_t *pSD, uint8_t csd[16]) {
     if (sd_cmd(pSD, CMD9_SEND_CSD, 0x0, false, 0) != 0x0) {
         DBG_PRINTF("Didn't get a response from the disk\r\n");
-        return 0;
+        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
-    uint8_t csd[16];
     if (sd_read_bytes(pSD, csd, 16) != 0) {
         DBG_PRINTF("Couldn't read csd response from disk\r\n");
-        return 0;
+        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/* Maximum data transfer rate, in Hz (bit/s on the one-bit SPI bus).
+ * TRAN_SPEED: csd[103:96] = time value [6:3] x transfer rate unit [2:0].
+ * Typically 0x32 (25 MHz) in default speed mode. */
+uint32_t sd_csd_tran_speed(uint8_t *csd) {
+    static const uint8_t time_value_x10[16] = {0,  10, 12, 13, 15, 20, 25, 30,
+                                               35, 40, 45, 50, 55, 60, 70, 80};
+    uint32_t tran_speed = ext_bits(csd, 103, 96);
+    uint32_t unit = tran_speed & 0x7;  // 0: 100 kbit/s ... 3: 100 Mbit/s
+    uint32_t hz = time_value_x10[(tran_speed >> 3) & 0xF] * 10000;
+    if (unit > 3) unit = 3;  // 4-7 are reserved
+    while (unit--) hz *= 10;
+    DBG_PRINTF("TRAN_SPEED: 0x%02" PRIx32 " (%" PRIu32 " Hz)\r\n", tran_speed, hz);
+    return hz;
+}
+
+uint64_t sd_csd_sectors(uint8_t *csd) {
+    uint32_t c_size, c_size_mult, read_bl_len;
+    uint32_t block_len, mult, blocknr;
+    uint32_t hc_c_size;
+    uint64_t blocks = 0, capacity = 0;
+
     // csd_structure : csd[127:126]
     int csd_structure = ext_bits(csd, 127, 126);
     switch (csd_structure) {
@@ -752,7 +961,54 @@ static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
     };
     return blocks;
 }
+/* Erase sector: the smallest erasable unit, in 512-byte sectors.
+ * SECTOR_SIZE: csd[45:39], in units of write blocks (WRITE_BL_LEN: csd[25:22]).
+ * Fixed at 64 KB by CSD version 2.0. Fallback for the allocation unit when the
+ * SD Status register isn't available. */
+uint32_t sd_csd_erase_sectors(uint8_t *csd) {
+    uint32_t sector_size = ext_bits(csd, 45, 39) + 1;
+    uint32_t write_bl_len = ext_bits(csd, 25, 22);
+    uint32_t sectors = (sector_size << write_bl_len) / _block_size;
+    return sectors ? sectors : 1;
+}
+
+/* Allocation unit, in 512-byte sectors, from the 64-byte SD Status (ACMD13).
+ * AU_SIZE: ssr[431:428] (byte 10, high nibble): 1-9 are 16 KB to 4 MB in
+ * powers of two, then 8, 12, 16, 24, 32 and 64 MB. 0 if not defined. */
+uint32_t sd_ssr_au_sectors(const uint8_t *ssr) {
+    static const uint32_t au_mb[] = {8, 12, 16, 24, 32, 64};  // AU_SIZE 0xA-0xF
+    uint32_t au_size = ssr[10] >> 4;
+    uint32_t erase_size = (uint32_t)ssr[11] << 8 | ssr[12];  // AUs per erase timeout
+    uint32_t sectors;
+    if (!au_size)
+        sectors = 0;
+    else if (au_size <= 9)
+        sectors = 32u << (au_size - 1);
+    else
+        sectors = au_mb[au_size - 0xA] * 2048;
+    DBG_PRINTF("AU_SIZE: %" PRIu32 " (%" PRIu32 " sectors), ERASE_SIZE: %" PRIu32 "\r\n",
+               au_size, sectors, erase_size);
+    return sectors;
+}
+
+// ACMD13, Response R2 (R1 + status byte) then a 64-byte data block
+static int sd_read_sd_status(sd_card_t *pSD, uint8_t ssr[64]) {
+    int status = sd_cmd(pSD, ACMD13_SD_STATUS, 0x0, true, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        DBG_PRINTF("ACMD13 failed: %d\r\n", status);
+        return status;
+    }
+    return sd_read_bytes(pSD, ssr, 64);
+}
+
+static uint64_t sd_sectors_nolock(sd_card_t *pSD) {
+    uint8_t csd[16];
+    if (sd_read_csd(pSD, csd) != SD_BLOCK_DEVICE_ERROR_NONE) return 0;
+    return sd_csd_sectors(csd);
+}
 uint64_t sd_sectors(sd_card_t *pSD) {
+    // Read from the CSD at initialization
+    if (SD_IF_SDIO == pSD->type) return pSD->sectors;
     sd_acquire(pSD);
     uint64_t sectors = sd_sectors_nolock(pSD);
     sd_release(pSD);
@@ -777,17 +1033,29 @@ static bool sd_wait_token(sd_card_t *pSD, uint8_t token) {
 #define SPI_START_BLOCK \
     (0xFE) /*!< For Single Block Read/Write and Multiple Block Read */
 
+/* Data block transfer. With CRC on, *crc gets the block's CRC16, computed
+ * by the DMA sniffer during the transfer (or in software if it is busy);
+ * otherwise it is left at ~0, which is what is sent when CRC is off. */
+static bool sd_spi_transfer_data(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
+                                 uint32_t length, uint16_t *crc) {
+#if SD_CRC_ENABLED
+    if (crc_on) return sd_spi_transfer_crc16(pSD, tx, rx, length, crc);
+#endif
+    *crc = ~0;
+    return sd_spi_transfer(pSD, tx, rx, length);
+}
+
 static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
-    uint16_t crc;
+    uint16_t crc, crc_result;
 
     // read until start byte (0xFE)
     if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
         DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
-    // read data
-    for (uint32_t i = 0; i < length; i++) {
-        buffer[i] = sd_spi_write(pSD, SPI_FILL_CHAR);
+    // read data, computing its checksum on the way (DMA sniffer)
+    if (!sd_spi_transfer_data(pSD, NULL, buffer, length, &crc_result)) {
+        return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
     // Read the CRC16 checksum for the data block
     crc = (sd_spi_write(pSD, SPI_FILL_CHAR) << 8);
@@ -795,13 +1063,12 @@ static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
 
 #if SD_CRC_ENABLED
     if (crc_on) {
-        uint32_t crc_result;
-        // Compute and verify checksum
-        crc_result = crc16((void *)buffer, length);
+        // Verify checksum
         if ((uint16_t)crc_result != crc) {
             DBG_PRINTF("_read_bytes: Invalid CRC received 0x%" PRIx16
                        " result of computation 0x%" PRIx16 "\r\n",
                        crc, (uint16_t)crc_result);
+            SD_COUNT(pSD, crc_errors);
             return SD_BLOCK_DEVICE_ERROR_CRC;
         }
     }
@@ -810,16 +1077,15 @@ static int sd_read_bytes(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     return 0;
 }
 static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
-    uint16_t crc;
+    uint16_t crc, crc_result;
 
     // read until start byte (0xFE)
     if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
         DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
-    // read data
-    // bool spi_transfer(const uint8_t *tx, uint8_t *rx, size_t length)
-    if (!sd_spi_transfer(pSD, NULL, buffer, length)) {
+    // read data, computing its checksum on the way (DMA sniffer)
+    if (!sd_spi_transfer_data(pSD, NULL, buffer, length, &crc_result)) {
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
     // Read the CRC16 checksum for the data block
@@ -828,13 +1094,12 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
 
 #if SD_CRC_ENABLED
     if (crc_on) {
-        uint32_t crc_result;
-        // Compute and verify checksum
-        crc_result = crc16((void *)buffer, length);
+        // Verify checksum
         if ((uint16_t)crc_result != crc) {
             DBG_PRINTF("%s: Invalid CRC received 0x%" PRIx16
                        " result of computation 0x%" PRIx16 "\r\n",
                        __FUNCTION__, crc, (uint16_t)crc_result);
+            SD_COUNT(pSD, crc_errors);
             return SD_BLOCK_DEVICE_ERROR_CRC;
         }
     }
@@ -843,6 +1108,150 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     return SD_BLOCK_DEVICE_ERROR_NONE;
 }
 
+/* Candidate SCK frequencies for sd_negotiate_baud_rate(), in ascending order.
+ * my_spi_set_baudrate() picks the fastest achievable rate not above each one
+ * (e.g. 20833333 Hz for 25 MHz with a 125 MHz clk_peri). */
+static const uint sd_baud_candidates[] = {
+    1000 * 1000,  5 * 1000 * 1000,  10 * 1000 * 1000, 12500 * 1000,
+    16 * 1000 * 1000, 20 * 1000 * 1000, 25 * 1000 * 1000, 31250 * 1000,
+    50 * 1000 * 1000};
+
+/*!< Reads of block 0 that must pass at a candidate rate before it is accepted */
+#define SD_BAUD_TEST_READS 4
+
+static int sd_test_read(sd_card_t *pSD, uint8_t *buffer) {
+    int status = sd_cmd(pSD, CMD17_READ_SINGLE_BLOCK, 0x0, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_read_block(pSD, buffer, _block_size);
+    return status;
+}
+
+/* Step SCK up through the candidate rates, up to the lower of the card's
+ * TRAN_SPEED and the SPI's configured baud_rate. A rate is accepted only if
+ * repeated reads of block 0 pass the CRC check and match a reference read
+ * taken at the (slow) initialization clock; the first failure stops the
+ * search and the card is left at the last good rate.
+ * Returns the negotiated (actual) frequency. */
+static uint sd_negotiate_baud_rate(sd_card_t *pSD) {
+    static uint8_t reference[BLOCK_SIZE_HC], test[BLOCK_SIZE_HC];
+    auto_init_mutex(sd_negotiate_mutex);
+    mutex_enter_blocking(&sd_negotiate_mutex);
+
+    uint limit = pSD->spi->baud_rate;
+    if (pSD->max_baud_rate && pSD->max_baud_rate < limit) limit = pSD->max_baud_rate;
+    uint good = pSD->spi->current_baud_rate;
+
+    if (SD_BLOCK_DEVICE_ERROR_NONE != sd_test_read(pSD, reference)) {
+        DBG_PRINTF("%s: reference read failed; staying at %u Hz\r\n", __FUNCTION__, good);
+        mutex_exit(&sd_negotiate_mutex);
+        return good;
+    }
+    for (size_t i = 0; i < count_of(sd_baud_candidates); ++i) {
+        uint target = sd_baud_candidates[i] < limit ? sd_baud_candidates[i] : limit;
+        uint actual = sd_spi_set_frequency(pSD, target);
+        if (actual > good) {
+            pSD->baud_rate = actual;  // What sd_spi_take() restores after a yield
+            bool ok = true;
+            for (int n = 0; n < SD_BAUD_TEST_READS && ok; ++n)
+                ok = SD_BLOCK_DEVICE_ERROR_NONE == sd_test_read(pSD, test) &&
+                     0 == memcmp(test, reference, sizeof test);
+            if (!ok) {
+                DBG_PRINTF("%s: %u Hz failed\r\n", __FUNCTION__, actual);
+                break;
+            }
+            good = actual;
+        }
+        if (target == limit) break;
+    }
+    pSD->baud_rate = sd_spi_set_frequency(pSD, good);
+    // A failed attempt may have left the card mid-transfer
+    sd_wait_ready(pSD, SD_COMMAND_TIMEOUT);
+
+    DBG_PRINTF("%s: %u Hz (card max %u Hz, SPI max %u Hz)\r\n", __FUNCTION__,
+               good, pSD->max_baud_rate, pSD->spi->baud_rate);
+    mutex_exit(&sd_negotiate_mutex);
+    return good;
+}
+
+/* Fall back one candidate step after a CRC error at run time.
+ * Called with the SPI acquired, so the new rate takes effect immediately. */
+static void sd_lower_baud_rate(sd_card_t *pSD) {
+    if (!pSD->baud_rate || pSD->baud_rate <= sd_baud_candidates[0]) return;
+    uint target = sd_baud_candidates[0];
+    for (size_t i = 0; i < count_of(sd_baud_candidates); ++i)
+        if (sd_baud_candidates[i] < pSD->baud_rate) target = sd_baud_candidates[i];
+    pSD->baud_rate = sd_spi_set_frequency(pSD, target);
+    DBG_PRINTF("%s: SCK lowered to %u Hz\r\n", __FUNCTION__, pSD->baud_rate);
+}
+
+/* Error recovery for block transfers
+ * ----------------------------------
+ * A failed sd_read_blocks() or sd_write_blocks() is repeated up to
+ * SD_RECOVERY_RETRIES times before the error reaches FatFs (and the
+ * application); the caller just sees a slower transfer. Before each retry:
+ *  - after a CRC error, SCK goes down one step;
+ *  - after a timeout, no response or a rejected block, the card gets
+ *    SD_RECOVERY_BACKOFF_MS << attempt ms with the SPI free for the other
+ *    cards, and from the second attempt on it is reset and initialized again
+ *    in place (CMD0, ACMD41, ...), one SCK step lower.
+ * Parameter errors (out of range, card not initialized) are returned at once.
+ * Asynchronous transfers report their errors to the callback unchanged.
+ * Cards in 4-bit SD mode follow the same policy (sd_card_sdio.c). */
+
+static int sd_init_medium(sd_card_t *pSD);
+
+// Reset and initialize the card again, with it and its SPI held
+static int sd_reinit(sd_card_t *pSD) {
+    sd_lower_baud_rate(pSD);
+    uint baud_rate = pSD->baud_rate;
+    // As in sd_init(): no rate while initializing, so that sd_spi_take() keeps
+    // the slow clock if sd_wait_ready() yields the SPI to another card
+    pSD->baud_rate = 0;
+    int status = sd_init_medium(pSD);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = sd_cmd(pSD, CMD16_SET_BLOCKLEN, _block_size, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        DBG_PRINTF("%s: failed: %d\r\n", __FUNCTION__, status);
+        pSD->m_Status |= STA_NOINIT;  // Fail fast until the next disk_initialize
+        return status;
+    }
+    if (baud_rate) pSD->baud_rate = sd_spi_set_frequency(pSD, baud_rate);
+    return status;
+}
+
+// After a transfer: true if it failed and should be tried again (*attempt counts them)
+static bool sd_retry(sd_card_t *pSD, int status, int *attempt) {
+    switch (status) {
+        case SD_BLOCK_DEVICE_ERROR_NONE:
+            if (*attempt) SD_COUNT(pSD, recovered);
+            return false;
+        case SD_BLOCK_DEVICE_ERROR_CRC:
+        case SD_BLOCK_DEVICE_ERROR_NO_RESPONSE:
+        case SD_BLOCK_DEVICE_ERROR_NO_DEVICE:
+        case SD_BLOCK_DEVICE_ERROR_WRITE:
+            break;
+        default:
+            return false;
+    }
+    if (*attempt >= SD_RECOVERY_RETRIES) {
+        DBG_PRINTF("%s: giving up after %d retries: %d\r\n", __FUNCTION__, *attempt, status);
+        SD_COUNT(pSD, unrecovered);
+        return false;
+    }
+    int n = (*attempt)++;
+    SD_COUNT(pSD, op_retries);
+    if (SD_BLOCK_DEVICE_ERROR_CRC == status) {
+        sd_lower_baud_rate(pSD);
+        return true;
+    }
+    sd_spi_release(pSD);
+    sleep_ms(SD_RECOVERY_BACKOFF_MS << n);
+    sd_spi_acquire(pSD);
+    if (!n) return true;
+    SD_COUNT(pSD, reinits);
+    return SD_BLOCK_DEVICE_ERROR_NONE == sd_reinit(pSD);
+}
+
 static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
                              uint64_t ulSectorNumber, uint32_t ulSectorCount) {
     uint32_t blockCnt = ulSectorCount;
@@ -874,8 +1283,8 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
     // receive the data : one block at a time
     int rd_status = 0;
     while (blockCnt) {
-        if (0 != sd_read_block(pSD, buffer, _block_size)) {
-            rd_status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+        rd_status = sd_read_block(pSD, buffer, _block_size);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rd_status) {
             break;
         }
         buffer += _block_size;
@@ -893,7 +1302,13 @@ int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
     sd_acquire(pSD);
     TRACE_PRINTF("sd_read_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, ulSectorCount);
-    int status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    uint32_t start = time_us_32();
+    int status, attempt = 0;
+    do {
+        status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    } while (sd_retry(pSD, status, &attempt));
+    sd_stat_op(pSD, ulSectorCount > 1 ? SD_STAT_CMD18 : SD_STAT_CMD17, start, status,
+               ulSectorCount * _block_size);
     sd_release(pSD);
     return status;
 }
@@ -906,17 +1321,10 @@ static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
     // indicate start of block
     sd_spi_write(pSD, token);
 
-    // write the data
-    bool ret = sd_spi_transfer(pSD, buffer, NULL, length);
+    // write the data, computing its CRC on the way (DMA sniffer)
+    bool ret = sd_spi_transfer_data(pSD, buffer, NULL, length, &crc);
     myASSERT(ret);
 
-#if SD_CRC_ENABLED
-    if (crc_on) {
-        // Compute CRC
-        crc = crc16((void *)buffer, length);
-    }
-#endif
-
     // write the checksum CRC16
     sd_spi_write(pSD, crc >> 8);
     sd_spi_write(pSD, crc);
@@ -931,6 +1339,98 @@ static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
     return (response & SPI_DATA_RESPONSE_MASK);
 }
 
+// CRC16 of a data block in software, or ~0 (what is sent) with CRC off
+static uint16_t sd_block_crc(const uint8_t *buffer) {
+#if SD_CRC_ENABLED
+    if (crc_on) return crc16((void *)buffer, _block_size);
+#endif
+    return ~0;
+}
+
+#if SD_WRITE_PIPELINED
+
+/* Wait for the card to release DO after programming a block.
+ * The first byte is often already non-zero, in which case there is no wait. */
+static bool sd_wait_not_busy(sd_card_t *pSD, int timeout_ms) {
+    if (sd_spi_write(pSD, SPI_FILL_CHAR)) return true;
+    uint32_t start = time_us_32();
+    absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+    do {
+        if (sd_spi_write(pSD, SPI_FILL_CHAR)) {
+            sd_stat_busy(pSD, start);
+            return true;
+        }
+        sd_spi_yield(pSD);
+    } while (!time_reached(timeout_time));
+    sd_stat_busy(pSD, start);
+    DBG_PRINTF("%s failed\r\n", __FUNCTION__);
+    return false;
+}
+
+/* Body of a CMD25 sequence. Each block goes out as a single gather DMA
+ * (Start Block token, 512 data bytes, CRC16), so the CPU never stalls the bus.
+ * The DMA sniffer follows the tx channel, seeded so that the token drops out,
+ * and the CRC it leaves is sent by polled SPI. Only if the sniffer is taken
+ * is the CRC computed in software: that of block N+1 while block N is on the
+ * wire, sent as the gather's last segment.
+ * The busy check is made only after the data response, with polled SPI.
+ * Returns with the card ready for the Stop Tran token. */
+static int sd_write_blocks_pipelined(sd_card_t *pSD, const uint8_t *buffer,
+                                     uint32_t blockCnt) {
+    static const uint8_t token = SPI_START_BLK_MUL_WRITE;
+    uint8_t crc_bytes[2];
+    bool sniff = false;
+#if SD_CRC_ENABLED
+    sniff = crc_on && spi_sniffer_claim();
+#endif
+    uint16_t crc = sniff ? 0 : sd_block_crc(buffer);
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+    do {
+        crc_bytes[0] = crc >> 8;
+        crc_bytes[1] = crc;
+        spi_segment_t segments[] = {
+            {1, &token},
+            {_block_size, buffer},
+            {2, crc_bytes},
+            {0, NULL}};
+        if (sniff) segments[2] = (spi_segment_t){0, NULL};
+        sd_spi_write_gather_start(pSD, segments, 1 + _block_size + (sniff ? 0 : 2), sniff,
+                                  token << 8);
+
+        // Overlap: next block's CRC while this one is being sent
+        if (!sniff && blockCnt > 1) crc = sd_block_crc(buffer + _block_size);
+
+        if (!sd_spi_transfer_wait(pSD)) {
+            status = SD_BLOCK_DEVICE_ERROR_WRITE;
+            break;
+        }
+        if (sniff) {
+            uint16_t sniffed = spi_sniffer_crc16();
+            sd_spi_write(pSD, sniffed >> 8);
+            sd_spi_write(pSD, sniffed);
+        }
+
+        uint8_t response = sd_spi_write(pSD, SPI_FILL_CHAR) & SPI_DATA_RESPONSE_MASK;
+        if (response != SPI_DATA_ACCEPTED) {
+            DBG_PRINTF("Multiple Block Write failed: 0x%x\r\n", response);
+            if (SPI_DATA_CRC_ERROR == response) SD_COUNT(pSD, crc_errors);
+            status = (SPI_DATA_CRC_ERROR == response) ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                      : SD_BLOCK_DEVICE_ERROR_WRITE;
+            break;
+        }
+        if (!sd_wait_not_busy(pSD, SD_COMMAND_TIMEOUT)) {
+            status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            break;
+        }
+
+        buffer += _block_size;
+    } while (--blockCnt);
+    if (sniff) spi_sniffer_unclaim();
+    return status;
+}
+#endif
+
 /** Program blocks to a block device
  *
  *
@@ -977,7 +1477,9 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
         // Only CRC and general write error are communicated via response token
         if (response != SPI_DATA_ACCEPTED) {
             DBG_PRINTF("Single Block Write failed: 0x%x \r\n", response);
-            status = SD_BLOCK_DEVICE_ERROR_WRITE;
+            if (SPI_DATA_CRC_ERROR == response) SD_COUNT(pSD, crc_errors);
+            status = (SPI_DATA_CRC_ERROR == response) ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                      : SD_BLOCK_DEVICE_ERROR_WRITE;
         }
     } else {
         // Pre-erase setting prior to multiple block write operation
@@ -991,16 +1493,23 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
             (status = sd_cmd(pSD, CMD25_WRITE_MULTIPLE_BLOCK, addr, false, 0))) {
             return status;
         }
+#if SD_WRITE_PIPELINED
+        // Write the data: pipelined, see sd_write_blocks_pipelined()
+        status = sd_write_blocks_pipelined(pSD, buffer, blockCnt);
+#else
         // Write the data: one block at a time
         do {
             response = sd_write_block(pSD, buffer, SPI_START_BLK_MUL_WRITE, _block_size);
             if (response != SPI_DATA_ACCEPTED) {
                 DBG_PRINTF("Multiple Block Write failed: 0x%x\r\n", response);
-                status = SD_BLOCK_DEVICE_ERROR_WRITE;
+                if (SPI_DATA_CRC_ERROR == response) SD_COUNT(pSD, crc_errors);
+                status = (SPI_DATA_CRC_ERROR == response) ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                          : SD_BLOCK_DEVICE_ERROR_WRITE;
                 break;
             }
             buffer += _block_size;
         } while (--blockCnt);  // Send all blocks of data
+#endif
         /* In a Multiple Block write operation, the stop transmission will be
          * done by sending 'Stop Tran' token instead of 'Start Block' token at
          * the beginning of the next block
@@ -1010,8 +1519,9 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
     uint32_t stat = 0;
     // Some SD cards want to be deselected between every bus transaction:
     sd_spi_deselect_pulse(pSD);
-    status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
-    return status;
+    int stat_status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    // Don't let the status read mask a failed data block
+    return status ? status : stat_status;
 }
 
 int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
@@ -1019,11 +1529,377 @@ int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
     sd_acquire(pSD);
     TRACE_PRINTF("sd_write_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, blockCnt);
-    int status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    uint32_t start = time_us_32();
+    int status, attempt = 0;
+    do {
+        status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    } while (sd_retry(pSD, status, &attempt));
+    sd_stat_op(pSD, blockCnt > 1 ? SD_STAT_CMD25 : SD_STAT_CMD24, start, status,
+               blockCnt * _block_size);
     sd_release(pSD);
     return status;
 }
 
+/* Asynchronous block transfers
+ * -----------------------------
+ * The command phase (ACMD23 + CMD25, or CMD18) is issued by the caller, the
+ * same way as the blocking path. From then on the transfer is a state machine
+ * advanced from interrupt context: the DMA completion IRQ (spi.c) ends each
+ * 512-byte data phase, and an alarm polls the card while it is busy
+ * programming a block or preparing the next read token. The few bytes in
+ * between (tokens, CRC, data response, CMD12) go through sd_spi_write(),
+ * which polls the FIFO and so is safe in an IRQ.
+ *
+ * The IRQ does no CRC work: the DMA sniffer, claimed for the whole transfer,
+ * computes each block's CRC as it goes by. Only if it is taken are the CRCs
+ * done in software, in thread context: those of the blocks to write before
+ * the transfer starts, and those received by a read checked by
+ * sd_async_wait().
+ *
+ * The card stays taken (async.sem) for the whole transfer and is given back
+ * by the completion path, so any other access to the card simply blocks
+ * until the transfer is over. The mutex is not held meanwhile: it could not
+ * be released from the IRQ. For the same reason the completion callback must
+ * not start another transfer. Its SPI, though, is given up while the card is busy, if
+ * another card is queued for it (sd_spi_park()), and the poll waits for the
+ * bus's scheduler to hand it back: cards sharing an SPI interleave their data
+ * phases with each other's programming time instead of taking turns for
+ * whole transfers.
+ */
+
+#define SD_ASYNC_POLL_US 50     /*!< Busy/token poll period */
+#define SD_ASYNC_POLL_BYTES 8   /*!< Bytes clocked per poll before deferring to the alarm */
+
+enum {
+    SD_ASYNC_IDLE,
+    SD_ASYNC_WRITE_DATA,      // DMA of a data block in flight
+    SD_ASYNC_WRITE_BUSY,      // Card programming the block
+    SD_ASYNC_WRITE_STOP_BUSY, // Card finishing after the Stop Tran token
+    SD_ASYNC_READ_TOKEN,      // Waiting for the start block token
+    SD_ASYNC_READ_DATA,       // DMA of a data block in flight
+    SD_ASYNC_READ_STOP_BUSY,  // CMD12 busy
+};
+
+static void sd_async_dma_done(void *context);
+
+static void sd_async_finish(sd_card_t *pSD) {
+    sd_async_t *a = &pSD->async;
+    a->state = SD_ASYNC_IDLE;
+    sd_stat_op(pSD, a->stat_op, a->start_us, a->status, a->bytes);
+    if (a->sniff) spi_sniffer_unclaim();
+    sd_spi_release(pSD);
+    a->pending = false;
+    // Before the card is given back, so that its status is in place for
+    // whoever sd_async_wait() lets through
+    if (a->callback) a->callback(pSD, a->status, a->context);
+    sem_release(&a->sem);
+}
+
+static void sd_async_write_next_block(sd_card_t *pSD) {
+    sd_async_t *a = &pSD->async;
+    sd_spi_write(pSD, a->multi ? SPI_START_BLK_MUL_WRITE : SPI_START_BLOCK);
+    a->state = SD_ASYNC_WRITE_DATA;
+    sd_spi_transfer_async(pSD, a->tx, NULL, _block_size, sd_async_dma_done, pSD, a->sniff);
+}
+
+static void sd_async_read_stop(sd_card_t *pSD) {
+    sd_async_t *a = &pSD->async;
+    if (!a->multi) {
+        sd_async_finish(pSD);
+        return;
+    }
+    char cmdPacket[PACKET_SIZE];
+    sd_cmd_packet(cmdPacket, CMD12_STOP_TRANSMISSION, 0);
+    sd_spi_transfer(pSD, (const uint8_t *)cmdPacket, NULL, PACKET_SIZE);
+    sd_spi_write(pSD, SPI_FILL_CHAR);  // Stuff byte
+    uint8_t response = R1_NO_RESPONSE;
+    for (int i = 0; i < 0x10 && (response & R1_RESPONSE_RECV); i++)
+        response = sd_spi_write(pSD, SPI_FILL_CHAR);
+    if (R1_NO_RESPONSE == response && !a->status) a->status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    a->state = SD_ASYNC_READ_STOP_BUSY;
+    a->deadline = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+}
+
+/* Advance the transfer as far as possible without blocking.
+ * Returns 0 if the next step is driven by a DMA IRQ (or the transfer is
+ * over), or the delay in us before polling the card again. */
+static int64_t sd_async_step(sd_card_t *pSD) {
+    sd_async_t *a = &pSD->async;
+    for (;;) {
+        switch (a->state) {
+            case SD_ASYNC_WRITE_BUSY:
+            case SD_ASYNC_WRITE_STOP_BUSY:
+            case SD_ASYNC_READ_STOP_BUSY: {
+                if (a->parked) {
+                    // A ticket can't be given back: wait for the turn, even past the deadline
+                    if (!sd_spi_resume(pSD, a->ticket)) return SD_ASYNC_POLL_US;
+                    a->parked = false;
+                }
+                uint8_t resp = 0;
+                for (int i = 0; i < SD_ASYNC_POLL_BYTES && !resp; i++)
+                    resp = sd_spi_write(pSD, SPI_FILL_CHAR);
+                if (!resp) {
+                    if (!time_reached(a->deadline)) {
+                        // Still busy: let the other cards on the SPI have it meanwhile
+                        a->parked = sd_spi_park(pSD, &a->ticket);
+                        return SD_ASYNC_POLL_US;
+                    }
+                    DBG_PRINTF("%s: busy timeout\r\n", __FUNCTION__);
+                    a->status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+                    sd_async_finish(pSD);
+                    return 0;
+                }
+                if (SD_ASYNC_WRITE_BUSY == a->state && a->blocks_left && !a->status) {
+                    sd_async_write_next_block(pSD);
+                    return 0;
+                }
+                if (SD_ASYNC_WRITE_BUSY == a->state && a->multi) {
+                    /* In a Multiple Block write operation, the stop transmission will be
+                     * done by sending 'Stop Tran' token instead of 'Start Block' token at
+                     * the beginning of the next block */
+                    sd_spi_write(pSD, SPI_STOP_TRAN);
+                    sd_spi_write(pSD, SPI_FILL_CHAR);
+                    a->state = SD_ASYNC_WRITE_STOP_BUSY;
+                    a->deadline = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+                    continue;
+                }
+                sd_async_finish(pSD);
+                return 0;
+            }
+            case SD_ASYNC_READ_TOKEN: {
+                uint8_t token = SPI_FILL_CHAR;
+                for (int i = 0; i < SD_ASYNC_POLL_BYTES && SPI_FILL_CHAR == token; i++)
+                    token = sd_spi_write(pSD, SPI_FILL_CHAR);
+                if (SPI_START_BLOCK == token) {
+                    a->state = SD_ASYNC_READ_DATA;
+                    sd_spi_transfer_async(pSD, NULL, a->rx, _block_size, sd_async_dma_done, pSD,
+                                          a->sniff);
+                    return 0;
+                }
+                if (SPI_FILL_CHAR == token && !time_reached(a->deadline)) return SD_ASYNC_POLL_US;
+                DBG_PRINTF("%s: read token 0x%02x\r\n", __FUNCTION__, token);
+                a->status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+                sd_async_read_stop(pSD);
+                continue;
+            }
+            default:
+                return 0;
+        }
+    }
+}
+
+static int64_t sd_async_alarm(alarm_id_t id, void *user_data) {
+    return sd_async_step((sd_card_t *)user_data);
+}
+
+static void sd_async_poll_later(sd_card_t *pSD, int64_t delay_us) {
+    if (delay_us && add_alarm_in_us(delay_us, sd_async_alarm, pSD, true) <= 0) {
+        // No alarm slot available: finish the wait here
+        while ((delay_us = sd_async_step(pSD)))
+            busy_wait_us(delay_us);
+    }
+}
+
+// Called from the DMA IRQ at the end of a data block
+static void sd_async_dma_done(void *context) {
+    sd_card_t *pSD = context;
+    sd_async_t *a = &pSD->async;
+    uint16_t crc;
+
+    switch (a->state) {
+        case SD_ASYNC_WRITE_DATA: {
+            // Sniffed, or else see sd_write_blocks_async()
+            crc = a->sniff ? spi_sniffer_crc16() : a->crc[a->blocks - a->blocks_left];
+            sd_spi_write(pSD, crc >> 8);
+            sd_spi_write(pSD, crc);
+            uint8_t response = sd_spi_write(pSD, SPI_FILL_CHAR) & SPI_DATA_RESPONSE_MASK;
+            if (response != SPI_DATA_ACCEPTED) {
+                DBG_PRINTF("Async Block Write failed: 0x%x\r\n", response);
+                if (SPI_DATA_CRC_ERROR == response) SD_COUNT(pSD, crc_errors);
+                a->status = (SPI_DATA_CRC_ERROR == response) ? SD_BLOCK_DEVICE_ERROR_CRC
+                                                             : SD_BLOCK_DEVICE_ERROR_WRITE;
+            }
+            a->tx += _block_size;
+            a->blocks_left--;
+            a->state = SD_ASYNC_WRITE_BUSY;
+            break;
+        }
+        case SD_ASYNC_READ_DATA:
+            crc = sd_spi_write(pSD, SPI_FILL_CHAR) << 8;
+            crc |= sd_spi_write(pSD, SPI_FILL_CHAR);
+            if (!a->sniff) {
+                a->crc[a->blocks - a->blocks_left] = crc;  // Checked by sd_async_wait()
+            } else if (crc != spi_sniffer_crc16()) {
+                DBG_PRINTF("%s: Invalid CRC\r\n", __FUNCTION__);
+                SD_COUNT(pSD, crc_errors);
+                a->status = SD_BLOCK_DEVICE_ERROR_CRC;
+            }
+            a->rx += _block_size;
+            if (--a->blocks_left && !a->status) {
+                a->state = SD_ASYNC_READ_TOKEN;
+            } else {
+                sd_async_read_stop(pSD);
+            }
+            break;
+        default:
+            myASSERT(false);
+            return;
+    }
+    a->deadline = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+    sd_async_poll_later(pSD, sd_async_step(pSD));
+}
+
+static int sd_async_begin(sd_card_t *pSD, uint64_t ulSectorNumber, uint32_t blockCnt,
+                          sd_async_callback_t callback, void *context, uint64_t *addr) {
+    if (!blockCnt || blockCnt > SD_ASYNC_MAX_BLOCKS || ulSectorNumber + blockCnt > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    sd_async_t *a = &pSD->async;
+    a->multi = blockCnt > 1;
+    a->blocks = blockCnt;
+    a->blocks_left = blockCnt;
+    a->start_us = time_us_32();
+    a->bytes = blockCnt * _block_size;
+    a->status = SD_BLOCK_DEVICE_ERROR_NONE;
+    a->callback = callback;
+    a->context = context;
+    a->parked = false;
+    a->check_crc = false;
+    a->sniff = false;
+#if SD_CRC_ENABLED
+    // Held until sd_async_finish(): the SPI may serve other cards meanwhile
+    a->sniff = crc_on && spi_sniffer_claim();
+#endif
+    a->pending = true;
+
+    // SDSC Card (CCS=0) uses byte unit address
+    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+    *addr = (SDCARD_V2HC == pSD->card_type) ? ulSectorNumber : ulSectorNumber * _block_size;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// Report a failure in the command phase: the transfer never started
+static int sd_async_abort(sd_card_t *pSD, int status) {
+    pSD->async.status = status;
+    pSD->async.callback = NULL;
+    sd_async_finish(pSD);
+    mutex_exit(&pSD->mutex);
+    return status;
+}
+
+// The transfer is under way: it keeps the card (async.sem) until it
+// completes, but thread context is done with it
+static int sd_async_started(sd_card_t *pSD) {
+    mutex_exit(&pSD->mutex);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+/** Start writing up to SD_ASYNC_MAX_BLOCKS blocks and return without waiting
+ *  for the card.
+ *
+ *  buffer must stay valid until callback(pSD, status, context) is called,
+ *  from interrupt context, or sd_async_wait() returns. The callback must not
+ *  start another transfer.
+ *  @return SD_BLOCK_DEVICE_ERROR_NONE if the transfer was started;
+ *          otherwise the error, and callback is not called.
+ */
+static int sd_write_blocks_async(sd_card_t *pSD, const uint8_t *buffer,
+                                 uint64_t ulSectorNumber, uint32_t blockCnt,
+                                 sd_async_callback_t callback, void *context) {
+    sd_acquire(pSD);
+    uint64_t addr;
+    int status = sd_async_begin(pSD, ulSectorNumber, blockCnt, callback, context, &addr);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        pSD->async.pending = false;
+        sd_release(pSD);
+        return status;
+    }
+    pSD->async.stat_op = pSD->async.multi ? SD_STAT_CMD25 : SD_STAT_CMD24;
+    // Without the sniffer, the CRCs are computed here rather than in the IRQ
+    // that sends each one
+    for (uint32_t i = 0; i < blockCnt && !pSD->async.sniff; i++)
+        pSD->async.crc[i] = sd_block_crc(buffer + i * _block_size);
+    if (pSD->async.multi) {
+        // Pre-erase setting prior to multiple block write operation
+        sd_cmd(pSD, ACMD23_SET_WR_BLK_ERASE_COUNT, blockCnt, 1, 0);
+        // Some SD cards want to be deselected between every bus transaction:
+        sd_spi_deselect_pulse(pSD);
+        status = sd_cmd(pSD, CMD25_WRITE_MULTIPLE_BLOCK, addr, false, 0);
+    } else {
+        status = sd_cmd(pSD, CMD24_WRITE_BLOCK, addr, false, 0);
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return sd_async_abort(pSD, status);
+
+    pSD->async.tx = buffer;
+    sd_async_write_next_block(pSD);
+    return sd_async_started(pSD);
+}
+
+/** Start reading blocks and return without waiting for the card.
+ *  See sd_write_blocks_async(). With CRC on and the sniffer taken, the blocks'
+ *  CRCs are checked by sd_async_wait(): the status passed to callback doesn't
+ *  cover them, so a read must be completed with sd_async_wait() before the
+ *  next transfer.
+ */
+static int sd_read_blocks_async(sd_card_t *pSD, uint8_t *buffer,
+                                uint64_t ulSectorNumber, uint32_t ulSectorCount,
+                                sd_async_callback_t callback, void *context) {
+    sd_acquire(pSD);
+    uint64_t addr;
+    int status = sd_async_begin(pSD, ulSectorNumber, ulSectorCount, callback, context, &addr);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        pSD->async.pending = false;
+        sd_release(pSD);
+        return status;
+    }
+    pSD->async.stat_op = pSD->async.multi ? SD_STAT_CMD18 : SD_STAT_CMD17;
+    status = sd_cmd(pSD, pSD->async.multi ? CMD18_READ_MULTIPLE_BLOCK : CMD17_READ_SINGLE_BLOCK,
+                    addr, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return sd_async_abort(pSD, status);
+
+    pSD->async.rx = buffer;
+    pSD->async.buffer = buffer;
+#if SD_CRC_ENABLED
+    pSD->async.check_crc = crc_on && !pSD->async.sniff;
+#endif
+    pSD->async.state = SD_ASYNC_READ_TOKEN;
+    pSD->async.deadline = make_timeout_time_ms(SD_COMMAND_TIMEOUT);
+    sd_async_poll_later(pSD, sd_async_step(pSD));
+    return sd_async_started(pSD);
+}
+
+// True while an asynchronous transfer is in progress on the card
+bool sd_async_busy(sd_card_t *pSD) {
+    return pSD->async.pending;
+}
+
+// Check the CRCs received by an asynchronous read, deferred from the DMA IRQ
+static void sd_async_check_read(sd_card_t *pSD) {
+    sd_async_t *a = &pSD->async;
+    if (!a->check_crc) return;
+    a->check_crc = false;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != a->status) return;
+    for (uint32_t i = 0; i < a->blocks; i++) {
+        if (a->crc[i] != sd_block_crc(a->buffer + i * _block_size)) {
+            DBG_PRINTF("%s: Invalid CRC in block %lu\r\n", __FUNCTION__, (unsigned long)i);
+            SD_COUNT(pSD, crc_errors);
+            a->status = SD_BLOCK_DEVICE_ERROR_CRC;
+            return;
+        }
+    }
+}
+
+// Wait for the asynchronous transfer in progress, if any; returns its status
+int sd_async_wait(sd_card_t *pSD) {
+    sd_lock(pSD);  // Only granted once the transfer is over
+    sd_async_check_read(pSD);
+    int status = pSD->async.status;
+    sd_unlock(pSD);
+    return status;
+}
+
 static int sd_init_medium(sd_card_t *pSD) {
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     uint32_t response, arg;
@@ -1131,12 +2007,74 @@ static int sd_init_medium(sd_card_t *pSD) {
 static int sd_init(sd_card_t *pSD);
 static bool sd_test_com(sd_card_t *pSD);
 
+/* Erase (TRIM) a range of sectors: CMD32 and CMD33 select the first and last
+ * block, CMD38 erases them. Long ranges go in runs of SD_ERASE_RUN_AUS
+ * allocation units (at least SD_ERASE_RUN_MIN sectors), each expected to
+ * finish within SD_ERASE_TIMEOUT. */
+#define SD_ERASE_TIMEOUT 5000 /*!< Timeout in ms for one CMD38 */
+#define SD_ERASE_RUN_AUS 4
+#define SD_ERASE_RUN_MIN 8192 /*!< Sectors (4 MB), for cards with small erase units */
+
+static int in_sd_trim_blocks(sd_card_t *pSD, uint64_t ulSectorNumber, uint64_t ulSectorCount) {
+    if (ulSectorNumber + ulSectorCount > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    uint64_t run = (uint64_t)SD_ERASE_RUN_AUS * pSD->au_sectors;
+    if (run < SD_ERASE_RUN_MIN) run = SD_ERASE_RUN_MIN;
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    while (ulSectorCount && SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        uint64_t n = ulSectorCount < run ? ulSectorCount : run;
+        uint64_t start = ulSectorNumber, end = ulSectorNumber + n - 1;
+        // SDSC Card (CCS=0) uses byte unit address
+        // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+        if (SDCARD_V2HC != pSD->card_type) {
+            start *= _block_size;
+            end *= _block_size;
+        }
+        status = sd_cmd(pSD, CMD32_ERASE_WR_BLK_START_ADDR, start, false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = sd_cmd(pSD, CMD33_ERASE_WR_BLK_END_ADDR, end, false, 0);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = sd_cmd(pSD, CMD38_ERASE, 0, false, 0);
+        // R1b: sd_cmd waits SD_COMMAND_TIMEOUT; erasing may take longer
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status && !sd_wait_ready(pSD, SD_ERASE_TIMEOUT)) {
+            DBG_PRINTF("%s: erase timeout\r\n", __FUNCTION__);
+            status = SD_BLOCK_DEVICE_ERROR_ERASE;
+        }
+        ulSectorNumber += n;
+        ulSectorCount -= n;
+    }
+    return status;
+}
+
+static int sd_trim_blocks(sd_card_t *pSD, uint64_t ulSectorNumber, uint64_t ulSectorCount) {
+    sd_acquire(pSD);
+    TRACE_PRINTF("sd_trim_blocks(0x%llx, 0x%llx)\r\n", ulSectorNumber, ulSectorCount);
+    uint32_t start = time_us_32();
+    int status = in_sd_trim_blocks(pSD, ulSectorNumber, ulSectorCount);
+    sd_stat_op(pSD, SD_STAT_CMD38, start, status, 0);
+    sd_release(pSD);
+    return status;
+}
+
 static void sd_ctor(sd_card_t *pSD) {
     // State variables:
     pSD->m_Status = STA_NOINIT;
+    pSD->async.state = SD_ASYNC_IDLE;
+    pSD->async.pending = false;
+    sem_init(&pSD->async.sem, 1, 1);
+    if (SD_IF_SDIO == pSD->type) {
+        sd_sdio_ctor(pSD);
+        return;
+    }
     pSD->init = sd_init;
     pSD->write_blocks = sd_write_blocks;
     pSD->read_blocks = sd_read_blocks;
+    pSD->trim_blocks = sd_trim_blocks;
+    pSD->write_blocks_async = sd_write_blocks_async;
+    pSD->read_blocks_async = sd_read_blocks_async;
     pSD->sd_test_com = sd_test_com;
 }
 bool sd_init_driver() {
@@ -1154,6 +2092,13 @@ bool sd_init_driver() {
                 gpio_pull_up(pSD->card_detect_gpio);
                 gpio_set_dir(pSD->card_detect_gpio, GPIO_IN);
             }
+            if (SD_IF_SDIO == pSD->type) {
+                if (!sdio_init(pSD->sdio_if)) {
+                    mutex_exit(&sd_init_driver_mutex);
+                    return false;
+                }
+                continue;
+            }
             if (pSD->set_drive_strength) {
                 gpio_set_drive_strength(pSD->ss_gpio, pSD->ss_gpio_drive_strength);
             }
@@ -1199,6 +2144,7 @@ static int sd_init(sd_card_t *pSD) {
     }
     // Initialize the member variables
     pSD->card_type = SDCARD_NONE;
+    pSD->baud_rate = 0;
 
     sd_spi_acquire(pSD);
 
@@ -1210,7 +2156,12 @@ static int sd_init(sd_card_t *pSD) {
         return pSD->m_Status;
     }
     DBG_PRINTF("SD card initialized\r\n");
-    pSD->sectors = sd_sectors_nolock(pSD);
+    uint8_t csd[16];
+    pSD->sectors = 0;
+    if (SD_BLOCK_DEVICE_ERROR_NONE == sd_read_csd(pSD, csd)) {
+        pSD->sectors = sd_csd_sectors(csd);
+        pSD->max_baud_rate = sd_csd_tran_speed(csd);
+    }
     if (0 == pSD->sectors) {
         // CMD9 failed
         sd_spi_release(pSD);
@@ -1224,8 +2175,15 @@ static int sd_init(sd_card_t *pSD) {
         sd_unlock(pSD);
         return pSD->m_Status;
     }
-    // Set SCK for data transfer
-    sd_spi_go_high_frequency(pSD);
+    // Set SCK for data transfer: fastest rate this card reads reliably at
+    pSD->baud_rate = sd_negotiate_baud_rate(pSD);
+
+    // Allocation unit, for aligning the file system to it (GET_BLOCK_SIZE)
+    uint8_t ssr[64];
+    pSD->au_sectors = 0;
+    if (SD_BLOCK_DEVICE_ERROR_NONE == sd_read_sd_status(pSD, ssr))
+        pSD->au_sectors = sd_ssr_au_sectors(ssr);
+    if (!pSD->au_sectors) pSD->au_sectors = sd_csd_erase_sectors(csd);
 
     // The card is now initialized
     pSD->m_Status &= ~STA_NOINIT;
@@ -21,9 +21,12 @@ specific language governing permissions and limitations under the License.
 //
 #include "hardware/gpio.h"
 #include "pico/mutex.h"
+#include "pico/sem.h"
+#include "pico/time.h"
 //
 #include "ff.h"
 //
+#include "sdio.h"
 #include "spi.h"
 
 #ifdef __cplusplus
@@ -32,9 +35,109 @@ extern "C" {
 
 typedef struct sd_card_t sd_card_t;
 
+// Bus the card is on
+typedef enum {
+    SD_IF_SPI,   // SPI mode: spi, ss_gpio
+    SD_IF_SDIO,  // 4-bit SD mode on PIO: sdio_if (see sdio.h)
+} sd_if_t;
+
+// card_type values
+#define SDCARD_NONE 0  /**< No card is present */
+#define SDCARD_V1 1    /**< v1.x Standard Capacity */
+#define SDCARD_V2 2    /**< v2.x Standard capacity SD card */
+#define SDCARD_V2HC 3  /**< v2.x High capacity SD card */
+#define CARD_UNKNOWN 4 /**< Unknown or unsupported card */
+
+/* Driver statistics (SD_CMD_STATS; both interfaces): latency histograms of
+ * the data, status and erase commands, each measured over the whole operation
+ * (command, data blocks, busy wait), and counters. Cumulative since boot or
+ * sd_reset_stats(). */
+#ifndef SD_CMD_STATS
+#define SD_CMD_STATS 1
+#endif
+#define SD_STATS_BUCKETS 16  // Bucket i < 16 << i us; the last one is open-ended
+typedef enum {
+    SD_STAT_CMD17,  // Single block read
+    SD_STAT_CMD18,  // Multiple block read
+    SD_STAT_CMD24,  // Single block write
+    SD_STAT_CMD25,  // Multiple block write
+    SD_STAT_CMD13,  // Send status
+    SD_STAT_CMD38,  // Erase (CMD32, CMD33 and CMD38 of each run)
+    SD_STAT_OPS
+} sd_stat_op_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t errors;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t hist[SD_STATS_BUCKETS];
+} sd_op_stats_t;
+
+typedef struct {
+    sd_op_stats_t op[SD_STAT_OPS];
+    uint32_t busy_waits;     // Waits for the card to release DO (sd_wait_ready and the like)
+    uint64_t busy_us;
+    uint32_t busy_max_us;
+    uint64_t bytes_read;     // Data blocks of successful operations
+    uint64_t bytes_written;
+    uint32_t retries;        // Commands sent again after no response
+    uint32_t crc_errors;     // Data blocks and command responses
+    uint32_t op_retries;     // Block transfers repeated by the error recovery
+    uint32_t recovered;      // ... that then succeeded
+    uint32_t reinits;        // Card reset and initialized again in place
+    uint32_t unrecovered;    // Errors passed on after SD_RECOVERY_RETRIES
+} sd_stats_t;
+
+// Error recovery for block transfers, on both interfaces: attempts after the
+// first, and the base of the exponential wait before each (see sd_card.c)
+#ifndef SD_RECOVERY_RETRIES
+#define SD_RECOVERY_RETRIES 4
+#endif
+#ifndef SD_RECOVERY_BACKOFF_MS
+#define SD_RECOVERY_BACKOFF_MS 2
+#endif
+
+// Blocks per asynchronous transfer: their CRCs are kept in sd_async_t
+#ifndef SD_ASYNC_MAX_BLOCKS
+#define SD_ASYNC_MAX_BLOCKS 16
+#endif
+
+// Completion of an asynchronous transfer. It runs in interrupt context,
+// before the card is free again, so it must not start another transfer or
+// otherwise call into the card: it would wait for itself.
+typedef void (*sd_async_callback_t)(sd_card_t *sd_card_p, int status, void *context);
+
+// State of the asynchronous transfer in progress on a card
+typedef struct {
+    volatile int state;
+    volatile bool pending;
+    bool multi;                      // CMD25/CMD18 (vs. CMD24/CMD17)
+    const uint8_t *tx;
+    uint8_t *rx;
+    uint32_t blocks;
+    uint32_t blocks_left;
+    int status;
+    absolute_time_t deadline;        // For the current busy/token wait
+    bool parked;                     // SPI given up while the card is busy
+    uint16_t ticket;                 // Place in the SPI's queue while parked
+    sd_async_callback_t callback;
+    void *context;
+    uint32_t start_us;               // For the statistics: whole transfer
+    uint32_t bytes;
+    sd_stat_op_t stat_op;
+    const uint8_t *buffer;           // Start of the data, for the deferred CRC check
+    bool sniff;                      // DMA sniffer claimed for the transfer
+    bool check_crc;                  // Read CRCs still to be verified (see sd_async_wait)
+    uint16_t crc[SD_ASYNC_MAX_BLOCKS]; // Without the sniffer: to send, or as received
+    semaphore_t sem;                 // Holds the card; released on completion (IRQ)
+} sd_async_t;
+
 // "Class" representing SD Cards
 struct sd_card_t {
     const char *pcName;
+    sd_if_t type;                   // Default: SD_IF_SPI
+    sdio_if_t *sdio_if;             // For SD_IF_SDIO; spi and ss_gpio are ignored then
     spi_t *spi;
     // Slave select is here instead of in spi_t because multiple SDs can share an SPI.
     uint ss_gpio;                   // Slave select for this SD card
@@ -51,15 +154,35 @@ struct sd_card_t {
     int m_Status;                                    // Card status
     uint64_t sectors;                                // Assigned dynamically
     int card_type;                                   // Assigned dynamically
+    uint max_baud_rate;                              // From CSD TRAN_SPEED; assigned dynamically
+    uint baud_rate;                                  // Negotiated SCK; assigned dynamically
+    uint32_t au_sectors;                             // Allocation unit (erase block); assigned dynamically
     mutex_t mutex;
     FATFS fatfs;
     bool mounted;
+    sd_stats_t stats;
 
     int (*init)(sd_card_t *sd_card_p);
     int (*write_blocks)(sd_card_t *sd_card_p, const uint8_t *buffer,
                     uint64_t ulSectorNumber, uint32_t blockCnt);
     int (*read_blocks)(sd_card_t *sd_card_p, uint8_t *buffer, uint64_t ulSectorNumber,
                     uint32_t ulSectorCount);
+    // Erase sectors the file system no longer uses (CTRL_TRIM)
+    int (*trim_blocks)(sd_card_t *sd_card_p, uint64_t ulSectorNumber,
+                    uint64_t ulSectorCount);
+
+    // Queue a transfer of up to SD_ASYNC_MAX_BLOCKS blocks and return
+    // immediately. The card stays taken until the transfer completes; other
+    // calls on it block until then. A read must be completed with
+    // sd_async_wait(), which checks its CRCs.
+    // NULL if the interface has no asynchronous mode (SD_IF_SDIO).
+    int (*write_blocks_async)(sd_card_t *sd_card_p, const uint8_t *buffer,
+                    uint64_t ulSectorNumber, uint32_t blockCnt,
+                    sd_async_callback_t callback, void *context);
+    int (*read_blocks_async)(sd_card_t *sd_card_p, uint8_t *buffer,
+                    uint64_t ulSectorNumber, uint32_t ulSectorCount,
+                    sd_async_callback_t callback, void *context);
+    sd_async_t async;
 
     // Useful when use_card_detect is false - call periodically to check for presence of SD card
     // Returns true if and only if SD card was sensed on the bus
@@ -91,8 +214,39 @@ bool sd_card_detect(sd_card_t *pSD);
 uint64_t sd_sectors(sd_card_t *pSD);
 
 bool sd_init_driver();
+void sd_sdio_ctor(sd_card_t *sd_card_p);  // See sd_card_sdio.c
+
+// CSD fields, common to both interfaces
+uint32_t sd_csd_tran_speed(uint8_t *csd);
+uint64_t sd_csd_sectors(uint8_t *csd);
+uint32_t sd_csd_erase_sectors(uint8_t *csd);
+uint32_t sd_ssr_au_sectors(const uint8_t *ssr);
 bool sd_card_detect(sd_card_t *sd_card_p);
 
+bool sd_async_busy(sd_card_t *sd_card_p);
+int sd_async_wait(sd_card_t *sd_card_p);
+
+// Per-command count, average/max time and errors (SD_CMD_STATS)
+void sd_print_cmd_stats();
+
+// Recording, for the drivers of both interfaces
+#if SD_CMD_STATS
+// One operation, started at start_us (time_us_32); bytes count only if it succeeded
+void sd_stat_op(sd_card_t *sd_card_p, sd_stat_op_t op, uint32_t start_us, int status,
+                uint32_t bytes);
+#define SD_COUNT(pSD, field) ((pSD)->stats.field++)
+#else
+#define sd_stat_op(pSD, op, start_us, status, bytes)
+#define SD_COUNT(pSD, field)
+#endif
+
+// Statistics of every card and bus counters of every SPI, as text lines
+// passed one at a time to put(context, line)
+typedef void (*sd_stats_put_t)(void *context, const char *line);
+void sd_stats_report(sd_stats_put_t put, void *context);
+void sd_print_stats();  // sd_stats_report() to stdout
+void sd_reset_stats();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,529 @@
+/* sd_card_sdio.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* SD card in 4-bit SD mode, on the PIO bus in sdio.c.
+ * Provides the same sd_card_t methods as the SPI driver in sd_card.c, so
+ * glue.c and FatFs don't see the difference. See the SD Physical Layer
+ * Simplified Specification, chapter 4, for the protocol. */
+
+#include <inttypes.h>
+#include <string.h>
+//
+#include "pico/stdlib.h"
+//
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sdio.h"
+//
+#include "ff.h" /* Obtains integer types */
+//
+#include "diskio.h" /* Declarations of disk functions */  // Needed for STA_NOINIT, ...
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf  // task_printf
+
+/* SD mode commands used here */
+typedef enum {
+    CMD0_GO_IDLE_STATE = 0,
+    CMD2_ALL_SEND_CID = 2,
+    CMD3_SEND_RELATIVE_ADDR = 3,
+    CMD7_SELECT_CARD = 7,
+    CMD8_SEND_IF_COND = 8,
+    CMD9_SEND_CSD = 9,
+    CMD12_STOP_TRANSMISSION = 12,
+    CMD13_SEND_STATUS = 13,
+    CMD16_SET_BLOCKLEN = 16,
+    CMD17_READ_SINGLE_BLOCK = 17,
+    CMD18_READ_MULTIPLE_BLOCK = 18,
+    CMD24_WRITE_BLOCK = 24,
+    CMD25_WRITE_MULTIPLE_BLOCK = 25,
+    CMD32_ERASE_WR_BLK_START = 32,
+    CMD33_ERASE_WR_BLK_END = 33,
+    CMD38_ERASE = 38,
+    CMD55_APP_CMD = 55,
+    ACMD6_SET_BUS_WIDTH = 6,
+    ACMD41_SD_SEND_OP_COND = 41,
+} sdio_cmd_t;
+
+#define SD_COMMAND_RETRIES 3      /*!< Times a command is retried when there is no response */
+#define SD_INIT_TIMEOUT 1000      /*!< ACMD41 busy, in ms */
+#define SD_DATA_TIMEOUT 500       /*!< Per block (read access or programming), in ms */
+#define SD_ERASE_TIMEOUT 5000     /*!< For one CMD38, in ms */
+#define SD_ERASE_RUN_AUS 4        /*!< Allocation units per CMD38 */
+#define SD_ERASE_RUN_MIN 8192     /*!< Sectors per CMD38, at least */
+#define CMD8_ARG 0x1AA            /*!< 2.7-3.6 V, check pattern 0xAA */
+#define OCR_BUSY (1u << 31)       /*!< Power up finished */
+#define OCR_HCS_CCS (1u << 30)
+#define OCR_VOLTAGE_WINDOW 0xFF8000 /*!< 2.7-3.6 V */
+#define BUS_WIDTH_4 2
+
+// Card status (R1) error bits
+#define CS_OUT_OF_RANGE (1u << 31)
+#define CS_ADDRESS_ERROR (1u << 30)
+#define CS_BLOCK_LEN_ERROR (1u << 29)
+#define CS_ERASE_SEQ_ERROR (1u << 28)
+#define CS_ERASE_PARAM (1u << 27)
+#define CS_WP_VIOLATION (1u << 26)
+#define CS_COM_CRC_ERROR (1u << 23)
+#define CS_ILLEGAL_COMMAND (1u << 22)
+#define CS_OTHER_ERRORS 0x033F8000 /*!< Lock, ECC, CC, general error, CSD overwrite, WP erase skip */
+
+/* Statistics (SD_CMD_STATS): the same as for cards on SPI, in pSD->stats.
+ * CMD13 isn't used by this driver; its row stays empty. */
+
+// Busy waits seen by sdio.c since the last call, into the card's statistics
+static void sd_sdio_stat_busy(sd_card_t *pSD) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+#if SD_CMD_STATS
+    pSD->stats.busy_waits += sdio_p->busy_waits;
+    pSD->stats.busy_us += sdio_p->busy_us;
+    if (sdio_p->busy_max_us > pSD->stats.busy_max_us)
+        pSD->stats.busy_max_us = sdio_p->busy_max_us;
+#endif
+    sdio_p->busy_waits = 0;
+    sdio_p->busy_us = 0;
+    sdio_p->busy_max_us = 0;
+}
+
+static int sd_sdio_card_status(uint32_t cs) {
+    if (cs & CS_COM_CRC_ERROR) return SD_BLOCK_DEVICE_ERROR_CRC;
+    if (cs & CS_ILLEGAL_COMMAND) return SD_BLOCK_DEVICE_ERROR_UNSUPPORTED;
+    if (cs & (CS_OUT_OF_RANGE | CS_ADDRESS_ERROR | CS_BLOCK_LEN_ERROR))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (cs & CS_WP_VIOLATION) return SD_BLOCK_DEVICE_ERROR_WRITE_PROTECTED;
+    if (cs & (CS_ERASE_SEQ_ERROR | CS_ERASE_PARAM)) return SD_BLOCK_DEVICE_ERROR_ERASE;
+    if (cs & CS_OTHER_ERRORS) return SD_BLOCK_DEVICE_ERROR_WRITE;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// Command with an R1 response, checked for card status errors
+static int sd_sdio_cmd(sd_card_t *pSD, sdio_cmd_t cmd, uint32_t arg, bool isAcmd,
+                       uint32_t *resp) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+    uint32_t cs = 0;
+    int status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    for (int i = 0; i < SD_COMMAND_RETRIES && SD_BLOCK_DEVICE_ERROR_NO_RESPONSE == status; i++) {
+        if (i) SD_COUNT(pSD, retries);
+        if (isAcmd) {
+            status = sdio_command(sdio_p, CMD55_APP_CMD, (uint32_t)sdio_p->rca << 16,
+                                  SDIO_RESP_R1, NULL);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != status) continue;
+        }
+        status = sdio_command(sdio_p, cmd, arg, SDIO_RESP_R1, &cs);
+    }
+    if (resp) *resp = cs;
+    if (SD_BLOCK_DEVICE_ERROR_CRC == status) SD_COUNT(pSD, crc_errors);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        DBG_PRINTF("CMD:%d failed: %d\r\n", cmd, status);
+        return status;
+    }
+    status = sd_sdio_card_status(cs);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status)
+        DBG_PRINTF("CMD:%d card status 0x%08" PRIx32 "\r\n", cmd, cs);
+    return status;
+}
+
+static int sd_sdio_init_medium(sd_card_t *pSD) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+    uint32_t response;
+    int status;
+
+    sdio_set_frequency(sdio_p, 400 * 1000);
+    sdio_p->rca = 0;
+    // CLK has been running since sdio_init(), well over the 74 cycles the card
+    // needs after power up
+    sleep_ms(1);
+    sdio_command(sdio_p, CMD0_GO_IDLE_STATE, 0, SDIO_RESP_NONE, NULL);
+
+    // Version 1.x cards don't answer CMD8
+    status = sdio_command(sdio_p, CMD8_SEND_IF_COND, CMD8_ARG, SDIO_RESP_R1, &response);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        if ((response & 0xFFF) != CMD8_ARG) {
+            DBG_PRINTF("CMD8 pattern mismatch: 0x%" PRIx32 "\r\n", response);
+            pSD->card_type = CARD_UNKNOWN;
+            return SD_BLOCK_DEVICE_ERROR_UNUSABLE;
+        }
+        pSD->card_type = SDCARD_V2;
+    } else if (SD_BLOCK_DEVICE_ERROR_NO_RESPONSE == status) {
+        pSD->card_type = SDCARD_V1;
+    } else {
+        return status;
+    }
+
+    // Repeat ACMD41 until the card has finished powering up
+    uint32_t arg = OCR_VOLTAGE_WINDOW;
+    if (SDCARD_V2 == pSD->card_type) arg |= OCR_HCS_CCS;
+    absolute_time_t timeout_time = make_timeout_time_ms(SD_INIT_TIMEOUT);
+    do {
+        status = sdio_command(sdio_p, CMD55_APP_CMD, 0, SDIO_RESP_R1, NULL);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = sdio_command(sdio_p, ACMD41_SD_SEND_OP_COND, arg, SDIO_RESP_R3,
+                                  &response);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            DBG_PRINTF("No disk, or ACMD41 failed: %d\r\n", status);
+            return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+        }
+    } while (!(response & OCR_BUSY) &&
+             0 < absolute_time_diff_us(get_absolute_time(), timeout_time));
+    if (!(response & OCR_BUSY)) {
+        pSD->card_type = CARD_UNKNOWN;
+        DBG_PRINTF("Timeout waiting for card\r\n");
+        return SD_BLOCK_DEVICE_ERROR_UNUSABLE;
+    }
+    if (SDCARD_V2 == pSD->card_type && (response & OCR_HCS_CCS)) {
+        pSD->card_type = SDCARD_V2HC;
+        DBG_PRINTF("Card Initialized: High Capacity Card\r\n");
+    }
+
+    // Identification: the CID isn't used, but the card won't publish its
+    // relative address (CMD3) before sending it
+    uint8_t cid[16];
+    status = sdio_read_register(sdio_p, CMD2_ALL_SEND_CID, 0, cid);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    status = sdio_command(sdio_p, CMD3_SEND_RELATIVE_ADDR, 0, SDIO_RESP_R1, &response);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    sdio_p->rca = response >> 16;
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// From the standby state to the transfer state, on the 4-bit bus
+static int sd_sdio_select(sd_card_t *pSD) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+    // R1b
+    int err = sd_sdio_cmd(pSD, CMD7_SELECT_CARD, (uint32_t)sdio_p->rca << 16, false, NULL);
+    if (!sdio_wait_not_busy(sdio_p, SD_DATA_TIMEOUT)) err = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    if (SD_BLOCK_DEVICE_ERROR_NONE == err)
+        err = sd_sdio_cmd(pSD, ACMD6_SET_BUS_WIDTH, BUS_WIDTH_4, true, NULL);
+    // Standard capacity cards may have another block length
+    if (SD_BLOCK_DEVICE_ERROR_NONE == err && SDCARD_V2HC != pSD->card_type)
+        err = sd_sdio_cmd(pSD, CMD16_SET_BLOCKLEN, SDIO_BLOCK_SIZE, false, NULL);
+    return err;
+}
+
+static int sd_sdio_init(sd_card_t *pSD) {
+    TRACE_PRINTF("> %s\r\n", __FUNCTION__);
+    sdio_if_t *sdio_p = pSD->sdio_if;
+
+    if (!mutex_is_initialized(&pSD->mutex)) mutex_init(&pSD->mutex);
+    mutex_enter_blocking(&pSD->mutex);
+
+    // Make sure there's a card in the socket before proceeding
+    sd_card_detect(pSD);
+    // Make sure we're not already initialized before proceeding
+    if (pSD->m_Status & STA_NODISK || !(pSD->m_Status & STA_NOINIT)) {
+        mutex_exit(&pSD->mutex);
+        return pSD->m_Status;
+    }
+    // Initialize the member variables
+    pSD->card_type = SDCARD_NONE;
+    pSD->baud_rate = 0;
+    pSD->sectors = 0;
+
+    int err = sd_sdio_init_medium(pSD);
+    uint8_t csd[16];
+    if (SD_BLOCK_DEVICE_ERROR_NONE == err)
+        err = sdio_read_register(sdio_p, CMD9_SEND_CSD, (uint32_t)sdio_p->rca << 16, csd);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == err) {
+        pSD->sectors = sd_csd_sectors(csd);
+        pSD->max_baud_rate = sd_csd_tran_speed(csd);
+        // ACMD13 would need a 64-byte data block; the erase sector size will do
+        pSD->au_sectors = sd_csd_erase_sectors(csd);
+        err = sd_sdio_select(pSD);
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE != err || !pSD->sectors) {
+        DBG_PRINTF("Failed to initialize card\r\n");
+        mutex_exit(&pSD->mutex);
+        return pSD->m_Status;
+    }
+    DBG_PRINTF("SD card initialized\r\n");
+
+    // Default speed: up to the card's TRAN_SPEED and the configured bound
+    uint baud_rate = sdio_p->baud_rate;
+    if (pSD->max_baud_rate && pSD->max_baud_rate < baud_rate) baud_rate = pSD->max_baud_rate;
+    pSD->baud_rate = sdio_set_frequency(sdio_p, baud_rate);
+
+    // The card is now initialized
+    pSD->m_Status &= ~STA_NOINIT;
+
+    mutex_exit(&pSD->mutex);
+    return pSD->m_Status;
+}
+
+static uint32_t sd_sdio_addr(sd_card_t *pSD, uint64_t sector) {
+    // SDSC Card (CCS=0) uses byte unit address
+    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+    return SDCARD_V2HC == pSD->card_type ? sector : sector * SDIO_BLOCK_SIZE;
+}
+
+// CMD12 ends multiple block transfers; R1b. Its card status may report the
+// end of the card as out of range when the last block has been reached.
+static int sd_sdio_stop_transmission(sd_card_t *pSD) {
+    int status = sdio_command(pSD->sdio_if, CMD12_STOP_TRANSMISSION, 0, SDIO_RESP_R1, NULL);
+    if (!sdio_wait_not_busy(pSD->sdio_if, SD_DATA_TIMEOUT) && SD_BLOCK_DEVICE_ERROR_NONE == status)
+        status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+    return status;
+}
+
+/* Error recovery for block transfers: the policy of the SPI driver (see
+ * sd_retry() in sd_card.c). A failed read or write is repeated up to
+ * SD_RECOVERY_RETRIES times; after a CRC error CLK is halved, and after a
+ * timeout, no response or a rejected block the card gets
+ * SD_RECOVERY_BACKOFF_MS << attempt ms and, from the second attempt on, is
+ * reset and initialized again in place at half the clock. */
+
+// Halve CLK, down to the initialization rate
+static void sd_sdio_lower_clock(sd_card_t *pSD) {
+    if (pSD->baud_rate <= 400 * 1000) return;
+    uint target = pSD->baud_rate / 2;
+    if (target < 400 * 1000) target = 400 * 1000;
+    pSD->baud_rate = sdio_set_frequency(pSD->sdio_if, target);
+    DBG_PRINTF("%s: CLK lowered to %u Hz\r\n", __FUNCTION__, pSD->baud_rate);
+}
+
+// Reset and initialize the card again, with it held
+static int sd_sdio_reinit(sd_card_t *pSD) {
+    sd_sdio_lower_clock(pSD);
+    uint baud_rate = pSD->baud_rate;
+    int status = sd_sdio_init_medium(pSD);  // Leaves CLK at the initialization rate
+    if (SD_BLOCK_DEVICE_ERROR_NONE == status) status = sd_sdio_select(pSD);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        DBG_PRINTF("%s: failed: %d\r\n", __FUNCTION__, status);
+        pSD->m_Status |= STA_NOINIT;  // Fail fast until the next disk_initialize
+        return status;
+    }
+    pSD->baud_rate = sdio_set_frequency(pSD->sdio_if, baud_rate);
+    return status;
+}
+
+// After a transfer: true if it failed and should be tried again (*attempt counts them)
+static bool sd_sdio_retry(sd_card_t *pSD, int status, int *attempt) {
+    switch (status) {
+        case SD_BLOCK_DEVICE_ERROR_NONE:
+            if (*attempt) SD_COUNT(pSD, recovered);
+            return false;
+        case SD_BLOCK_DEVICE_ERROR_CRC:
+        case SD_BLOCK_DEVICE_ERROR_NO_RESPONSE:
+        case SD_BLOCK_DEVICE_ERROR_NO_DEVICE:
+        case SD_BLOCK_DEVICE_ERROR_WRITE:
+            break;
+        default:
+            return false;
+    }
+    if (*attempt >= SD_RECOVERY_RETRIES) {
+        DBG_PRINTF("%s: giving up after %d retries: %d\r\n", __FUNCTION__, *attempt, status);
+        SD_COUNT(pSD, unrecovered);
+        return false;
+    }
+    int n = (*attempt)++;
+    SD_COUNT(pSD, op_retries);
+    if (SD_BLOCK_DEVICE_ERROR_CRC == status) {
+        sd_sdio_lower_clock(pSD);
+        return true;
+    }
+    sleep_ms(SD_RECOVERY_BACKOFF_MS << n);
+    if (!n) return true;
+    SD_COUNT(pSD, reinits);
+    return SD_BLOCK_DEVICE_ERROR_NONE == sd_sdio_reinit(pSD);
+}
+
+// One read command for up to SDIO_MAX_BLOCKS blocks into a word aligned buffer
+static int sd_sdio_read_run(sd_card_t *pSD, uint8_t *buffer, uint64_t sector, uint32_t count) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+    sdio_rx_start(sdio_p, buffer, count);
+    int status = sd_sdio_cmd(pSD, count > 1 ? CMD18_READ_MULTIPLE_BLOCK : CMD17_READ_SINGLE_BLOCK,
+                             sd_sdio_addr(pSD, sector), false, NULL);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        sdio_data_stop(sdio_p);
+        return status;
+    }
+    status = sdio_rx_wait(sdio_p, buffer, count, SD_DATA_TIMEOUT);
+    if (SD_BLOCK_DEVICE_ERROR_CRC == status) SD_COUNT(pSD, crc_errors);
+    if (count > 1) {
+        int stop_status = sd_sdio_stop_transmission(pSD);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status) status = stop_status;
+    }
+    return status;
+}
+
+static int in_sd_sdio_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                                  uint32_t ulSectorCount) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK)) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    while (ulSectorCount && SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        uint32_t count;
+        if ((uintptr_t)buffer & 3) {
+            // The DMA moves words: one block at a time through the bounce buffer
+            count = 1;
+            status = sd_sdio_read_run(pSD, (uint8_t *)sdio_p->bounce, ulSectorNumber, 1);
+            memcpy(buffer, sdio_p->bounce, SDIO_BLOCK_SIZE);
+        } else {
+            count = ulSectorCount < SDIO_MAX_BLOCKS ? ulSectorCount : SDIO_MAX_BLOCKS;
+            status = sd_sdio_read_run(pSD, buffer, ulSectorNumber, count);
+        }
+        buffer += count * SDIO_BLOCK_SIZE;
+        ulSectorNumber += count;
+        ulSectorCount -= count;
+    }
+    return status;
+}
+
+static int sd_sdio_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
+                               uint32_t ulSectorCount) {
+    TRACE_PRINTF("%s(0x%p, 0x%llx, %lu)\r\n", __FUNCTION__, buffer, ulSectorNumber,
+                 ulSectorCount);
+    if (ulSectorNumber + ulSectorCount > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    mutex_enter_blocking(&pSD->mutex);
+    uint32_t start = time_us_32();
+    int status, attempt = 0;
+    do {
+        status = in_sd_sdio_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    } while (sd_sdio_retry(pSD, status, &attempt));
+    sd_stat_op(pSD, ulSectorCount > 1 ? SD_STAT_CMD18 : SD_STAT_CMD17, start, status,
+               ulSectorCount * SDIO_BLOCK_SIZE);
+    sd_sdio_stat_busy(pSD);
+    mutex_exit(&pSD->mutex);
+    return status;
+}
+
+// One write command for count blocks from a word aligned buffer
+static int sd_sdio_write_run(sd_card_t *pSD, const uint8_t *buffer, uint64_t sector,
+                             uint32_t count) {
+    int status = sd_sdio_cmd(pSD, count > 1 ? CMD25_WRITE_MULTIPLE_BLOCK : CMD24_WRITE_BLOCK,
+                             sd_sdio_addr(pSD, sector), false, NULL);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    status = sdio_write_blocks(pSD->sdio_if, buffer, count, SD_DATA_TIMEOUT);
+    if (SD_BLOCK_DEVICE_ERROR_CRC == status) SD_COUNT(pSD, crc_errors);
+    if (count > 1) {
+        int stop_status = sd_sdio_stop_transmission(pSD);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status) status = stop_status;
+    }
+    return status;
+}
+
+static int in_sd_sdio_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
+                                   uint64_t ulSectorNumber, uint32_t blockCnt) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK)) return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    int status;
+    if ((uintptr_t)buffer & 3) {
+        // The DMA moves words: one block at a time through the bounce buffer
+        status = SD_BLOCK_DEVICE_ERROR_NONE;
+        for (uint32_t i = 0; i < blockCnt && SD_BLOCK_DEVICE_ERROR_NONE == status; ++i) {
+            memcpy(sdio_p->bounce, buffer + i * SDIO_BLOCK_SIZE, SDIO_BLOCK_SIZE);
+            status = sd_sdio_write_run(pSD, (const uint8_t *)sdio_p->bounce, ulSectorNumber + i, 1);
+        }
+    } else {
+        status = sd_sdio_write_run(pSD, buffer, ulSectorNumber, blockCnt);
+    }
+    return status;
+}
+
+static int sd_sdio_write_blocks(sd_card_t *pSD, const uint8_t *buffer, uint64_t ulSectorNumber,
+                                uint32_t blockCnt) {
+    TRACE_PRINTF("%s(0x%p, 0x%llx, %lu)\r\n", __FUNCTION__, buffer, ulSectorNumber, blockCnt);
+    if (ulSectorNumber + blockCnt > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    mutex_enter_blocking(&pSD->mutex);
+    uint32_t start = time_us_32();
+    int status, attempt = 0;
+    do {
+        status = in_sd_sdio_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    } while (sd_sdio_retry(pSD, status, &attempt));
+    sd_stat_op(pSD, blockCnt > 1 ? SD_STAT_CMD25 : SD_STAT_CMD24, start, status,
+               blockCnt * SDIO_BLOCK_SIZE);
+    sd_sdio_stat_busy(pSD);
+    mutex_exit(&pSD->mutex);
+    return status;
+}
+
+// CMD32/CMD33 select the first and last block, CMD38 (R1b) erases them
+static int sd_sdio_trim_blocks(sd_card_t *pSD, uint64_t ulSectorNumber, uint64_t ulSectorCount) {
+    TRACE_PRINTF("%s(0x%llx, 0x%llx)\r\n", __FUNCTION__, ulSectorNumber, ulSectorCount);
+    if (ulSectorNumber + ulSectorCount > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    mutex_enter_blocking(&pSD->mutex);
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK)) {
+        mutex_exit(&pSD->mutex);
+        return SD_BLOCK_DEVICE_ERROR_NO_INIT;
+    }
+    uint32_t start = time_us_32();
+    uint64_t run = (uint64_t)SD_ERASE_RUN_AUS * pSD->au_sectors;
+    if (run < SD_ERASE_RUN_MIN) run = SD_ERASE_RUN_MIN;
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    while (ulSectorCount && SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        uint64_t n = ulSectorCount < run ? ulSectorCount : run;
+        status = sd_sdio_cmd(pSD, CMD32_ERASE_WR_BLK_START, sd_sdio_addr(pSD, ulSectorNumber),
+                             false, NULL);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = sd_sdio_cmd(pSD, CMD33_ERASE_WR_BLK_END,
+                                 sd_sdio_addr(pSD, ulSectorNumber + n - 1), false, NULL);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status)
+            status = sd_sdio_cmd(pSD, CMD38_ERASE, 0, false, NULL);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status &&
+            !sdio_wait_not_busy(pSD->sdio_if, SD_ERASE_TIMEOUT))
+            status = SD_BLOCK_DEVICE_ERROR_ERASE;
+        ulSectorNumber += n;
+        ulSectorCount -= n;
+    }
+    sd_stat_op(pSD, SD_STAT_CMD38, start, status, 0);
+    sd_sdio_stat_busy(pSD);
+    mutex_exit(&pSD->mutex);
+    return status;
+}
+
+static bool sd_sdio_test_com(sd_card_t *pSD) {
+    sdio_if_t *sdio_p = pSD->sdio_if;
+    // This is allowed to be called before initialization, so ensure mutex is created
+    if (!mutex_is_initialized(&pSD->mutex)) mutex_init(&pSD->mutex);
+    mutex_enter_blocking(&pSD->mutex);
+
+    bool success;
+    if (!(pSD->m_Status & STA_NOINIT)) {
+        // SD card is currently initialized
+        success = SD_BLOCK_DEVICE_ERROR_NONE ==
+                  sdio_command(sdio_p, CMD13_SEND_STATUS, (uint32_t)sdio_p->rca << 16,
+                               SDIO_RESP_R1, NULL);
+        if (!success) {
+            // Card no longer sensed - ensure card is initialized once re-attached
+            pSD->m_Status |= STA_NOINIT;
+        }
+    } else {
+        // Do a "light" version of init, just enough to test com: any card in
+        // the idle state answers CMD55
+        sdio_set_frequency(sdio_p, 400 * 1000);
+        sdio_p->rca = 0;
+        sdio_command(sdio_p, CMD0_GO_IDLE_STATE, 0, SDIO_RESP_NONE, NULL);
+        success = SD_BLOCK_DEVICE_ERROR_NONE ==
+                  sdio_command(sdio_p, CMD55_APP_CMD, 0, SDIO_RESP_R1, NULL);
+    }
+    mutex_exit(&pSD->mutex);
+    return success;
+}
+
+void sd_sdio_ctor(sd_card_t *pSD) {
+    pSD->init = sd_sdio_init;
+    pSD->write_blocks = sd_sdio_write_blocks;
+    pSD->read_blocks = sd_sdio_read_blocks;
+    pSD->trim_blocks = sd_sdio_trim_blocks;
+    pSD->write_blocks_async = NULL;
+    pSD->read_blocks_async = NULL;
+    pSD->sd_test_com = sd_sdio_test_com;
+}
+
+/* [] END OF FILE */
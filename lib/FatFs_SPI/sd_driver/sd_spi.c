@@ -30,13 +30,19 @@ specific language governing permissions and limitations under the License.
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-variable"
 
-void sd_spi_go_high_frequency(sd_card_t *pSD) {
-    uint actual = spi_set_baudrate(pSD->spi->hw_inst, pSD->spi->baud_rate);
+// Returns the actual frequency, which is the closest achievable not above baud_rate
+uint sd_spi_set_frequency(sd_card_t *pSD, uint baud_rate) {
+    uint actual = my_spi_set_baudrate(pSD->spi, baud_rate);
+    pSD->spi->current_baud_rate = actual;
     TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    return actual;
+}
+// Uses the rate negotiated for this card, or the SPI's configured rate if none yet
+void sd_spi_go_high_frequency(sd_card_t *pSD) {
+    sd_spi_set_frequency(pSD, pSD->baud_rate ? pSD->baud_rate : pSD->spi->baud_rate);
 }
 void sd_spi_go_low_frequency(sd_card_t *pSD) {
-    uint actual = spi_set_baudrate(pSD->spi->hw_inst, 400 * 1000); // Actual frequency: 398089
-    TRACE_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__, (long)actual);
+    sd_spi_set_frequency(pSD, 400 * 1000); // Actual frequency: 398089
 }
 
 #pragma GCC diagnostic pop
@@ -53,7 +59,7 @@ static void sd_spi_select(sd_card_t *pSD) {
     gpio_put(pSD->ss_gpio, 0);
     // A fill byte seems to be necessary, sometimes:
     uint8_t fill = SPI_FILL_CHAR;
-    spi_write_blocking(pSD->spi->hw_inst, &fill, 1);
+    spi_transfer_polled(pSD->spi, &fill, NULL, 1);
     LED_ON();
 }
 
@@ -68,7 +74,7 @@ static void sd_spi_deselect(sd_card_t *pSD) {
     deasserted.
     */
     uint8_t fill = SPI_FILL_CHAR;
-    spi_write_blocking(pSD->spi->hw_inst, &fill, 1);
+    spi_transfer_polled(pSD->spi, &fill, NULL, 1);
 }
 /* Some SD cards want to be deselected between every bus transaction */
 void sd_spi_deselect_pulse(sd_card_t *pSD) {
@@ -76,9 +82,21 @@ void sd_spi_deselect_pulse(sd_card_t *pSD) {
     // tCSH Pulse duration, CS high 200 ns
     sd_spi_select(pSD);
 }
+// The bus is ours: set it up for this card
+static void sd_spi_take(sd_card_t *pSD) {
+    // Cards sharing this SPI may have negotiated different clocks. One without
+    // a rate is being initialized, which must stay at the slow clock even if
+    // another card had the SPI while it was busy.
+    if (!pSD->baud_rate) {
+        if (pSD->spi->current_baud_rate > 400 * 1000) sd_spi_go_low_frequency(pSD);
+    } else if (pSD->baud_rate != pSD->spi->current_baud_rate) {
+        sd_spi_set_frequency(pSD, pSD->baud_rate);
+    }
+    sd_spi_select(pSD);
+}
 void sd_spi_acquire(sd_card_t *pSD) {
     sd_spi_lock(pSD);
-    sd_spi_select(pSD);
+    sd_spi_take(pSD);
 }
 
 void sd_spi_release(sd_card_t *pSD) {
@@ -86,24 +104,64 @@ void sd_spi_release(sd_card_t *pSD) {
     sd_spi_unlock(pSD);
 }
 
+/* Sharing the bus while the card is busy (programming, erasing): a deselected
+ * card goes on working and shows busy again when selected, so the SPI can
+ * serve the other cards on it meanwhile. */
+
+// Thread context: let the cards queued for the SPI have it, and wait for it back
+void sd_spi_yield(sd_card_t *pSD) {
+    if (!spi_has_waiters(pSD->spi)) return;
+    sd_spi_release(pSD);
+    sd_spi_acquire(pSD);
+}
+// Interrupt context: give the SPI up and queue for it again, in *ticket.
+// false (and the bus is kept) if nobody is waiting for it.
+bool sd_spi_park(sd_card_t *pSD, uint16_t *ticket) {
+    if (!spi_has_waiters(pSD->spi)) return false;
+    sd_spi_release(pSD);
+    *ticket = spi_take_ticket(pSD->spi);
+    return true;
+}
+// After sd_spi_park(): true once the bus is this card's again
+bool sd_spi_resume(sd_card_t *pSD, uint16_t ticket) {
+    if (!spi_is_turn(pSD->spi, ticket)) return false;
+    sd_spi_take(pSD);
+    return true;
+}
+
 bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx,
                      size_t length) {
     return spi_transfer(pSD->spi, tx, rx, length);
 }
 
+bool sd_spi_transfer_crc16(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length,
+                          uint16_t *crc) {
+    return spi_transfer_crc16(pSD->spi, tx, rx, length, crc);
+}
+
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value) {
     // TRACE_PRINTF("%s\n", __FUNCTION__);
     uint8_t received = SPI_FILL_CHAR;
-#if 0
-    int num = spi_write_read_blocking(pSD->spi->hw_inst, &value, &received, 1);
-    myASSERT(1 == num);
-#else
-    bool success = spi_transfer(pSD->spi, &value, &received, 1);
-    myASSERT(success);
-#endif
+    // A DMA setup and IRQ round trip would cost many times the byte itself
+    bool ok = spi_transfer_polled(pSD->spi, &value, &received, 1);
+    myASSERT(ok);
     return received;
 }
 
+void sd_spi_write_gather_start(sd_card_t *pSD, const spi_segment_t *segments, size_t total,
+                               bool sniff, uint16_t seed) {
+    spi_write_gather_start(pSD->spi, segments, total, sniff, seed);
+}
+
+bool sd_spi_transfer_wait(sd_card_t *pSD) {
+    return spi_transfer_wait(pSD->spi);
+}
+
+void sd_spi_transfer_async(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length,
+                           spi_async_done_t done, void *context, bool sniff) {
+    spi_transfer_async(pSD->spi, tx, rx, length, done, context, sniff);
+}
+
 void sd_spi_send_initializing_sequence(sd_card_t * pSD) {
     bool old_ss = gpio_get(pSD->ss_gpio);
     // Set DI and CS high and apply 74 or more clock pulses to SCLK:
@@ -21,12 +21,25 @@ specific language governing permissions and limitations under the License.
 /* Transfer tx to SPI while receiving SPI to rx. 
 tx or rx can be NULL if not important. */
 bool sd_spi_transfer(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length);
+bool sd_spi_transfer_crc16(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length,
+                          uint16_t *crc);
+/* Single byte exchange by polling the FIFO (no DMA, no semaphore): cheap,
+and usable from interrupt context */
 uint8_t sd_spi_write(sd_card_t *pSD, const uint8_t value);
+void sd_spi_write_gather_start(sd_card_t *pSD, const spi_segment_t *segments, size_t total,
+                               bool sniff, uint16_t seed);
+bool sd_spi_transfer_wait(sd_card_t *pSD);
+void sd_spi_transfer_async(sd_card_t *pSD, const uint8_t *tx, uint8_t *rx, size_t length,
+                           spi_async_done_t done, void *context, bool sniff);
 void sd_spi_deselect_pulse(sd_card_t *pSD);
 void sd_spi_acquire(sd_card_t *pSD);
 void sd_spi_release(sd_card_t *pSD);
+void sd_spi_yield(sd_card_t *pSD);
+bool sd_spi_park(sd_card_t *pSD, uint16_t *ticket);
+bool sd_spi_resume(sd_card_t *pSD, uint16_t ticket);
 void sd_spi_go_low_frequency(sd_card_t *this);
 void sd_spi_go_high_frequency(sd_card_t *this);
+uint sd_spi_set_frequency(sd_card_t *pSD, uint baud_rate);
 
 /* 
 After power up, the host starts the clock and sends the initializing sequence on the CMD line. 
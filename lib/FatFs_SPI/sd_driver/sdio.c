@@ -0,0 +1,452 @@
+/* sdio.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* 4-bit SD bus on PIO state machines (programs in sdio.pio).
+ * Commands go through the command/clock state machine, one command at a time.
+ * Data blocks are moved between the data state machine's FIFOs and memory by
+ * a DMA channel, reloaded by a control channel from a list that splits each
+ * block into its data (straight to or from the caller's buffer) and its CRC.
+ * The data CRC is per line, so the DMA sniffer can't compute it; it is
+ * computed for all four lines at once, 32 bits at a time, while the DMA moves
+ * the neighbouring block. */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+//
+#include "hardware/clocks.h"
+#include "pico/stdlib.h"
+//
+#include "crc.h"
+#include "my_debug.h"
+#include "sd_card.h"
+#include "sdio.h"
+#include "sdio.pio.h"
+
+#define TRACE_PRINTF(fmt, args...)
+//#define TRACE_PRINTF printf  // task_printf
+
+#define SDIO_BLOCK_WORDS (SDIO_BLOCK_SIZE / 4)
+#define SDIO_RX_NIBBLES (2 * SDIO_BLOCK_SIZE + 16)    /*!< Data and CRC */
+#define SDIO_TX_NIBBLES (8 + 2 * SDIO_BLOCK_SIZE + 16 + 1) /*!< Idle and start bit, data, CRC, end bit */
+#define SDIO_CMD_TIMEOUT_US 5000 /*!< NCR is 64 clocks; this allows for slow 400 kHz starts */
+#define SDIO_CLK_GPIO(sdio_p) (((sdio_p)->D0_gpio + 30) % 32) /*!< See SDIO_CLK in sdio.pio */
+
+// Words sent around each block, in bus order (the DMA swaps bytes)
+static const uint8_t sdio_tx_start_bit[4] = {0xFF, 0xFF, 0xFF, 0xF0};
+static const uint8_t sdio_tx_end_bit[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+
+// Time for n CLK cycles, rounded up
+static uint32_t sdio_clocks_us(sdio_if_t *sdio_p, uint32_t n) {
+    return (n * 1000000 + sdio_p->current_baud_rate - 1) / sdio_p->current_baud_rate;
+}
+
+static uint64_t get_be64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = v << 8 | p[i];
+    return v;
+}
+static void put_be64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; --i, v >>= 8) p[i] = v;
+}
+
+/* CRC16-CCITT of each data line, computed for all four at once. The lines
+ * interleave nibble by nibble, which turns x^16 + x^12 + x^5 + 1 into
+ * x^64 + x^48 + x^20 + 1 over the byte stream; the 64-bit result, sent MSB
+ * first after the data, carries each line's CRC on that line.
+ * length must be a multiple of 4. */
+uint64_t sdio_crc16_4bit(const uint8_t *data, size_t length) {
+    uint64_t crc = 0;
+    for (size_t i = 0; i < length; i += 4) {
+        uint32_t d = (uint32_t)data[i] << 24 | (uint32_t)data[i + 1] << 16 |
+                     (uint32_t)data[i + 2] << 8 | data[i + 3];
+        // crc * x^32 + d * x^64 (mod G), with x^64 = x^48 + x^20 + 1 (mod G)
+        uint32_t t = (uint32_t)(crc >> 32) ^ d;
+        uint32_t h = t >> 16;  // Part of t * x^48 at x^64 and above
+        crc = (crc << 32) ^ ((uint64_t)t << 48) ^ ((uint64_t)t << 20) ^ t ^
+              ((uint64_t)h << 48) ^ ((uint64_t)h << 20) ^ h;
+    }
+    return crc;
+}
+
+// Returns the actual frequency, which is the closest achievable not above baud_rate
+uint sdio_set_frequency(sdio_if_t *sdio_p, uint baud_rate) {
+    // Each half period of CLK is one state machine cycle
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    uint32_t div = (sys_hz + 2 * baud_rate - 1) / (2 * baud_rate);
+    // The data state machines need a few cycles per edge to follow CLK
+    if (div < 3) div = 3;
+    if (div > 0xFFFF) div = 0xFFFF;
+    pio_sm_set_clkdiv_int_frac(sdio_p->pio, sdio_p->SM_cmd, div, 0);
+    sdio_p->current_baud_rate = sys_hz / (2 * div);
+    DBG_PRINTF("%s: Actual frequency: %lu\n", __FUNCTION__,
+               (unsigned long)sdio_p->current_baud_rate);
+    return sdio_p->current_baud_rate;
+}
+
+// Abandon a command (no response): back to waiting, with CMD released
+static void sdio_cmd_reset(sdio_if_t *sdio_p) {
+    PIO pio = sdio_p->pio;
+    uint sm = sdio_p->SM_cmd;
+    pio_sm_set_enabled(pio, sm, false);
+    pio_sm_clear_fifos(pio, sm);
+    pio_sm_restart(pio, sm);
+    pio_sm_exec(pio, sm, pio_encode_set(pio_pindirs, 0));
+    pio_sm_exec(pio, sm, pio_encode_jmp(sdio_p->cmd_offset));
+    pio_sm_set_enabled(pio, sm, true);
+}
+
+// Send a command; the response bits following the start bit go to words
+static int sdio_cmd_transfer(sdio_if_t *sdio_p, uint8_t cmd, uint32_t arg,
+                             uint resp_bits, uint32_t *words) {
+    PIO pio = sdio_p->pio;
+    uint sm = sdio_p->SM_cmd;
+    const uint8_t packet[5] = {0x40 | cmd, arg >> 24, arg >> 16, arg >> 8, arg};
+    uint8_t crc = crc7((const char *)packet, sizeof packet);
+
+    assert(pio_sm_is_tx_fifo_empty(pio, sm));
+    pio_sm_put(pio, sm, (47u << 24) | (resp_bits << 16) | packet[0] << 8 | packet[1]);
+    pio_sm_put(pio, sm, arg << 8 | crc << 1 | 1);
+
+    if (!resp_bits) {
+        // 32 bits are left once the second word is taken; then NCC, 8 clocks
+        while (!pio_sm_is_tx_fifo_empty(pio, sm)) tight_loop_contents();
+        busy_wait_us_32(sdio_clocks_us(sdio_p, 32 + 8));
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    absolute_time_t timeout_time = make_timeout_time_us(SDIO_CMD_TIMEOUT_US);
+    for (uint i = 0; i < (resp_bits + 31) / 32; ++i) {
+        while (pio_sm_is_rx_fifo_empty(pio, sm)) {
+            if (0 >= absolute_time_diff_us(get_absolute_time(), timeout_time)) {
+                TRACE_PRINTF("No response CMD:%d\r\n", cmd);
+                sdio_cmd_reset(sdio_p);
+                return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            }
+        }
+        words[i] = pio_sm_get(pio, sm);
+    }
+    busy_wait_us_32(sdio_clocks_us(sdio_p, 8));  // NRC
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// Response bytes, start bit included, from the words received after it
+static void sdio_response_bytes(uint32_t *words, uint bits, uint8_t *bytes) {
+    uint last = (bits - 1) / 32;
+    if (bits % 32) words[last] <<= 32 - bits % 32;  // Left-align the partial word
+    memset(bytes, 0, (bits + 1 + 7) / 8);
+    for (uint k = 0; k < bits; ++k) {
+        if (words[k / 32] >> (31 - k % 32) & 1)
+            bytes[(k + 1) / 8] |= 0x80 >> ((k + 1) % 8);
+    }
+}
+
+// For SDIO_RESP_R1 and SDIO_RESP_R3, resp gets the 32-bit response argument
+// (card status for R1). Card status errors are left to the caller.
+int sdio_command(sdio_if_t *sdio_p, uint8_t cmd, uint32_t arg, sdio_resp_t type,
+                 uint32_t *resp) {
+    assert(SDIO_RESP_R2 != type);  // See sdio_read_register
+    uint32_t words[2];
+    uint8_t r[6];
+    uint bits = SDIO_RESP_NONE == type ? 0 : 47;
+    int status = sdio_cmd_transfer(sdio_p, cmd, arg, bits, words);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status || !bits) return status;
+    sdio_response_bytes(words, bits, r);
+    if (SDIO_RESP_R1 == type) {
+        if ((r[0] & 0x3F) != cmd || crc7((const char *)r, 5) != r[5] >> 1) {
+            DBG_PRINTF("CRC error CMD:%d response 0x%02x%02x%02x%02x%02x%02x\r\n", cmd,
+                       r[0], r[1], r[2], r[3], r[4], r[5]);
+            return SD_BLOCK_DEVICE_ERROR_CRC;
+        }
+    }
+    if (resp) *resp = (uint32_t)r[1] << 24 | (uint32_t)r[2] << 16 | (uint32_t)r[3] << 8 | r[4];
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// Command with an R2 response (CMD2, CMD9, CMD10): the 128-bit CID or CSD,
+// most significant byte first
+int sdio_read_register(sdio_if_t *sdio_p, uint8_t cmd, uint32_t arg, uint8_t reg[16]) {
+    uint32_t words[5];
+    uint8_t r[17];
+    int status = sdio_cmd_transfer(sdio_p, cmd, arg, 135, words);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    sdio_response_bytes(words, 135, r);
+    // The register's own CRC7 is its last byte
+    if (crc7((const char *)r + 1, 15) != r[16] >> 1) {
+        DBG_PRINTF("CRC error CMD:%d\r\n", cmd);
+        return SD_BLOCK_DEVICE_ERROR_CRC;
+    }
+    memcpy(reg, r + 1, 16);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+// Busy is signalled by the card holding D0 low (R1b, block programming)
+bool sdio_wait_not_busy(sdio_if_t *sdio_p, uint32_t timeout_ms) {
+    if (gpio_get(sdio_p->D0_gpio)) return true;
+    uint32_t start = time_us_32();
+    absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+    bool ready = true;
+    while (!gpio_get(sdio_p->D0_gpio)) {
+        if (0 >= absolute_time_diff_us(get_absolute_time(), timeout_time)) {
+            DBG_PRINTF("%s: timed out\r\n", __FUNCTION__);
+            ready = false;
+            break;
+        }
+    }
+    uint32_t elapsed = time_us_32() - start;
+    sdio_p->busy_waits++;
+    sdio_p->busy_us += elapsed;
+    if (elapsed > sdio_p->busy_max_us) sdio_p->busy_max_us = elapsed;
+    return ready;
+}
+
+// Data channel fed by the control channel from a segment list. The control
+// channel writes one 8-byte entry per trigger into the data channel's
+// registers at ctrl_dst, the last of which is a trigger; the data channel
+// chains back to it when done. The zero entry ending the list is a null
+// trigger, which stops the sequence.
+static void sdio_dma_setup(sdio_if_t *sdio_p, bool rx, volatile void *ctrl_dst,
+                           const void *list) {
+    PIO pio = sdio_p->pio_data;
+    uint sm = sdio_p->SM_data;
+
+    dma_channel_config c = dma_channel_get_default_config(sdio_p->data_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, !rx);
+    channel_config_set_write_increment(&c, rx);
+    channel_config_set_dreq(&c, pio_get_dreq(pio, sm, !rx));
+    channel_config_set_bswap(&c, true);  // Bytes in bus order: first byte in bits 31:24
+    channel_config_set_chain_to(&c, sdio_p->ctrl_dma);
+    if (rx)
+        dma_channel_set_read_addr(sdio_p->data_dma, &pio->rxf[sm], false);
+    else
+        dma_channel_set_write_addr(sdio_p->data_dma, &pio->txf[sm], false);
+    dma_channel_set_config(sdio_p->data_dma, &c, false);
+
+    c = dma_channel_get_default_config(sdio_p->ctrl_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, 3);  // 1 << 3 byte boundary on write ptr
+    dma_channel_configure(sdio_p->ctrl_dma, &c, ctrl_dst, list,
+                          2,  // One entry (2 words) per trigger
+                          false);
+}
+
+// Stop the data state machine and DMA, releasing D0-D3
+void sdio_data_stop(sdio_if_t *sdio_p) {
+    pio_sm_set_enabled(sdio_p->pio_data, sdio_p->SM_data, false);
+    dma_channel_abort(sdio_p->ctrl_dma);
+    dma_channel_abort(sdio_p->data_dma);
+    pio_sm_set_pindirs_with_mask(sdio_p->pio_data, sdio_p->SM_data, 0,
+                                 0xFu << sdio_p->D0_gpio);
+}
+
+// Get ready to receive blockCnt blocks into buffer (word aligned). Call before
+// sending the read command: the first block can follow the response closely.
+void sdio_rx_start(sdio_if_t *sdio_p, uint8_t *buffer, uint32_t blockCnt) {
+    PIO pio = sdio_p->pio_data;
+    uint sm = sdio_p->SM_data;
+    assert(blockCnt && blockCnt <= SDIO_MAX_BLOCKS);
+    assert(!((uintptr_t)buffer & 3));
+
+    sdio_rx_segment_t *seg = sdio_p->rx_list;
+    for (uint32_t i = 0; i < blockCnt; ++i) {
+        *seg++ = (sdio_rx_segment_t){buffer + i * SDIO_BLOCK_SIZE, SDIO_BLOCK_WORDS};
+        *seg++ = (sdio_rx_segment_t){sdio_p->rx_crc[i], sizeof sdio_p->rx_crc[i] / 4};
+    }
+    *seg = (sdio_rx_segment_t){NULL, 0};
+    sdio_dma_setup(sdio_p, true, &dma_hw->ch[sdio_p->data_dma].al1_write_addr, sdio_p->rx_list);
+
+    pio_sm_init(pio, sm, sdio_p->rx_offset, &sdio_p->rx_cfg);
+    pio_sm_put(pio, sm, SDIO_RX_NIBBLES - 1);
+    dma_channel_start(sdio_p->ctrl_dma);
+    pio_sm_set_enabled(pio, sm, true);
+}
+
+// Blocks received so far. Block i is entries 2i (data) and 2i + 1 (CRC), so
+// it is complete once the control channel has started reading entry 2i + 2.
+static uint32_t sdio_rx_blocks_done(sdio_if_t *sdio_p) {
+    uint32_t offset = dma_hw->ch[sdio_p->ctrl_dma].read_addr - (uintptr_t)sdio_p->rx_list;
+    return offset ? (offset - 1) / (2 * sizeof(sdio_rx_segment_t)) : 0;
+}
+
+// Wait for the blocks queued by sdio_rx_start(), checking the CRC of each one
+// as soon as it is in, while the following blocks are still arriving.
+// timeout_ms applies to each block.
+int sdio_rx_wait(sdio_if_t *sdio_p, uint8_t *buffer, uint32_t blockCnt, uint32_t timeout_ms) {
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    uint32_t checked = 0;
+    absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+    while (checked < blockCnt && SD_BLOCK_DEVICE_ERROR_NONE == status) {
+        uint32_t done = sdio_rx_blocks_done(sdio_p);
+        if (done == checked) {
+            if (0 >= absolute_time_diff_us(get_absolute_time(), timeout_time)) {
+                DBG_PRINTF("%s: timed out after %lu of %lu blocks\r\n", __FUNCTION__,
+                           (unsigned long)checked, (unsigned long)blockCnt);
+                status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            }
+            continue;
+        }
+        for (; checked < done && checked < blockCnt; ++checked) {
+            const uint8_t *block = buffer + checked * SDIO_BLOCK_SIZE;
+            if (sdio_crc16_4bit(block, SDIO_BLOCK_SIZE) != get_be64(sdio_p->rx_crc[checked])) {
+                DBG_PRINTF("%s: CRC error in block %lu\r\n", __FUNCTION__,
+                           (unsigned long)checked);
+                status = SD_BLOCK_DEVICE_ERROR_CRC;
+                break;
+            }
+        }
+        timeout_time = make_timeout_time_ms(timeout_ms);
+    }
+    sdio_data_stop(sdio_p);
+    return status;
+}
+
+// Send blockCnt blocks from buffer (word aligned) after a write command has
+// been accepted. Each block is one DMA sequence (start bit, data, CRC, end
+// bit); the next block's CRC is computed while it goes out. Returns after the
+// card has finished programming the last block.
+int sdio_write_blocks(sdio_if_t *sdio_p, const uint8_t *buffer, uint32_t blockCnt,
+                      uint32_t timeout_ms) {
+    PIO pio = sdio_p->pio_data;
+    uint sm = sdio_p->SM_data;
+    assert(!((uintptr_t)buffer & 3));
+
+    sdio_dma_setup(sdio_p, false, &dma_hw->ch[sdio_p->data_dma].al3_transfer_count,
+                   sdio_p->tx_list);
+    pio_sm_init(pio, sm, sdio_p->tx_offset, &sdio_p->tx_cfg);
+    pio_sm_put(pio, sm, SDIO_TX_NIBBLES - 2);
+    pio_sm_set_enabled(pio, sm, true);
+
+    int status = SD_BLOCK_DEVICE_ERROR_NONE;
+    uint64_t crc = sdio_crc16_4bit(buffer, SDIO_BLOCK_SIZE);
+    for (uint32_t i = 0; i < blockCnt; ++i) {
+        const uint8_t *block = buffer + i * SDIO_BLOCK_SIZE;
+        put_be64(sdio_p->tx_crc, crc);
+        sdio_tx_segment_t *seg = sdio_p->tx_list;
+        *seg++ = (sdio_tx_segment_t){1, sdio_tx_start_bit};
+        *seg++ = (sdio_tx_segment_t){SDIO_BLOCK_WORDS, block};
+        *seg++ = (sdio_tx_segment_t){sizeof sdio_p->tx_crc / 4, sdio_p->tx_crc};
+        *seg++ = (sdio_tx_segment_t){1, sdio_tx_end_bit};
+        *seg = (sdio_tx_segment_t){0, NULL};
+        dma_channel_set_read_addr(sdio_p->ctrl_dma, sdio_p->tx_list, true);
+
+        if (i + 1 < blockCnt) crc = sdio_crc16_4bit(block + SDIO_BLOCK_SIZE, SDIO_BLOCK_SIZE);
+
+        // CRC status token
+        absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+        while (pio_sm_is_rx_fifo_empty(pio, sm)) {
+            if (0 >= absolute_time_diff_us(get_absolute_time(), timeout_time)) {
+                DBG_PRINTF("%s: no CRC status for block %lu\r\n", __FUNCTION__,
+                           (unsigned long)i);
+                status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+                break;
+            }
+        }
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) break;
+        uint32_t token = pio_sm_get(pio, sm) & 0x7;
+        if (0x2 != token) {
+            DBG_PRINTF("%s: block %lu rejected: 0x%lx\r\n", __FUNCTION__,
+                       (unsigned long)i, (unsigned long)token);
+            status = 0x5 == token ? SD_BLOCK_DEVICE_ERROR_CRC : SD_BLOCK_DEVICE_ERROR_WRITE;
+            break;
+        }
+        // Busy starts after the token's end bit
+        busy_wait_us_32(sdio_clocks_us(sdio_p, 3));
+        if (!sdio_wait_not_busy(sdio_p, timeout_ms)) {
+            status = SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+            break;
+        }
+    }
+    sdio_data_stop(sdio_p);
+    return status;
+}
+
+bool sdio_init(sdio_if_t *sdio_p) {
+    auto_init_mutex(sdio_init_mutex);
+    mutex_enter_blocking(&sdio_init_mutex);
+    if (!sdio_p->initialized) {
+        uint clk_gpio = SDIO_CLK_GPIO(sdio_p);
+
+        // Default:
+        if (!sdio_p->baud_rate)
+            sdio_p->baud_rate = 25 * 1000 * 1000;
+        sdio_p->pio_data = sdio_p->pio == pio0 ? pio1 : pio0;
+        sdio_p->SM_cmd = pio_claim_unused_sm(sdio_p->pio, true);
+        sdio_p->SM_data = pio_claim_unused_sm(sdio_p->pio_data, true);
+        sdio_p->cmd_offset = pio_add_program(sdio_p->pio, &sdio_cmd_clk_program);
+        sdio_p->rx_offset = pio_add_program(sdio_p->pio_data, &sdio_data_rx_program);
+        sdio_p->tx_offset = pio_add_program(sdio_p->pio_data, &sdio_data_tx_program);
+
+        // The card pulls up only D3; CMD and data lines are open between transfers
+        gpio_pull_up(sdio_p->CMD_gpio);
+        pio_gpio_init(sdio_p->pio, clk_gpio);
+        pio_gpio_init(sdio_p->pio, sdio_p->CMD_gpio);
+        for (uint i = 0; i < 4; ++i) {
+            gpio_pull_up(sdio_p->D0_gpio + i);
+            pio_gpio_init(sdio_p->pio_data, sdio_p->D0_gpio + i);
+        }
+        if (sdio_p->set_drive_strength) {
+            gpio_set_drive_strength(clk_gpio, sdio_p->CLK_gpio_drive_strength);
+            gpio_set_drive_strength(sdio_p->CMD_gpio, sdio_p->CMD_gpio_drive_strength);
+            for (uint i = 0; i < 4; ++i)
+                gpio_set_drive_strength(sdio_p->D0_gpio + i, sdio_p->D0_gpio_drive_strength);
+        }
+
+        pio_sm_config c = sdio_cmd_clk_program_get_default_config(sdio_p->cmd_offset);
+        sm_config_set_sideset_pins(&c, clk_gpio);
+        sm_config_set_out_pins(&c, sdio_p->CMD_gpio, 1);
+        sm_config_set_set_pins(&c, sdio_p->CMD_gpio, 1);
+        sm_config_set_in_pins(&c, sdio_p->CMD_gpio);
+        sm_config_set_jmp_pin(&c, sdio_p->CMD_gpio);
+        sm_config_set_out_shift(&c, false, true, 32);  // MSB first, autopull
+        sm_config_set_in_shift(&c, false, true, 32);   // MSB first, autopush
+        sm_config_set_mov_status(&c, STATUS_TX_LESSTHAN, 1);
+        pio_sm_init(sdio_p->pio, sdio_p->SM_cmd, sdio_p->cmd_offset, &c);
+        pio_sm_set_pins_with_mask(sdio_p->pio, sdio_p->SM_cmd, 1u << sdio_p->CMD_gpio,
+                                  (1u << clk_gpio) | (1u << sdio_p->CMD_gpio));
+        pio_sm_set_pindirs_with_mask(sdio_p->pio, sdio_p->SM_cmd, 1u << clk_gpio,
+                                     (1u << clk_gpio) | (1u << sdio_p->CMD_gpio));
+
+        c = sdio_data_rx_program_get_default_config(sdio_p->rx_offset);
+        sm_config_set_in_pins(&c, sdio_p->D0_gpio);
+        sm_config_set_jmp_pin(&c, sdio_p->D0_gpio);
+        sm_config_set_in_shift(&c, false, true, 32);
+        sm_config_set_out_shift(&c, false, false, 32);
+        sdio_p->rx_cfg = c;
+
+        c = sdio_data_tx_program_get_default_config(sdio_p->tx_offset);
+        sm_config_set_in_pins(&c, sdio_p->D0_gpio);
+        sm_config_set_out_pins(&c, sdio_p->D0_gpio, 4);
+        sm_config_set_set_pins(&c, sdio_p->D0_gpio, 4);
+        sm_config_set_jmp_pin(&c, sdio_p->D0_gpio);
+        sm_config_set_out_shift(&c, false, true, 32);
+        sm_config_set_in_shift(&c, false, false, 32);
+        sdio_p->tx_cfg = c;
+
+        // Grab some unused dma channels
+        sdio_p->data_dma = dma_claim_unused_channel(true);
+        sdio_p->ctrl_dma = dma_claim_unused_channel(true);
+
+        // CLK runs from here on, at the identification rate until the card is set up
+        sdio_set_frequency(sdio_p, 400 * 1000);
+        pio_sm_set_enabled(sdio_p->pio, sdio_p->SM_cmd, true);
+
+        sdio_p->initialized = true;
+    }
+    mutex_exit(&sdio_init_mutex);
+    return true;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,118 @@
+/* sdio.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+//
+// Pico includes
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "pico/mutex.h"
+#include "pico/types.h"
+
+#define SDIO_BLOCK_SIZE 512
+
+// Blocks per data transfer list; longer transfers are split by the caller
+#ifndef SDIO_MAX_BLOCKS
+#define SDIO_MAX_BLOCKS 32
+#endif
+
+typedef enum {
+    SDIO_RESP_NONE,
+    SDIO_RESP_R1,  // 48 bits, CRC7 checked (also R6, R7)
+    SDIO_RESP_R2,  // 136 bits: CID or CSD
+    SDIO_RESP_R3,  // 48 bits, no CRC (OCR)
+} sdio_resp_t;
+
+// Entries of the DMA control lists. The layouts match the DMA alias-1
+// registers (WRITE_ADDR, TRANS_COUNT_TRIG) for reception and the alias-3
+// registers (TRANS_COUNT, READ_ADDR_TRIG) for transmission, so a control
+// channel can load them directly. A list ends with a zero entry.
+typedef struct {
+    void *addr;
+    uint32_t count;
+} sdio_rx_segment_t;
+typedef struct {
+    uint32_t count;
+    const void *addr;
+} sdio_tx_segment_t;
+
+// "Class" representing a 4-bit SD bus driven by PIO state machines
+typedef struct {
+    // PIO block for the command/clock state machine. The data state machines
+    // use the other block, since the three programs don't fit in one.
+    PIO pio;
+    uint CMD_gpio;
+    uint D0_gpio;     // D1-D3 on the next three GPIOs; CLK on D0_gpio - 2 (see sdio.pio)
+    uint baud_rate;   // Upper bound for CLK after initialization
+
+    // Drive strength levels for GPIO outputs.
+    // enum gpio_drive_strength { GPIO_DRIVE_STRENGTH_2MA = 0, GPIO_DRIVE_STRENGTH_4MA = 1, GPIO_DRIVE_STRENGTH_8MA = 2,
+    // GPIO_DRIVE_STRENGTH_12MA = 3 }
+    bool set_drive_strength;
+    enum gpio_drive_strength CLK_gpio_drive_strength;
+    enum gpio_drive_strength CMD_gpio_drive_strength;
+    enum gpio_drive_strength D0_gpio_drive_strength;  // Applied to D0-D3
+
+    // State variables:
+    PIO pio_data;
+    uint SM_cmd;
+    uint SM_data;
+    uint cmd_offset;
+    uint rx_offset;
+    uint tx_offset;
+    pio_sm_config rx_cfg;
+    pio_sm_config tx_cfg;
+    uint data_dma;
+    uint ctrl_dma;
+    uint current_baud_rate;
+    uint16_t rca;  // Relative card address, assigned by the card (CMD3)
+    sdio_rx_segment_t rx_list[2 * SDIO_MAX_BLOCKS + 1];  // Data and CRC of each block
+    uint8_t rx_crc[SDIO_MAX_BLOCKS][8];
+    sdio_tx_segment_t tx_list[5];  // Start bit, data, CRC, end bit
+    uint8_t tx_crc[8];
+    uint32_t bounce[SDIO_BLOCK_SIZE / 4];  // For buffers the DMA can't use (not word aligned)
+    // Waits for D0 low (busy), since sd_card_sdio.c last moved them to the card's statistics
+    uint32_t busy_waits;
+    uint32_t busy_us;
+    uint32_t busy_max_us;
+    bool initialized;
+} sdio_if_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool sdio_init(sdio_if_t *sdio_p);
+uint sdio_set_frequency(sdio_if_t *sdio_p, uint baud_rate);
+int sdio_command(sdio_if_t *sdio_p, uint8_t cmd, uint32_t arg, sdio_resp_t type,
+                 uint32_t *resp);
+int sdio_read_register(sdio_if_t *sdio_p, uint8_t cmd, uint32_t arg, uint8_t reg[16]);
+bool sdio_wait_not_busy(sdio_if_t *sdio_p, uint32_t timeout_ms);
+void sdio_rx_start(sdio_if_t *sdio_p, uint8_t *buffer, uint32_t blockCnt);
+int sdio_rx_wait(sdio_if_t *sdio_p, uint8_t *buffer, uint32_t blockCnt, uint32_t timeout_ms);
+int sdio_write_blocks(sdio_if_t *sdio_p, const uint8_t *buffer, uint32_t blockCnt,
+                      uint32_t timeout_ms);
+void sdio_data_stop(sdio_if_t *sdio_p);
+uint64_t sdio_crc16_4bit(const uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -14,19 +14,34 @@ specific language governing permissions and limitations under the License.
 
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 //
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
 #include "pico/sem.h"
 //
+#include "crc.h"
 #include "my_debug.h"
 #include "hw_config.h"
 //
 #include "spi.h"
+#include "pio_spi.pio.h"
 
 static bool irqChannel1 = false;
 static bool irqShared = true;
 
+// The DMA sniffer is a single resource shared by all channels
+static volatile bool sniffer_in_use;
+#define DMA_SNIFF_CRC16_CCITT 0x2  // SNIFF_CTRL.CALC: polynomial 0x1021, MSB first
+
+#if SPI_STATS
+#define SPI_COUNT(spi_p, field, n) ((spi_p)->stats.field += (n))
+#else
+#define SPI_COUNT(spi_p, field, n)
+#endif
+
 static void in_spi_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p) {
     for (size_t i = 0; i < spi_get_num(); ++i) {
         spi_t *spi_p = spi_get_by_num(i);
@@ -35,9 +50,16 @@ static void in_spi_irq_handler(const uint DMA_IRQ_num, io_rw_32 *dma_hw_ints_p)
             if (*dma_hw_ints_p & (1 << spi_p->rx_dma)) {
                 *dma_hw_ints_p = 1 << spi_p->rx_dma;  // Clear it.
                 assert(!dma_channel_is_busy(spi_p->rx_dma));
-                assert(!sem_available(&spi_p->sem));
-                bool ok = sem_release(&spi_p->sem);
-                assert(ok);
+                if (spi_p->async_done) {
+                    // Asynchronous transfer: hand over to its owner
+                    spi_async_done_t done = spi_p->async_done;
+                    spi_p->async_done = NULL;
+                    done(spi_p->async_context);
+                } else {
+                    assert(!sem_available(&spi_p->sem));
+                    bool ok = sem_release(&spi_p->sem);
+                    assert(ok);
+                }
             }
         }
     }
@@ -54,16 +76,35 @@ void set_spi_dma_irq_channel(bool useChannel1, bool shared) {
     irqShared = shared;
 }
 
-// SPI Transfer: Read & Write (simultaneously) on SPI bus
-//   If the data that will be received is not important, pass NULL as rx.
-//   If the data that will be transmitted is not important,
-//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
-//     element.
-bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+// The PIO FIFOs take byte accesses: a byte written is replicated across the
+// word, and the top byte is what is shifted out first; a byte read is the
+// bottom byte, where autopush left what was shifted in.
+static volatile void *spi_tx_fifo(spi_t *spi_p) {
+    if (spi_p->pio) return (io_rw_8 *)&spi_p->pio->txf[spi_p->pio_sm];
+    return &spi_get_hw(spi_p->hw_inst)->dr;
+}
+static volatile void *spi_rx_fifo(spi_t *spi_p) {
+    if (spi_p->pio) return (io_rw_8 *)&spi_p->pio->rxf[spi_p->pio_sm];
+    return &spi_get_hw(spi_p->hw_inst)->dr;
+}
+static uint spi_dreq(spi_t *spi_p, bool is_tx) {
+    if (spi_p->pio) return pio_get_dreq(spi_p->pio, spi_p->pio_sm, is_tx);
+    if (spi_get_index(spi_p->hw_inst))
+        return is_tx ? DREQ_SPI1_TX : DREQ_SPI1_RX;
+    return is_tx ? DREQ_SPI0_TX : DREQ_SPI0_RX;
+}
+
+// Configure both DMA channels and start them.
+//   If sniff, the DMA sniffer follows the channel carrying the data (tx, or
+//   rx if tx is NULL) and accumulates its CRC16, starting from 0.
+static void spi_transfer_start(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length,
+                               bool sniff) {
     // assert(512 == length || 1 == length);
     assert(tx || rx);
     // assert(!(tx && rx));
 
+    uint sniff_channel = tx ? spi_p->tx_dma : spi_p->rx_dma;
+
     // tx write increment is already false
     if (tx) {
         channel_config_set_read_increment(&spi_p->tx_dma_cfg, true);
@@ -83,18 +124,23 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
     }
 
     dma_channel_configure(spi_p->tx_dma, &spi_p->tx_dma_cfg,
-                          &spi_get_hw(spi_p->hw_inst)->dr,  // write address
+                          spi_tx_fifo(spi_p),               // write address
                           tx,                              // read address
                           length,  // element count (each element is of
                                    // size transfer_data_size)
                           false);  // start
     dma_channel_configure(spi_p->rx_dma, &spi_p->rx_dma_cfg,
                           rx,                              // write address
-                          &spi_get_hw(spi_p->hw_inst)->dr,  // read address
+                          spi_rx_fifo(spi_p),               // read address
                           length,  // element count (each element is of
                                    // size transfer_data_size)
                           false);  // start
 
+    if (sniff) {
+        dma_sniffer_enable(sniff_channel, DMA_SNIFF_CRC16_CCITT, true);
+        dma_sniffer_set_data_accumulator(0);
+    }
+
     switch (spi_p->DMA_IRQ_num) {
         case DMA_IRQ_0:
             assert(!dma_channel_get_irq0_status(spi_p->rx_dma));
@@ -106,11 +152,160 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
             assert(false);
     }
     sem_reset(&spi_p->sem, 0);
+    SPI_COUNT(spi_p, dma_transfers, 1);
+    SPI_COUNT(spi_p, bytes, length);
 
     // start them exactly simultaneously to avoid races (in extreme cases
     // the FIFO could overflow)
     dma_start_channel_mask((1u << spi_p->tx_dma) | (1u << spi_p->rx_dma));
+}
+
+static void spi_pio_transfer_polled(spi_t *spi_p, const uint8_t *tx, uint8_t *rx,
+                                    size_t length) {
+    io_rw_8 *txfifo = (io_rw_8 *)&spi_p->pio->txf[spi_p->pio_sm];
+    io_rw_8 *rxfifo = (io_rw_8 *)&spi_p->pio->rxf[spi_p->pio_sm];
+    size_t tx_remain = length, rx_remain = length;
+    // Keep the TX FIFO ahead of the RX FIFO, but never more than its depth
+    while (tx_remain || rx_remain) {
+        if (tx_remain && !pio_sm_is_tx_fifo_full(spi_p->pio, spi_p->pio_sm)) {
+            *txfifo = tx ? *tx++ : SPI_FILL_CHAR;
+            --tx_remain;
+        }
+        if (rx_remain && !pio_sm_is_rx_fifo_empty(spi_p->pio, spi_p->pio_sm)) {
+            uint8_t received = *rxfifo;
+            if (rx) *rx++ = received;
+            --rx_remain;
+        }
+    }
+}
+
+// Short transfers (commands, tokens, CRCs, R1/R3/R7 responses) by polling
+// the FIFO: cheaper than setting up two DMA channels and taking an IRQ.
+bool spi_transfer_polled(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+    SPI_COUNT(spi_p, polled_transfers, 1);
+    SPI_COUNT(spi_p, bytes, length);
+    if (spi_p->pio) {
+        spi_pio_transfer_polled(spi_p, tx, rx, length);
+        return true;
+    }
+    int num;
+    if (tx && rx) {
+        num = spi_write_read_blocking(spi_p->hw_inst, tx, rx, length);
+    } else if (tx) {
+        num = spi_write_blocking(spi_p->hw_inst, tx, length);
+    } else {
+        num = spi_read_blocking(spi_p->hw_inst, SPI_FILL_CHAR, rx, length);
+    }
+    return (size_t)num == length;
+}
+
+// SPI Transfer: Read & Write (simultaneously) on SPI bus
+//   If the data that will be received is not important, pass NULL as rx.
+//   If the data that will be transmitted is not important,
+//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
+//     element.
+//   Transfers up to SPI_POLLED_MAX bytes are done without DMA.
+bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
+    assert(!spi_p->async_done);
+    assert(tx || rx);
+    if (length <= SPI_POLLED_MAX)
+        return spi_transfer_polled(spi_p, tx, rx, length);
+    spi_transfer_start(spi_p, tx, rx, length, false);
+    return spi_transfer_wait(spi_p);
+}
+
+// The DMA sniffer for a transfer, or a sequence of them (sniff argument of
+//   spi_write_gather_start and spi_transfer_async): false if it is taken.
+//   Unclaiming is safe in interrupt context.
+bool spi_sniffer_claim(void) {
+    uint32_t save = hw_claim_lock();
+    bool claimed = !sniffer_in_use;
+    sniffer_in_use = true;
+    hw_claim_unlock(save);
+    return claimed;
+}
+void spi_sniffer_unclaim(void) {
+    dma_sniffer_disable();
+    sniffer_in_use = false;
+}
+// CRC16 of the data of the last sniffed transfer
+uint16_t spi_sniffer_crc16(void) {
+    return dma_sniffer_get_data_accumulator();
+}
+
+// Same as spi_transfer, and also returns in *crc the CRC16 of the data
+//   block (the bytes transmitted, or received if tx is NULL), as used by SD
+//   cards. The DMA sniffer computes it on the fly; only when the sniffer is
+//   taken (by a transfer on another SPI) is it computed in software.
+bool spi_transfer_crc16(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length,
+                        uint16_t *crc) {
+    assert(!spi_p->async_done);
+    assert(tx || rx);
+    if (length > SPI_POLLED_MAX && spi_sniffer_claim()) {
+        spi_transfer_start(spi_p, tx, rx, length, true);
+        bool ok = spi_transfer_wait(spi_p);
+        *crc = spi_sniffer_crc16();
+        spi_sniffer_unclaim();
+        return ok;
+    }
+    bool ok = spi_transfer(spi_p, tx, rx, length);
+    *crc = crc16((const char *)(tx ? tx : rx), length);
+    return ok;
+}
+
+// Gather write: transmit a list of segments back to back, discarding what
+//   is received. The control channel loads each (count, address) pair into
+//   the tx channel's alias-3 registers, triggering it; the tx channel chains
+//   back to the control channel when it finishes, and the {0, NULL}
+//   terminator is a null trigger that ends the sequence. The bus never idles
+//   between segments and the CPU is free until spi_transfer_wait().
+//   total is the sum of the counts; segments must stay valid until then.
+//   If sniff (the caller has claimed the sniffer), it follows the tx channel
+//   across the segments, starting from seed: a seed of b << 8 makes a
+//   leading byte b (a token) drop out of the CRC16.
+void spi_write_gather_start(spi_t *spi_p, const spi_segment_t *segments, size_t total,
+                            bool sniff, uint16_t seed) {
+    assert(!spi_p->async_done);
+    assert(total);
+
+    dma_channel_config c = spi_p->tx_dma_cfg;
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_chain_to(&c, spi_p->ctrl_dma);
+    channel_config_set_sniff_enable(&c, sniff);
+    dma_channel_set_write_addr(spi_p->tx_dma, spi_tx_fifo(spi_p), false);
+    dma_channel_set_config(spi_p->tx_dma, &c, false);
+    if (sniff) {
+        dma_sniffer_enable(spi_p->tx_dma, DMA_SNIFF_CRC16_CCITT, false);
+        dma_sniffer_set_data_accumulator(seed);
+    }
+
+    c = dma_channel_get_default_config(spi_p->ctrl_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, 3);  // 1 << 3 byte boundary on write ptr
+    dma_channel_configure(spi_p->ctrl_dma, &c,
+                          &dma_hw->ch[spi_p->tx_dma].al3_transfer_count,  // write address
+                          segments,                                     // read address
+                          2,  // One segment (2 words) per trigger
+                          false);
+
+    static uint8_t dummy;
+    channel_config_set_write_increment(&spi_p->rx_dma_cfg, false);
+    dma_channel_configure(spi_p->rx_dma, &spi_p->rx_dma_cfg,
+                          &dummy,                           // write address
+                          spi_rx_fifo(spi_p),               // read address
+                          total, false);
+    sem_reset(&spi_p->sem, 0);
+    SPI_COUNT(spi_p, dma_transfers, 1);
+    SPI_COUNT(spi_p, bytes, total);
 
+    // rx waits on its DREQ, so it can go first
+    dma_start_channel_mask((1u << spi_p->rx_dma) | (1u << spi_p->ctrl_dma));
+}
+
+// Wait for the transfer started by spi_write_gather_start() (or spi_transfer)
+bool spi_transfer_wait(spi_t *spi_p) {
     /* Wait until master completes transfer or time out has occured. */
     uint32_t timeOut = 1000; /* Timeout 1 sec */
     bool rc = sem_acquire_timeout_ms(
@@ -131,13 +326,106 @@ bool spi_transfer(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length) {
     return true;
 }
 
+// Same as spi_transfer, but returns as soon as the DMA is started.
+//   done(context) is called from the DMA IRQ when the transfer completes.
+//   The caller must hold the SPI (spi_lock) until then. If sniff (the caller
+//   has claimed the sniffer), spi_sniffer_crc16() gives done() the CRC16 of
+//   the data.
+void spi_transfer_async(spi_t *spi_p, const uint8_t *tx, uint8_t *rx, size_t length,
+                        spi_async_done_t done, void *context, bool sniff) {
+    assert(!spi_p->async_done);
+    spi_p->async_context = context;
+    spi_p->async_done = done;
+    spi_transfer_start(spi_p, tx, rx, length, sniff);
+}
+
+// Returns the actual frequency, which is the closest achievable not above baud_rate
+uint my_spi_set_baudrate(spi_t *spi_p, uint baud_rate) {
+    if (!spi_p->pio) return spi_set_baudrate(spi_p->hw_inst, baud_rate);
+    // spi_cpha0 takes four cycles per bit; integer divider, rounded up
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    uint32_t div = (sys_hz + 4 * baud_rate - 1) / (4 * baud_rate);
+    if (div < 1) div = 1;
+    if (div > 0xFFFF) div = 0xFFFF;
+    pio_sm_set_clkdiv_int_frac(spi_p->pio, spi_p->pio_sm, div, 0);
+    return sys_hz / (4 * div);
+}
+
+static void spi_pio_init(spi_t *spi_p) {
+    spi_p->pio_sm = pio_claim_unused_sm(spi_p->pio, true);
+    spi_p->pio_offset = pio_add_program(spi_p->pio, &spi_cpha0_program);
+
+    pio_sm_config c = spi_cpha0_program_get_default_config(spi_p->pio_offset);
+    sm_config_set_out_pins(&c, spi_p->mosi_gpio, 1);
+    sm_config_set_in_pins(&c, spi_p->miso_gpio);
+    sm_config_set_sideset_pins(&c, spi_p->sck_gpio);
+    // MSB first, a byte at a time
+    sm_config_set_out_shift(&c, false, true, 8);
+    sm_config_set_in_shift(&c, false, true, 8);
+
+    // MOSI high and SCK low while idle
+    pio_sm_set_pins_with_mask(spi_p->pio, spi_p->pio_sm, 1u << spi_p->mosi_gpio,
+                              (1u << spi_p->mosi_gpio) | (1u << spi_p->sck_gpio));
+    pio_sm_set_pindirs_with_mask(spi_p->pio, spi_p->pio_sm,
+                                 (1u << spi_p->mosi_gpio) | (1u << spi_p->sck_gpio),
+                                 (1u << spi_p->mosi_gpio) | (1u << spi_p->sck_gpio) |
+                                     (1u << spi_p->miso_gpio));
+    pio_gpio_init(spi_p->pio, spi_p->mosi_gpio);
+    pio_gpio_init(spi_p->pio, spi_p->miso_gpio);
+    pio_gpio_init(spi_p->pio, spi_p->sck_gpio);
+
+    pio_sm_init(spi_p->pio, spi_p->pio_sm, spi_p->pio_offset, &c);
+    my_spi_set_baudrate(spi_p, 100 * 1000);
+    pio_sm_set_enabled(spi_p->pio, spi_p->pio_sm, true);
+}
+
+/* Bus scheduler
+ * A shared SPI is granted in arrival order: spi_take_ticket() joins the queue
+ * and the holder of ticket_serving owns the bus. Unlike a mutex this can be
+ * used from interrupt context, by polling spi_is_turn(), which is how an
+ * asynchronous transfer gives the bus up while its card is busy programming
+ * and queues for it again (see sd_spi_park() and sd_spi_yield()): while card A
+ * programs, card B transfers data. */
+uint16_t spi_take_ticket(spi_t *spi_p) {
+    uint32_t save = spin_lock_blocking(spi_p->sched_lock);
+    uint16_t ticket = spi_p->ticket_next++;
+    spin_unlock(spi_p->sched_lock, save);
+    return ticket;
+}
+bool spi_is_turn(spi_t *spi_p, uint16_t ticket) {
+    if (spi_p->ticket_serving != ticket) return false;
+#if SPI_STATS
+    // First time the new holder sees its turn: from here the bus is held
+    if (spi_p->granted_ticket != ticket) {
+        spi_p->granted_ticket = ticket;
+        spi_p->granted_us = time_us_64();
+        spi_p->stats.grants++;
+    }
+#endif
+    return true;
+}
+// Someone is queued behind the current holder
+bool spi_has_waiters(spi_t *spi_p) {
+    return (uint16_t)(spi_p->ticket_next - spi_p->ticket_serving) > 1;
+}
 void spi_lock(spi_t *spi_p) {
-    assert(mutex_is_initialized(&spi_p->mutex));
-    mutex_enter_blocking(&spi_p->mutex);
+    assert(spi_p->sched_lock);
+    uint16_t ticket = spi_take_ticket(spi_p);
+    if (spi_is_turn(spi_p, ticket)) return;
+    SPI_COUNT(spi_p, waits, 1);
+    uint64_t start = time_us_64();
+    // Interrupts keep running: parked transfers of other cards move on meanwhile
+    while (!spi_is_turn(spi_p, ticket)) tight_loop_contents();
+    SPI_COUNT(spi_p, wait_us, time_us_64() - start);
 }
 void spi_unlock(spi_t *spi_p) {
-    assert(mutex_is_initialized(&spi_p->mutex));
-    mutex_exit(&spi_p->mutex);
+    assert(spi_p->sched_lock);
+    SPI_COUNT(spi_p, held_us, time_us_64() - spi_p->granted_us);
+    spi_p->ticket_serving++;  // Only the holder writes it
+}
+void spi_reset_stats(spi_t *spi_p) {
+    memset(&spi_p->stats, 0, sizeof spi_p->stats);
+    spi_p->stats.since_us = spi_p->granted_us = time_us_64();
 }
 
 bool my_spi_init(spi_t *spi_p) {
@@ -147,7 +435,10 @@ bool my_spi_init(spi_t *spi_p) {
         //// The SPI may be shared (using multiple SSs); protect it
         //spi_p->mutex = xSemaphoreCreateRecursiveMutex();
         //xSemaphoreTakeRecursive(spi_p->mutex, portMAX_DELAY);
-        if (!mutex_is_initialized(&spi_p->mutex)) mutex_init(&spi_p->mutex);
+        if (!spi_p->sched_lock)
+            spi_p->sched_lock = spin_lock_init(spin_lock_claim_unused(true));
+        spi_p->granted_ticket = spi_p->ticket_serving - 1;  // Nobody has had the bus yet
+        spi_reset_stats(spi_p);
         spi_lock(spi_p);
 
         // Default:
@@ -157,13 +448,17 @@ bool my_spi_init(spi_t *spi_p) {
         sem_init(&spi_p->sem, 0, 1);
 
         /* Configure component */
-        // Enable SPI at 100 kHz and connect to GPIOs
-        spi_init(spi_p->hw_inst, 100 * 1000);
-        spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+        if (spi_p->pio) {
+            spi_pio_init(spi_p);
+        } else {
+            // Enable SPI at 100 kHz and connect to GPIOs
+            spi_init(spi_p->hw_inst, 100 * 1000);
+            spi_set_format(spi_p->hw_inst, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
 
-        gpio_set_function(spi_p->miso_gpio, GPIO_FUNC_SPI);
-        gpio_set_function(spi_p->mosi_gpio, GPIO_FUNC_SPI);
-        gpio_set_function(spi_p->sck_gpio, GPIO_FUNC_SPI);
+            gpio_set_function(spi_p->miso_gpio, GPIO_FUNC_SPI);
+            gpio_set_function(spi_p->mosi_gpio, GPIO_FUNC_SPI);
+            gpio_set_function(spi_p->sck_gpio, GPIO_FUNC_SPI);
+        }
         // ss_gpio is initialized in sd_init_driver()
 
         // Slew rate limiting levels for GPIO outputs.
@@ -186,6 +481,7 @@ bool my_spi_init(spi_t *spi_p) {
         // Grab some unused dma channels
         spi_p->tx_dma = dma_claim_unused_channel(true);
         spi_p->rx_dma = dma_claim_unused_channel(true);
+        spi_p->ctrl_dma = dma_claim_unused_channel(true);
 
         spi_p->tx_dma_cfg = dma_channel_get_default_config(spi_p->tx_dma);
         spi_p->rx_dma_cfg = dma_channel_get_default_config(spi_p->rx_dma);
@@ -196,18 +492,14 @@ bool my_spi_init(spi_t *spi_p) {
         // transmit FIFO paced by the SPI TX FIFO DREQ The default is for the
         // read address to increment every element (in this case 1 byte -
         // DMA_SIZE_8) and for the write address to remain unchanged.
-        channel_config_set_dreq(&spi_p->tx_dma_cfg, spi_get_index(spi_p->hw_inst)
-                                                       ? DREQ_SPI1_TX
-                                                       : DREQ_SPI0_TX);
+        channel_config_set_dreq(&spi_p->tx_dma_cfg, spi_dreq(spi_p, true));
         channel_config_set_write_increment(&spi_p->tx_dma_cfg, false);
 
         // We set the inbound DMA to transfer from the SPI receive FIFO to a
         // memory buffer paced by the SPI RX FIFO DREQ We coinfigure the read
         // address to remain unchanged for each element, but the write address
         // to increment (so data is written throughout the buffer)
-        channel_config_set_dreq(&spi_p->rx_dma_cfg, spi_get_index(spi_p->hw_inst)
-                                                       ? DREQ_SPI1_RX
-                                                       : DREQ_SPI0_RX);
+        channel_config_set_dreq(&spi_p->rx_dma_cfg, spi_dreq(spi_p, false));
         channel_config_set_read_increment(&spi_p->rx_dma_cfg, false);
 
         /* Theory: we only need an interrupt on rx complete,
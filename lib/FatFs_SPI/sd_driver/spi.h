@@ -20,21 +20,57 @@ specific language governing permissions and limitations under the License.
 #include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
+#include "hardware/pio.h"
 #include "hardware/spi.h"
+#include "hardware/sync.h"
 #include "pico/mutex.h"
 #include "pico/sem.h"
 #include "pico/types.h"
 
 #define SPI_FILL_CHAR (0xFF)
 
+// spi_transfer() polls the FIFO instead of using DMA up to this length
+#ifndef SPI_POLLED_MAX
+#define SPI_POLLED_MAX 32
+#endif
+
+// One piece of a gather write; the layout matches the DMA alias-3 registers
+// (TRANS_COUNT, READ_ADDR_TRIG) so a list of these can drive the DMA directly.
+// A list ends with {0, NULL}.
+typedef struct {
+    uint32_t count;
+    const void *addr;
+} spi_segment_t;
+
+// Bus counters, cumulative since my_spi_init() or spi_reset_stats()
+#ifndef SPI_STATS
+#define SPI_STATS 1
+#endif
+typedef struct {
+    uint64_t bytes;            // Clocked on the bus; a full-duplex byte counts once
+    uint32_t dma_transfers;
+    uint32_t polled_transfers;
+    uint32_t grants;           // Times the bus was handed to a user (spi_lock or a parked transfer)
+    uint32_t waits;            // spi_lock() calls that found the bus taken
+    uint64_t wait_us;          // Time spent in them
+    uint64_t held_us;          // Time the bus was owned: with since_us, the utilization
+    uint64_t since_us;
+} spi_stats_t;
+
+// Completion callback for spi_transfer_async(); runs in the DMA IRQ
+typedef void (*spi_async_done_t)(void *context);
+
 // "Class" representing SPIs
 typedef struct {
     // SPI HW
     spi_inst_t *hw_inst;
+    // Non-NULL: the bus is driven by a state machine of this PIO block
+    // (pio_spi.pio) instead, on any GPIOs; hw_inst is then ignored.
+    PIO pio;
     uint miso_gpio;  // SPI MISO GPIO number (not pin number)
     uint mosi_gpio;
     uint sck_gpio;
-    uint baud_rate;
+    uint baud_rate;   // Upper bound for SCK; each card negotiates its own rate up to this
     uint DMA_IRQ_num; // DMA_IRQ_0 or DMA_IRQ_1
 
     // Drive strength levels for GPIO outputs.
@@ -47,12 +83,24 @@ typedef struct {
     // State variables:
     uint tx_dma;
     uint rx_dma;
+    uint ctrl_dma;  // Reloads tx_dma for gather writes
+    uint pio_sm;
+    uint pio_offset;
     dma_channel_config tx_dma_cfg;
     dma_channel_config rx_dma_cfg;
     irq_handler_t dma_isr; // Ignored: no longer used
     bool initialized;  
+    uint current_baud_rate; // Last rate programmed (cards sharing the SPI may differ)
     semaphore_t sem;
-    mutex_t mutex;    
+    // Bus scheduler: users of a shared SPI get it in arrival order (tickets)
+    spin_lock_t *sched_lock;
+    volatile uint16_t ticket_next;
+    volatile uint16_t ticket_serving;
+    spi_stats_t stats;
+    uint64_t granted_us;       // When the current holder got the bus
+    uint16_t granted_ticket;
+    volatile spi_async_done_t async_done; // Set while an asynchronous transfer is in flight
+    void *async_context;
 } spi_t;
 
 #ifdef __cplusplus
@@ -60,9 +108,25 @@ extern "C" {
 #endif
   
 bool __not_in_flash_func(spi_transfer)(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);  
+bool spi_transfer_crc16(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length,
+                        uint16_t *crc);
+void spi_write_gather_start(spi_t *pSPI, const spi_segment_t *segments, size_t total,
+                            bool sniff, uint16_t seed);
+bool spi_transfer_wait(spi_t *pSPI);
+void spi_transfer_async(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length,
+                        spi_async_done_t done, void *context, bool sniff);
+bool spi_sniffer_claim(void);
+void spi_sniffer_unclaim(void);
+uint16_t spi_sniffer_crc16(void);
+bool spi_transfer_polled(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length);
+uint my_spi_set_baudrate(spi_t *pSPI, uint baud_rate);
 void spi_lock(spi_t *pSPI);
 void spi_unlock(spi_t *pSPI);
+uint16_t spi_take_ticket(spi_t *pSPI);
+bool spi_is_turn(spi_t *pSPI, uint16_t ticket);
+bool spi_has_waiters(spi_t *pSPI);
 bool my_spi_init(spi_t *pSPI);
+void spi_reset_stats(spi_t *pSPI);
 void set_spi_dma_irq_channel(bool useChannel1, bool shared);
 
 #ifdef __cplusplus
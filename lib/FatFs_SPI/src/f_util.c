@@ -12,6 +12,7 @@ CONDITIONS OF ANY KIND, either express or implied. See the License for the
 specific language governing permissions and limitations under the License.
 */
 #include "ff.h"
+#include "diskio.h"
 
 const char *FRESULT_str(FRESULT i) {
     switch (i) {
@@ -103,3 +104,76 @@ FRESULT delete_node (
     if (fr == FR_OK) fr = f_unlink(path);  /* Delete the empty sub-directory */
     return fr;
 }
+
+#if FF_USE_TRIM && !FF_FS_READONLY
+/*
+ * Erase (TRIM) all the free clusters of a volume, in runs of contiguous free
+ * clusters, so that the medium doesn't have to reclaim them while it is
+ * written next. Meant to be run between sessions, with no file open: the
+ * FAT (or the exFAT allocation bitmap) is read from the medium.
+ */
+FRESULT f_trim_free (
+    const TCHAR* path,  /* Logical drive */
+    DWORD* ntrim        /* Number of clusters trimmed */
+)
+{
+    FRESULT fr;
+    FATFS *fs;
+    DWORD nfree, clst, run, val;
+    LBA_t sect, cur = 0, rt[2];
+    BYTE buf[FF_MAX_SS];
+    BYTE *p;
+    int isfree;
+
+    *ntrim = 0;
+    fr = f_getfree(path, &nfree, &fs);  /* Mounts the volume and validates the FAT */
+    if (fr != FR_OK) return fr;
+    if (fs->fs_type == FS_FAT12) return FR_DENIED;  /* Not worth it */
+
+    run = 0;
+    for (clst = 2; clst <= fs->n_fatent && fr == FR_OK; clst++) {
+        isfree = 0;
+        if (clst < fs->n_fatent) {  /* Past the end: closes the last run */
+            switch (fs->fs_type) {
+            case FS_FAT16:
+                sect = fs->fatbase + clst / (FF_MAX_SS / 2);
+                break;
+            case FS_FAT32:
+                sect = fs->fatbase + clst / (FF_MAX_SS / 4);
+                break;
+            default:    /* FS_EXFAT: one bit per cluster */
+                sect = fs->bitbase + (clst - 2) / (FF_MAX_SS * 8);
+                break;
+            }
+            if (sect != cur) {
+                if (disk_read(fs->pdrv, buf, sect, 1) != RES_OK) { fr = FR_DISK_ERR; break; }
+                cur = sect;
+            }
+            switch (fs->fs_type) {
+            case FS_FAT16:
+                p = buf + clst % (FF_MAX_SS / 2) * 2;
+                val = (DWORD)p[1] << 8 | p[0];
+                break;
+            case FS_FAT32:
+                p = buf + clst % (FF_MAX_SS / 4) * 4;
+                val = ((DWORD)p[3] << 24 | (DWORD)p[2] << 16 | (DWORD)p[1] << 8 | p[0]) & 0x0FFFFFFF;
+                break;
+            default:
+                val = buf[(clst - 2) / 8 % FF_MAX_SS] >> ((clst - 2) % 8) & 1;
+                break;
+            }
+            isfree = (val == 0);
+        }
+        if (isfree) {
+            run++;
+        } else if (run) {   /* End of a run of free clusters */
+            rt[0] = fs->database + (LBA_t)(clst - run - 2) * fs->csize;
+            rt[1] = rt[0] + (LBA_t)run * fs->csize - 1;
+            if (disk_ioctl(fs->pdrv, CTRL_TRIM, rt) != RES_OK) fr = FR_DISK_ERR;
+            *ntrim += run;
+            run = 0;
+        }
+    }
+    return fr;
+}
+#endif
@@ -20,11 +20,13 @@ specific language governing permissions and limitations under the License.
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 #include <stdio.h>
+#include <string.h>
 //
 #include "ff.h" /* Obtains integer types */
 //
 #include "diskio.h" /* Declarations of disk functions */
 //
+#include "disk_cache.h"
 #include "hw_config.h"
 #include "my_debug.h"
 #include "sd_card.h"
@@ -32,6 +34,328 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf  // task_printf
 
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+
+static disk_cache_stats_t cache_stats;
+
+void disk_cache_get_stats(disk_cache_stats_t *stats) { *stats = cache_stats; }
+
+void disk_cache_print_stats(void) {
+    uint32_t reads = cache_stats.read_hits + cache_stats.read_misses;
+    uint32_t writes = cache_stats.write_hits + cache_stats.write_misses;
+    printf("Sector cache (%u sectors): reads %lu (%lu%% hits), writes %lu (%lu%% hits), "
+           "written back %lu, syncs %lu\n",
+           (unsigned)DISK_CACHE_SECTORS, (unsigned long)reads,
+           (unsigned long)(reads ? 100ull * cache_stats.read_hits / reads : 0),
+           (unsigned long)writes,
+           (unsigned long)(writes ? 100ull * cache_stats.write_hits / writes : 0),
+           (unsigned long)cache_stats.write_backs, (unsigned long)cache_stats.syncs);
+    printf("Read-ahead (%u sectors): %lu runs, %lu sectors served\n",
+           (unsigned)DISK_READ_AHEAD_SECTORS, (unsigned long)cache_stats.read_ahead_runs,
+           (unsigned long)cache_stats.read_ahead_hits);
+}
+
+static void ra_invalidate(BYTE pdrv, LBA_t sector, LBA_t count);
+
+#if DISK_CACHE_SECTORS
+
+typedef struct {
+    LBA_t sector;
+    uint32_t last_use;  // For LRU replacement
+    BYTE pdrv;
+    bool valid;
+    bool dirty;
+} cache_entry_t;
+
+static cache_entry_t cache[DISK_CACHE_SECTORS];
+// Word aligned, so the drivers' DMA can use it directly
+static uint32_t cache_data[DISK_CACHE_SECTORS][FF_MAX_SS / 4];
+static uint32_t cache_clock;
+
+static cache_entry_t *cache_find(BYTE pdrv, LBA_t sector) {
+    for (size_t i = 0; i < DISK_CACHE_SECTORS; ++i)
+        if (cache[i].valid && cache[i].pdrv == pdrv && cache[i].sector == sector)
+            return &cache[i];
+    return NULL;
+}
+
+static bool cache_contains(BYTE pdrv, LBA_t sector) { return cache_find(pdrv, sector); }
+
+static BYTE *cache_buf(const cache_entry_t *e) { return (BYTE *)cache_data[e - cache]; }
+
+static void cache_touch(cache_entry_t *e) { e->last_use = ++cache_clock; }
+
+static int cache_write_back(sd_card_t *p_sd, cache_entry_t *e) {
+    // A run read ahead while the sector was dirty holds the old contents,
+    // and once the sector is clean cache_overlay() no longer covers it
+    ra_invalidate(e->pdrv, e->sector, 1);
+    int rc = p_sd->write_blocks(p_sd, cache_buf(e), e->sector, 1);
+    if (SD_BLOCK_DEVICE_ERROR_NONE == rc) {
+        e->dirty = false;
+        ++cache_stats.write_backs;
+    }
+    return rc;
+}
+
+// A free entry, or else the least recently used one, written back first if
+// dirty. NULL if that write back fails.
+static cache_entry_t *cache_alloc(void) {
+    cache_entry_t *victim = &cache[0];
+    for (size_t i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        if (!cache[i].valid) return &cache[i];
+        if (cache[i].last_use < victim->last_use) victim = &cache[i];
+    }
+    if (victim->dirty) {
+        sd_card_t *p_sd = sd_get_by_num(victim->pdrv);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != cache_write_back(p_sd, victim)) return NULL;
+    }
+    victim->valid = false;
+    return victim;
+}
+
+/* Write all dirty sectors of the drive, in ascending order, so that repeated
+ * updates of a sector have become one write and the card sees a forward
+ * sweep instead of FatFs' order. */
+static int cache_sync(BYTE pdrv) {
+    sd_card_t *p_sd = sd_get_by_num(pdrv);
+    ++cache_stats.syncs;
+    for (;;) {
+        cache_entry_t *next = NULL;
+        for (size_t i = 0; i < DISK_CACHE_SECTORS; ++i) {
+            cache_entry_t *e = &cache[i];
+            if (e->valid && e->dirty && e->pdrv == pdrv && (!next || e->sector < next->sector))
+                next = e;
+        }
+        if (!next) return SD_BLOCK_DEVICE_ERROR_NONE;
+        int rc = cache_write_back(p_sd, next);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    }
+}
+
+// Forget the drive's sectors: the medium may have been changed
+static void cache_invalidate(BYTE pdrv) {
+    for (size_t i = 0; i < DISK_CACHE_SECTORS; ++i)
+        if (cache[i].pdrv == pdrv) cache[i].valid = false;
+}
+
+// The sectors have been trimmed: drop them, even if dirty
+static void cache_discard(BYTE pdrv, LBA_t sector, LBA_t count) {
+    for (size_t i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        cache_entry_t *e = &cache[i];
+        if (e->valid && e->pdrv == pdrv && e->sector >= sector && e->sector < sector + count)
+            e->valid = false;
+    }
+}
+
+// Data read from the card is stale where the cache holds dirty sectors
+static void cache_overlay(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    for (size_t i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        cache_entry_t *e = &cache[i];
+        if (e->valid && e->dirty && e->pdrv == pdrv && e->sector >= sector &&
+            e->sector < sector + count)
+            memcpy(buff + (e->sector - sector) * FF_MAX_SS, cache_buf(e), FF_MAX_SS);
+    }
+}
+
+static int cache_read(sd_card_t *p_sd, BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    if (1 == count) {
+        cache_entry_t *e = cache_find(pdrv, sector);
+        if (e) {
+            ++cache_stats.read_hits;
+        } else {
+            ++cache_stats.read_misses;
+            e = cache_alloc();
+            if (!e) return p_sd->read_blocks(p_sd, buff, sector, 1);
+            int rc = p_sd->read_blocks(p_sd, cache_buf(e), sector, 1);
+            if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+            e->pdrv = pdrv;
+            e->sector = sector;
+            e->dirty = false;
+            e->valid = true;
+        }
+        cache_touch(e);
+        memcpy(buff, cache_buf(e), FF_MAX_SS);
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    // Bulk data: straight from the card, then overlay what is cached
+    int rc = p_sd->read_blocks(p_sd, buff, sector, count);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    cache_overlay(pdrv, buff, sector, count);
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+static int cache_write(sd_card_t *p_sd, BYTE pdrv, const BYTE *buff, LBA_t sector,
+                       UINT count) {
+    if (1 == count) {
+        cache_entry_t *e = cache_find(pdrv, sector);
+        if (e) {
+            ++cache_stats.write_hits;
+        } else {
+            ++cache_stats.write_misses;
+            e = cache_alloc();
+            if (!e) return p_sd->write_blocks(p_sd, buff, sector, 1);
+            e->pdrv = pdrv;
+            e->sector = sector;
+            e->valid = true;
+        }
+        cache_touch(e);
+        memcpy(cache_buf(e), buff, FF_MAX_SS);
+        e->dirty = true;
+        return SD_BLOCK_DEVICE_ERROR_NONE;
+    }
+    // Bulk data: straight to the card; cached copies take the new contents
+    int rc = p_sd->write_blocks(p_sd, buff, sector, count);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return rc;
+    for (size_t i = 0; i < DISK_CACHE_SECTORS; ++i) {
+        cache_entry_t *e = &cache[i];
+        if (e->valid && e->pdrv == pdrv && e->sector >= sector && e->sector < sector + count) {
+            memcpy(cache_buf(e), buff + (e->sector - sector) * FF_MAX_SS, FF_MAX_SS);
+            e->dirty = false;
+        }
+    }
+    return SD_BLOCK_DEVICE_ERROR_NONE;
+}
+
+#else
+
+static int cache_sync(BYTE pdrv) { return SD_BLOCK_DEVICE_ERROR_NONE; }
+static void cache_invalidate(BYTE pdrv) {}
+static void cache_discard(BYTE pdrv, LBA_t sector, LBA_t count) {}
+static bool cache_contains(BYTE pdrv, LBA_t sector) { return false; }
+static void cache_overlay(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {}
+static int cache_read(sd_card_t *p_sd, BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    return p_sd->read_blocks(p_sd, buff, sector, count);
+}
+static int cache_write(sd_card_t *p_sd, BYTE pdrv, const BYTE *buff, LBA_t sector,
+                       UINT count) {
+    return p_sd->write_blocks(p_sd, buff, sector, count);
+}
+
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* Read-ahead                                                            */
+/*-----------------------------------------------------------------------*/
+
+#if DISK_READ_AHEAD_SECTORS
+
+typedef struct {
+    LBA_t sector;
+    UINT count;    // 0: empty
+    BYTE pdrv;
+    bool pending;  // Asynchronous read in flight
+    uint32_t data[DISK_READ_AHEAD_SECTORS][FF_MAX_SS / 4];  // Word aligned for the DMA
+} ra_buf_t;
+
+static ra_buf_t ra_bufs[2];
+// Sequential access detection: where the next read should start
+static BYTE ra_pdrv;
+static LBA_t ra_next;
+
+static void ra_wait(ra_buf_t *b) {
+    if (!b->pending) return;
+    int rc = sd_async_wait(sd_get_by_num(b->pdrv));
+    b->pending = false;
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) b->count = 0;
+}
+
+// The buffer holding the sector, waiting for it to arrive if needed
+static ra_buf_t *ra_find(BYTE pdrv, LBA_t sector) {
+    for (size_t i = 0; i < count_of(ra_bufs); ++i) {
+        ra_buf_t *b = &ra_bufs[i];
+        if (b->count && b->pdrv == pdrv && sector >= b->sector &&
+            sector < b->sector + b->count) {
+            ra_wait(b);
+            if (b->count) return b;
+        }
+    }
+    return NULL;
+}
+
+// Drop buffered sectors of [sector, sector + count), e.g. on a write
+static void ra_invalidate(BYTE pdrv, LBA_t sector, LBA_t count) {
+    for (size_t i = 0; i < count_of(ra_bufs); ++i) {
+        ra_buf_t *b = &ra_bufs[i];
+        if (b->count && b->pdrv == pdrv && sector < b->sector + b->count &&
+            b->sector < sector + count) {
+            ra_wait(b);
+            b->count = 0;
+        }
+    }
+}
+
+// Read a run starting at sector into the buffer, asynchronously if the
+// driver can
+static void ra_fill(ra_buf_t *b, sd_card_t *p_sd, BYTE pdrv, LBA_t sector, bool async) {
+    ra_wait(b);
+    b->count = 0;
+    uint64_t sectors = sd_sectors(p_sd);
+    if (sector >= sectors) return;
+    UINT count = DISK_READ_AHEAD_SECTORS;
+    if (sectors - sector < count) count = sectors - sector;
+    int rc;
+    if (async && p_sd->read_blocks_async) {
+        rc = p_sd->read_blocks_async(p_sd, (uint8_t *)b->data, sector, count, NULL, NULL);
+        b->pending = SD_BLOCK_DEVICE_ERROR_NONE == rc;
+    } else {
+        rc = p_sd->read_blocks(p_sd, (uint8_t *)b->data, sector, count);
+    }
+    if (SD_BLOCK_DEVICE_ERROR_NONE != rc) return;
+    b->pdrv = pdrv;
+    b->sector = sector;
+    b->count = count;
+    ++cache_stats.read_ahead_runs;
+}
+
+/* Serve what can be served of the request from the read-ahead buffers.
+ * Returns the number of leading sectors copied to buff; the rest is left to
+ * the cache. A read that continues the previous one counts as sequential:
+ * on a miss it gets a synchronous run, and whenever a run is entered the one
+ * after it is started in the other buffer. */
+static UINT ra_read(sd_card_t *p_sd, BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    bool sequential = pdrv == ra_pdrv && sector == ra_next;
+    ra_pdrv = pdrv;
+    ra_next = sector + count;
+
+    UINT done = 0;
+    while (done < count) {
+        LBA_t s = sector + done;
+        ra_buf_t *b = ra_find(pdrv, s);
+        if (!b) {
+            if (!sequential) break;
+            b = &ra_bufs[0];
+            if (ra_bufs[0].pending) b = &ra_bufs[1];
+            ra_fill(b, p_sd, pdrv, s, false);
+            if (!b->count) break;
+        }
+        UINT n = b->sector + b->count - s;
+        if (n > count - done) n = count - done;
+        memcpy(buff + done * FF_MAX_SS, (BYTE *)b->data + (s - b->sector) * FF_MAX_SS,
+               n * FF_MAX_SS);
+        done += n;
+        cache_stats.read_ahead_hits += n;
+
+        // Keep the next run coming while this one is consumed
+        ra_buf_t *other = &ra_bufs[b == &ra_bufs[0]];
+        LBA_t next = b->sector + b->count;
+        if (!(other->count && other->pdrv == pdrv && other->sector == next))
+            ra_fill(other, p_sd, pdrv, next, true);
+    }
+    if (done) cache_overlay(pdrv, buff, sector, done);
+    return done;
+}
+
+#else
+
+static UINT ra_read(sd_card_t *p_sd, BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+    return 0;
+}
+static void ra_invalidate(BYTE pdrv, LBA_t sector, LBA_t count) {}
+
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -59,6 +383,8 @@ DSTATUS disk_initialize(
 
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
+    cache_invalidate(pdrv);
+    ra_invalidate(pdrv, 0, ~(LBA_t)0);
     // See http://elm-chan.org/fsw/ff/doc/dstat.html
     return p_sd->init(p_sd);  
 }
@@ -98,7 +424,12 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = p_sd->read_blocks(p_sd, buff, sector, count);
+    // Sectors in the cache may be newer than anything read ahead
+    UINT done = 0;
+    if (1 != count || !cache_contains(pdrv, sector))
+        done = ra_read(p_sd, pdrv, buff, sector, count);
+    if (done == count) return RES_OK;
+    int rc = cache_read(p_sd, pdrv, buff + done * FF_MAX_SS, sector + done, count - done);
     return sdrc2dresult(rc);
 }
 
@@ -116,7 +447,8 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive nmuber to identify the drive */
     TRACE_PRINTF(">>> %s\n", __FUNCTION__);
     sd_card_t *p_sd = sd_get_by_num(pdrv);
     if (!p_sd) return RES_PARERR;
-    int rc = p_sd->write_blocks(p_sd, buff, sector, count);
+    ra_invalidate(pdrv, sector, count);
+    int rc = cache_write(p_sd, pdrv, buff, sector, count);
     return sdrc2dresult(rc);
 }
 
@@ -156,12 +488,26 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive nmuber (0..) */
                                 // f_mkfs function and it attempts to align data
                                 // area on the erase block boundary. It is
                                 // required when FF_USE_MKFS == 1.
-            static DWORD bs = 1;
+            // The card's allocation unit, rounded down to a power of two
+            // (AUs of 12, 24 MB) and limited to 32768 sectors (16 MB)
+            DWORD bs = 1;
+            while (bs < 32768 && bs * 2 <= p_sd->au_sectors) bs *= 2;
             *(DWORD *)buff = bs;
             return RES_OK;
         }
-        case CTRL_SYNC:
-            return RES_OK;
+        case CTRL_SYNC:  // Complete pending write process
+            return sdrc2dresult(cache_sync(pdrv));
+        case CTRL_TRIM: {  // Informs the device that the data on the block of
+                           // sectors is no longer needed and it can be erased.
+                           // The sector block is specified in an LBA_t array
+                           // {<Start LBA>, <End LBA>} pointed by buff.
+            LBA_t start = ((LBA_t *)buff)[0];
+            LBA_t count = ((LBA_t *)buff)[1] - start + 1;
+            cache_discard(pdrv, start, count);
+            ra_invalidate(pdrv, start, count);
+            if (!p_sd->trim_blocks) return RES_OK;  // Only a hint
+            return sdrc2dresult(p_sd->trim_blocks(p_sd, start, count));
+        }
         default:
             return RES_PARERR;
     }
@@ -0,0 +1,240 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "adc_capture.h"
+
+_Static_assert((ADC_CAPTURE_RING_SAMPLES & (ADC_CAPTURE_RING_SAMPLES - 1)) == 0,
+               "ADC_CAPTURE_RING_SAMPLES deve ser potência de 2");
+
+// Folga mantida entre leitura e escrita: a DMA continua escrevendo durante a cópia
+#define ADC_CAPTURE_MARGIN (ADC_CAPTURE_RING_SAMPLES / 8)
+
+static uint16_t ring[ADC_CAPTURE_RING_SAMPLES];
+// Lido pelo canal de controle para reposicionar o canal de dados no início do buffer
+static uint16_t *ring_base = ring;
+
+static int data_chan = -1;
+static int ctrl_chan = -1;
+static volatile uint32_t wraps;
+
+static uint64_t read_index;
+static uint32_t dropped_pending;
+static uint64_t start_us;
+static uint32_t period_cycles;
+
+static uint8_t mask;
+static uint8_t num_channels;
+static uint8_t order[5];
+
+/**
+ * @brief Conta as voltas completas do buffer circular
+ */
+static void __not_in_flash_func(adc_dma_irq_handler)()
+{
+    if (data_chan >= 0 && (dma_hw->ints1 & (1u << data_chan)))
+    {
+        dma_hw->ints1 = 1u << data_chan;
+        wraps++;
+    }
+}
+
+/**
+ * @brief Configura o ADC e os dois canais de DMA.
+ *
+ * O canal de dados copia a FIFO do ADC para o buffer e, ao completar uma
+ * volta, aciona o canal de controle, que o reposiciona no início do buffer e
+ * o dispara novamente. A captura segue indefinidamente sem a CPU.
+ *
+ * @param channel_mask bits 0..3: GPIO26..29, bit 4: sensor de temperatura
+ * @param sample_rate_hz Taxa total (dividida entre os canais), até 500 ksps
+ */
+bool adc_capture_init(uint8_t channel_mask, uint32_t sample_rate_hz)
+{
+    channel_mask &= 0x1F;
+    if (!channel_mask || !sample_rate_hz)
+        return false;
+
+    mask = channel_mask;
+    num_channels = 0;
+    for (uint ch = 0; ch < 5; ch++)
+    {
+        if (!(mask & (1u << ch)))
+            continue;
+        order[num_channels++] = ch;
+    }
+
+    adc_init();
+    for (uint ch = 0; ch < 4; ch++)
+        if (mask & (1u << ch))
+            adc_gpio_init(26 + ch);
+    adc_set_temp_sensor_enabled(mask & (1u << ADC_TEMP_CHANNEL));
+    adc_select_input(order[0]);
+    adc_set_round_robin(mask);
+    adc_fifo_setup(true,  // Escreve cada conversão na FIFO
+                   true,  // DREQ para a DMA
+                   1,     // DREQ assim que houver uma amostra
+                   false, // Sem bit de erro nas amostras
+                   false  // Amostras de 12 bits em palavras de 16 bits
+    );
+
+    period_cycles = ADC_CAPTURE_CLOCK_HZ / sample_rate_hz;
+    if (period_cycles < ADC_CAPTURE_MIN_PERIOD_CYCLES)
+        period_cycles = ADC_CAPTURE_MIN_PERIOD_CYCLES;
+    adc_set_clkdiv(period_cycles - 1);
+
+    if (data_chan < 0)
+    {
+        data_chan = dma_claim_unused_channel(true);
+        ctrl_chan = dma_claim_unused_channel(true);
+
+        dma_channel_set_irq1_enabled(data_chan, true);
+        irq_add_shared_handler(DMA_IRQ_1, adc_dma_irq_handler,
+                               PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+    }
+
+    dma_channel_config c = dma_channel_get_default_config(data_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, DREQ_ADC);
+    channel_config_set_chain_to(&c, ctrl_chan);
+    dma_channel_configure(data_chan, &c, ring, &adc_hw->fifo, ADC_CAPTURE_RING_SAMPLES, false);
+
+    c = dma_channel_get_default_config(ctrl_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(ctrl_chan, &c, &dma_hw->ch[data_chan].al2_write_addr_trig,
+                          &ring_base, 1, false);
+    return true;
+}
+
+/**
+ * @brief Inicia a conversão contínua; o índice das amostras recomeça em 0
+ */
+void adc_capture_start()
+{
+    adc_run(false);
+    adc_fifo_drain();
+
+    wraps = 0;
+    read_index = 0;
+    dropped_pending = 0;
+
+    dma_channel_set_write_addr(data_chan, ring, false);
+    dma_channel_set_trans_count(data_chan, ADC_CAPTURE_RING_SAMPLES, true);
+
+    adc_select_input(order[0]);
+    start_us = time_us_64();
+    adc_run(true);
+}
+
+/**
+ * @brief Para a conversão. Amostras ainda não lidas continuam disponíveis.
+ */
+void adc_capture_stop()
+{
+    adc_run(false);
+
+    // Abortar um canal pode sinalizar término (RP2040-E13): evita contar uma volta falsa
+    dma_channel_set_irq1_enabled(data_chan, false);
+    dma_channel_abort(data_chan);
+    dma_channel_abort(ctrl_chan);
+    dma_channel_abort(data_chan);
+    dma_hw->ints1 = 1u << data_chan;
+    dma_channel_set_irq1_enabled(data_chan, true);
+
+    adc_fifo_drain();
+}
+
+/**
+ * @brief Número de amostras produzidas desde adc_capture_start()
+ */
+static uint64_t adc_capture_produced()
+{
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t addr = dma_hw->ch[data_chan].write_addr;
+    uint32_t w = wraps;
+    // Fim de volta ainda não contado pela interrupção?
+    bool pending = dma_hw->ints1 & (1u << data_chan);
+    restore_interrupts(save);
+
+    uint32_t pos = (addr - (uint32_t)(uintptr_t)ring) / sizeof(uint16_t);
+    if (pending && pos < ADC_CAPTURE_RING_SAMPLES / 2)
+        w++;
+    return (uint64_t)w * ADC_CAPTURE_RING_SAMPLES + pos;
+}
+
+/**
+ * @brief Copia as amostras novas para dst.
+ *
+ * Lê sempre voltas completas do round robin: o bloco começa no primeiro canal
+ * habilitado e contém um múltiplo de adc_capture_num_channels() amostras.
+ * Se o consumidor atrasar a ponto de o buffer circular dar a volta, as
+ * amostras mais antigas são descartadas e contadas em block->dropped.
+ *
+ * @return Número de amostras copiadas (0 se não há uma volta completa nova)
+ */
+size_t adc_capture_read(uint16_t *dst, size_t max_samples, adc_block_t *block)
+{
+    if (data_chan < 0)
+        return 0;
+
+    uint64_t produced = adc_capture_produced();
+    uint64_t avail = produced - read_index;
+
+    if (avail > ADC_CAPTURE_RING_SAMPLES - ADC_CAPTURE_MARGIN)
+    {
+        uint64_t skip = avail - (ADC_CAPTURE_RING_SAMPLES - ADC_CAPTURE_MARGIN);
+        skip = (skip + num_channels - 1) / num_channels * num_channels; // Mantém o alinhamento em voltas
+        read_index += skip;
+        dropped_pending += (uint32_t)skip;
+        avail -= skip;
+    }
+    size_t n = avail < max_samples ? (size_t)avail : max_samples;
+    n -= n % num_channels;
+    if (!n)
+        return 0;
+
+    uint32_t start = (uint32_t)read_index & (ADC_CAPTURE_RING_SAMPLES - 1);
+    size_t first = ADC_CAPTURE_RING_SAMPLES - start;
+    if (first > n)
+        first = n;
+    memcpy(dst, &ring[start], first * sizeof(uint16_t));
+    memcpy(dst + first, ring, (n - first) * sizeof(uint16_t));
+
+    block->first_index = read_index;
+    block->t0_us = adc_capture_time_us(read_index);
+    block->dropped = dropped_pending;
+    block->count = n;
+
+    dropped_pending = 0;
+    read_index += n;
+    return n;
+}
+
+uint8_t adc_capture_channel_mask() { return mask; }
+uint8_t adc_capture_num_channels() { return num_channels; }
+uint32_t adc_capture_period_cycles() { return period_cycles; }
+
+/**
+ * @brief Canal do ADC que produziu a amostra de índice absoluto index
+ */
+uint8_t adc_capture_channel_of(uint64_t index)
+{
+    return num_channels ? order[(uint32_t)(index % num_channels)] : 0;
+}
+
+/**
+ * @brief Instante (base de time_us_64) da amostra de índice absoluto index
+ */
+uint64_t adc_capture_time_us(uint64_t index)
+{
+    return start_us + (index * period_cycles) / (ADC_CAPTURE_CLOCK_HZ / 1000000);
+}
@@ -0,0 +1,46 @@
+#ifndef ADC_CAPTURE_H
+#define ADC_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Captura contínua do ADC do RP2040 em modo round robin (free-running),
+ * com a FIFO do ADC esvaziada por DMA em um buffer circular.
+ *
+ * As amostras ficam intercaladas na ordem crescente dos canais habilitados
+ * (ex.: máscara 0b10011 -> ch0, ch1, ch4, ch0, ch1, ch4, ...). Cada amostra
+ * tem um índice absoluto desde o início da captura, do qual se obtém o canal
+ * e o instante exato (mesma base de tempo de time_us_64()).
+ */
+
+// Tamanho do buffer circular, em amostras de 16 bits
+#ifndef ADC_CAPTURE_RING_SAMPLES
+#define ADC_CAPTURE_RING_SAMPLES 4096
+#endif
+
+#define ADC_CAPTURE_CLOCK_HZ 48000000 // clk_adc
+#define ADC_CAPTURE_MIN_PERIOD_CYCLES 96 // Uma conversão: 500 ksps no máximo
+#define ADC_TEMP_CHANNEL 4
+
+// Descreve um bloco de amostras lido do buffer circular
+typedef struct {
+    uint64_t first_index;   // Índice absoluto da primeira amostra do bloco
+    uint64_t t0_us;         // Instante da primeira amostra
+    uint32_t dropped;       // Amostras perdidas (buffer cheio) antes deste bloco
+    size_t count;
+} adc_block_t;
+
+bool adc_capture_init(uint8_t channel_mask, uint32_t sample_rate_hz);
+void adc_capture_start();
+void adc_capture_stop();
+size_t adc_capture_read(uint16_t *dst, size_t max_samples, adc_block_t *block);
+
+uint8_t adc_capture_channel_mask();
+uint8_t adc_capture_num_channels();
+uint8_t adc_capture_channel_of(uint64_t index);
+uint32_t adc_capture_period_cycles();
+uint64_t adc_capture_time_us(uint64_t index);
+
+#endif
@@ -0,0 +1,552 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "datalog.h"
+#include "sensor_source.h"
+#include "stripe_log.h"
+
+_Static_assert(sizeof(datalog_file_header_t) == 40, "datalog_file_header_t deve ter 40 bytes");
+_Static_assert(sizeof(datalog_channel_t) == 28, "datalog_channel_t deve ter 28 bytes");
+_Static_assert(sizeof(datalog_block_header_t) == 32, "datalog_block_header_t deve ter 32 bytes");
+
+#define DATALOG_LINE_SIZE 512
+
+// Destino de uma fonte: arquivo comum ou faixas distribuídas entre os cartões
+typedef struct {
+    FIL fil;
+    stripe_log_t *stripe;
+    // Arquivo comum: bytes até o próximo fim de setor. O FatFs só recebe
+    // setores inteiros; com a reserva, um setor parcial novo seria lido do
+    // cartão antes de ser escrito.
+    UINT staged;
+    uint32_t stage[FF_MAX_SS / 4];
+} log_file_t;
+
+static log_file_t files[DATALOG_MAX_SOURCES];
+#if DATALOG_STRIPED
+static stripe_log_t stripe;
+#endif
+static sensor_source_t *opened[DATALOG_MAX_SOURCES];
+static size_t num_opened;
+
+// Cartão ausente (datalog_suspend): os lotes ficam na RAM até datalog_resume()
+typedef struct {
+    uint32_t source;        // Índice em opened[]
+    uint32_t size;          // Bytes de frames após a entrada
+    sensor_batch_t batch;   // data aponta para os frames ao reproduzir
+} spool_entry_t;
+
+static bool suspended;
+static unsigned segment;    // 0: log_name; n: "<nome>_<n>.<ext>"
+static uint32_t spool[DATALOG_SPOOL_BYTES / 4];
+static size_t spool_len;    // Bytes usados
+static uint32_t spool_lost[DATALOG_MAX_SOURCES]; // Frames que não couberam, somados ao próximo lote
+static absolute_time_t next_sync;
+
+static FRESULT stage_flush(log_file_t *lf)
+{
+    UINT bw;
+    FRESULT res = lf->staged ? f_write(&lf->fil, lf->stage, lf->staged, &bw) : FR_OK;
+    lf->staged = 0;
+    return res;
+}
+
+static FRESULT log_write(log_file_t *lf, const void *data, UINT len)
+{
+    UINT bw;
+    if (lf->stripe)
+        return stripe_log_write(lf->stripe, data, len, &bw);
+    FIL *fp = &lf->fil;
+    const uint8_t *src = data;
+    while (len)
+    {
+        // Setores inteiros a partir de um limite de setor: direto, sem cópia
+        if (!lf->staged && f_tell(fp) % FF_MAX_SS == 0 && len >= FF_MAX_SS)
+        {
+            UINT n = len - len % FF_MAX_SS;
+            FRESULT res = f_write(fp, src, n, &bw);
+            if (res != FR_OK)
+                return res;
+            src += n;
+            len -= n;
+            continue;
+        }
+        UINT room = FF_MAX_SS - (UINT)((f_tell(fp) + lf->staged) % FF_MAX_SS);
+        UINT n = len < room ? len : room;
+        memcpy((uint8_t *)lf->stage + lf->staged, src, n);
+        lf->staged += n;
+        src += n;
+        len -= n;
+        if (n == room)
+        {
+            FRESULT res = stage_flush(lf);
+            if (res != FR_OK)
+                return res;
+        }
+    }
+    return FR_OK;
+}
+
+/**
+ * @brief Salva o arquivo no cartão com o tamanho do que foi gravado
+ *
+ * O FatFs trata a reserva do f_expand como parte do arquivo: o f_sync
+ * gravaria o tamanho reservado, e um arquivo abandonado (cartão removido,
+ * falta de energia) terminaria em setores antigos que os leitores tomariam
+ * por dados. O f_sync_tell grava no diretório a posição de escrita; a reserva
+ * continua alocada e é liberada no fechamento (ou fica perdida até um chkdsk).
+ */
+static FRESULT log_sync(log_file_t *lf)
+{
+    if (lf->stripe)
+        return FR_OK;
+    FRESULT res = stage_flush(lf);
+    if (res != FR_OK)
+        return res;
+    return f_sync_tell(&lf->fil);
+}
+
+/**
+ * @brief Escreve o cabeçalho do .csv a partir do esquema da fonte
+ */
+static FRESULT write_csv_header(log_file_t *lf, const sensor_source_t *src)
+{
+    char line[DATALOG_LINE_SIZE];
+    size_t len = snprintf(line, sizeof line, "num_amostra,t_us");
+    for (size_t c = 0; c < src->num_channels && len < sizeof line; ++c)
+        len += snprintf(line + len, sizeof line - len, ",%s", src->channels[c].name);
+    if (len < sizeof line - 1)
+        line[len++] = '\n';
+    else
+        return FR_INVALID_PARAMETER;
+    return log_write(lf, line, len);
+}
+
+/**
+ * @brief Escreve o descritor do arquivo binário a partir do esquema da fonte
+ */
+static FRESULT write_binary_header(log_file_t *lf, const sensor_source_t *src)
+{
+    datalog_file_header_t header = {
+        .magic = DATALOG_FILE_MAGIC,
+        .version = DATALOG_FILE_VERSION,
+        .header_size = sizeof(datalog_file_header_t) + src->num_channels * sizeof(datalog_channel_t),
+        .num_channels = src->num_channels,
+        .frame_size = sensor_source_frame_size(src),
+        .timestamp = src->timestamp,
+    };
+    strncpy(header.source, src->name, sizeof header.source - 1);
+    FRESULT res = log_write(lf, &header, sizeof header);
+
+    uint16_t offset = 0;
+    for (size_t c = 0; c < src->num_channels && res == FR_OK; ++c)
+    {
+        datalog_channel_t desc = {
+            .type = src->channels[c].type,
+            .size = channel_type_size(src->channels[c].type),
+            .offset = offset,
+        };
+        strncpy(desc.name, src->channels[c].name, sizeof desc.name - 1);
+        offset += desc.size;
+        res = log_write(lf, &desc, sizeof desc);
+    }
+    return res;
+}
+
+/**
+ * @brief Lê o valor de um canal; memcpy evita acesso desalinhado (falha no Cortex-M0+)
+ */
+static int32_t channel_value(const uint8_t *p, channel_type_t type)
+{
+    switch (type)
+    {
+    case CHANNEL_INT16:
+    {
+        int16_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+    }
+    case CHANNEL_UINT16:
+    {
+        uint16_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+    }
+    case CHANNEL_INT32:
+    default:
+    {
+        int32_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+    }
+    }
+}
+
+static FRESULT write_csv(log_file_t *lf, const sensor_source_t *src, const sensor_batch_t *batch)
+{
+    const uint8_t *frame = batch->data;
+    size_t frame_size = sensor_source_frame_size(src);
+    char line[DATALOG_LINE_SIZE];
+
+    for (size_t f = 0; f < batch->num_frames; ++f, frame += frame_size)
+    {
+        uint64_t t_us = batch->t0_us + (f * (uint64_t)batch->period_ns) / 1000;
+        size_t len = snprintf(line, sizeof line, "%llu,%llu",
+                              (unsigned long long)(batch->first_index + f + 1), (unsigned long long)t_us);
+        if (src->format_csv)
+        {
+            len += src->format_csv(src, frame, line + len, sizeof line - len);
+        }
+        else
+        {
+            const uint8_t *p = frame;
+            for (size_t c = 0; c < src->num_channels && len < sizeof line; ++c)
+            {
+                len += snprintf(line + len, sizeof line - len, ",%ld", (long)channel_value(p, src->channels[c].type));
+                p += channel_type_size(src->channels[c].type);
+            }
+        }
+        if (len >= sizeof line - 1)
+            return FR_INVALID_PARAMETER;
+        line[len++] = '\n';
+        FRESULT res = log_write(lf, line, len);
+        if (res != FR_OK)
+            return res;
+    }
+    return FR_OK;
+}
+
+static FRESULT write_binary(log_file_t *lf, const sensor_source_t *src, const sensor_batch_t *batch)
+{
+    const uint8_t *data = batch->data;
+    size_t frame_size = sensor_source_frame_size(src);
+    size_t remaining = batch->num_frames;
+    uint64_t index = batch->first_index;
+    uint64_t offset_ns = 0;
+    uint32_t dropped = batch->dropped;
+
+    // num_frames do cabeçalho tem 16 bits: lotes maiores viram vários blocos
+    while (remaining)
+    {
+        size_t n = remaining > UINT16_MAX ? UINT16_MAX : remaining;
+        datalog_block_header_t header = {
+            .magic = DATALOG_BLOCK_MAGIC,
+            .num_frames = (uint16_t)n,
+            .frame_size = (uint16_t)frame_size,
+            .period_ns = batch->period_ns,
+            .dropped = dropped,
+            .first_index = index,
+            .t0_us = batch->t0_us + offset_ns / 1000,
+        };
+        FRESULT res = log_write(lf, &header, sizeof header);
+        if (res == FR_OK)
+            res = log_write(lf, data, n * frame_size);
+        if (res != FR_OK)
+            return res;
+        data += n * frame_size;
+        index += n;
+        offset_ns += n * (uint64_t)batch->period_ns;
+        remaining -= n;
+        dropped = 0;
+    }
+    return FR_OK;
+}
+
+static FRESULT write_batch(size_t i, const sensor_batch_t *batch)
+{
+    return opened[i]->log_format == LOG_FORMAT_CSV ? write_csv(&files[i], opened[i], batch)
+                                                   : write_binary(&files[i], opened[i], batch);
+}
+
+/**
+ * @brief Guarda o lote na RAM; sem espaço, seus frames entram como perdidos no próximo
+ */
+static void spool_put(size_t i, const sensor_batch_t *batch)
+{
+    size_t size = batch->num_frames * sensor_source_frame_size(opened[i]);
+    size_t need = sizeof(spool_entry_t) + ((size + 3) & ~3u);
+    if (spool_len + need > sizeof spool)
+    {
+        spool_lost[i] += batch->dropped + batch->num_frames;
+        return;
+    }
+    spool_entry_t *e = (spool_entry_t *)((uint8_t *)spool + spool_len);
+    e->source = i;
+    e->size = size;
+    e->batch = *batch;
+    e->batch.dropped += spool_lost[i];
+    spool_lost[i] = 0;
+    memcpy(e + 1, batch->data, size);
+    spool_len += need;
+}
+
+/**
+ * @brief Grava os lotes guardados na RAM, na ordem em que foram lidos
+ *
+ * Um lote sai da RAM quando o arquivo da sua fonte foi salvo (log_sync) com
+ * ele. Se algo falha, os lotes que não chegaram a ser salvos continuam na RAM
+ * para o próximo segmento: o arquivo abandonado não os mostra (o diretório
+ * tem o tamanho do último f_sync), e os que ele mostra não se repetem.
+ */
+static FRESULT spool_drain()
+{
+    size_t pos = 0;
+    FRESULT res = FR_OK;
+    while (pos < spool_len)
+    {
+        spool_entry_t *e = (spool_entry_t *)((uint8_t *)spool + pos);
+        sensor_batch_t batch = e->batch;
+        batch.data = e + 1;
+        res = write_batch(e->source, &batch);
+        if (res != FR_OK)
+            return res; // Nada do que foi gravado agora foi salvo: tudo fica
+        pos += sizeof(spool_entry_t) + ((e->size + 3) & ~3u);
+    }
+    bool saved[DATALOG_MAX_SOURCES];
+    for (size_t i = 0; i < num_opened; ++i)
+    {
+        FRESULT r = log_sync(&files[i]);
+        saved[i] = r == FR_OK;
+        if (res == FR_OK)
+            res = r;
+    }
+    size_t keep = 0;
+    for (pos = 0; pos < spool_len;)
+    {
+        spool_entry_t *e = (spool_entry_t *)((uint8_t *)spool + pos);
+        size_t need = sizeof(spool_entry_t) + ((e->size + 3) & ~3u);
+        if (!saved[e->source])
+        {
+            memmove((uint8_t *)spool + keep, e, need);
+            keep += need;
+        }
+        pos += need;
+    }
+    spool_len = keep;
+    return res;
+}
+
+/**
+ * @brief Libera o que sobrou da reserva, a partir da posição de escrita, e fecha o arquivo
+ */
+static FRESULT log_close(log_file_t *lf)
+{
+    if (lf->stripe)
+        return stripe_log_close(lf->stripe);
+    FRESULT res = stage_flush(lf);
+    if (res == FR_OK)
+        res = f_truncate(&lf->fil);
+    FRESULT r = f_close(&lf->fil);
+    return res == FR_OK ? r : res;
+}
+
+static void close_all()
+{
+    for (size_t i = 0; i < num_opened; ++i)
+        log_close(&files[i]);
+    num_opened = 0;
+}
+
+/**
+ * @brief Nome do arquivo no segmento atual: log_name, e depois "<nome>_<n>.<ext>"
+ */
+static const char *segment_name(const char *name, char *buf, size_t size)
+{
+    if (!segment)
+        return name;
+    const char *dot = strrchr(name, '.');
+    int stem = dot ? (int)(dot - name) : (int)strlen(name);
+    snprintf(buf, size, "%.*s_%u%s", stem, name, segment, dot ? dot : "");
+    return buf;
+}
+
+/**
+ * @brief Abre o destino da fonte e grava o cabeçalho
+ */
+static FRESULT log_open(log_file_t *lf, const sensor_source_t *src)
+{
+    char buf[DATALOG_NAME_LEN + 8];
+    const char *name = segment_name(src->log_name, buf, sizeof buf);
+    lf->stripe = NULL;
+#if DATALOG_STRIPED
+    // Uma fonte binária por vez em faixas; as demais, e os .csv, em arquivos comuns
+    if (src->log_format == LOG_FORMAT_BINARY && !stripe.num_cards && stripe_log_num_cards() > 1)
+    {
+        FRESULT res = stripe_log_open(&stripe, name,
+                                      DATALOG_MIRRORED ? STRIPE_LOG_MIRRORED : STRIPE_LOG_STRIPED);
+        if (res != FR_OK)
+            return res;
+        lf->stripe = &stripe;
+        res = write_binary_header(lf, src);
+        if (res != FR_OK)
+            log_close(lf);
+        return res;
+    }
+#endif
+    FIL *fp = &lf->fil;
+    lf->staged = 0;
+    FRESULT res = f_open(fp, name, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK)
+        return res;
+    // Sem bloco contíguo livre do tamanho pedido o arquivo cresce normalmente
+    if (DATALOG_PREALLOC_BYTES && f_expand(fp, DATALOG_PREALLOC_BYTES, 1) != FR_OK)
+        printf("[AVISO] %s: sem espaço contíguo para reserva\n", name);
+    res = src->log_format == LOG_FORMAT_CSV ? write_csv_header(lf, src) : write_binary_header(lf, src);
+    if (res != FR_OK)
+        log_close(lf);
+    return res;
+}
+
+/**
+ * @brief Cria um arquivo por fonte inicializada, grava os cabeçalhos e inicia as fontes
+ */
+FRESULT datalog_open()
+{
+    num_opened = 0;
+    segment = 0;
+    suspended = false;
+    spool_len = 0;
+    memset(spool_lost, 0, sizeof spool_lost);
+    next_sync = make_timeout_time_ms(DATALOG_SYNC_MS);
+    for (size_t i = 0; i < sensor_source_get_num() && num_opened < DATALOG_MAX_SOURCES; ++i)
+    {
+        sensor_source_t *src = sensor_source_get_by_num(i);
+        if (!src->initialized)
+            continue;
+        FRESULT res = log_open(&files[num_opened], src);
+        if (res != FR_OK)
+        {
+            close_all();
+            return res;
+        }
+        opened[num_opened++] = src;
+    }
+    if (!num_opened)
+        return FR_NO_FILE;
+
+    for (size_t i = 0; i < num_opened; ++i)
+        opened[i]->start(opened[i]);
+    return FR_OK;
+}
+
+/**
+ * @brief Grava o lote disponível de cada fonte; chamada uma vez por período de amostragem
+ */
+FRESULT datalog_poll()
+{
+    for (size_t i = 0; i < num_opened; ++i)
+    {
+        sensor_source_t *src = opened[i];
+        sensor_batch_t batch;
+        if (!src->read_batch(src, &batch))
+            continue;
+        if (batch.dropped)
+            printf("[AVISO] %s: %lu frames perdidos\n", src->name, (unsigned long)batch.dropped);
+        if (suspended)
+        {
+            spool_put(i, &batch);
+            continue;
+        }
+        batch.dropped += spool_lost[i];
+        spool_lost[i] = 0;
+        FRESULT res = write_batch(i, &batch);
+        if (res != FR_OK)
+        {
+            // O driver já esgotou a recuperação: o lote fica na RAM, caso a captura seja retomada
+            spool_put(i, &batch);
+            return res;
+        }
+    }
+    // Metadados no cartão a cada DATALOG_SYNC_MS: limita o que uma remoção pode perder
+    if (DATALOG_SYNC_MS && !suspended && time_reached(next_sync))
+    {
+        next_sync = make_timeout_time_ms(DATALOG_SYNC_MS);
+        for (size_t i = 0; i < num_opened; ++i)
+        {
+            FRESULT res = log_sync(&files[i]);
+            if (res != FR_OK)
+                return res;
+        }
+    }
+    return FR_OK;
+}
+
+/**
+ * @brief Cartão removido: abandona os arquivos, sem acessá-lo, e passa a guardar os lotes na RAM
+ */
+void datalog_suspend()
+{
+    if (suspended || !num_opened)
+        return;
+    for (size_t i = 0; i < num_opened; ++i)
+        if (files[i].stripe)
+            stripe_log_abandon(files[i].stripe);
+    suspended = true;
+}
+
+bool datalog_suspended()
+{
+    return suspended;
+}
+
+/**
+ * @brief Cartão remontado: abre o próximo segmento de arquivos e grava nele o que ficou na RAM
+ */
+FRESULT datalog_resume()
+{
+    if (!suspended)
+        return FR_OK;
+    ++segment; // Também após uma tentativa que falhou: não sobrescreve o que ela criou
+    for (size_t i = 0; i < num_opened; ++i)
+    {
+        FRESULT res = log_open(&files[i], opened[i]);
+        if (res != FR_OK)
+        {
+            while (i--)
+                log_close(&files[i]);
+            return res;
+        }
+    }
+    suspended = false;
+    next_sync = make_timeout_time_ms(DATALOG_SYNC_MS);
+    return spool_drain();
+}
+
+/**
+ * @brief Para as fontes, grava o que restou nos buffers e fecha (salva) os arquivos
+ */
+FRESULT datalog_close()
+{
+    FRESULT res = FR_OK;
+    for (size_t i = 0; i < num_opened; ++i)
+        opened[i]->stop(opened[i]);
+    if (suspended)
+    {
+        // Sem cartão: o que está na RAM se perde
+        printf("[AVISO] captura encerrada sem cartão: %lu bytes na RAM descartados\n", (unsigned long)spool_len);
+        suspended = false;
+        spool_len = 0;
+        num_opened = 0;
+        return FR_NOT_READY;
+    }
+
+    // Apenas fontes com amostragem por hardware têm dados pendentes após stop()
+    for (size_t i = 0; i < num_opened && res == FR_OK; ++i)
+    {
+        sensor_source_t *src = opened[i];
+        sensor_batch_t batch;
+        if (src->timestamp != TIMESTAMP_SAMPLE_CLOCK || !src->read_batch(src, &batch))
+            continue;
+        res = write_batch(i, &batch);
+    }
+    for (size_t i = 0; i < num_opened; ++i)
+    {
+        FRESULT r = log_close(&files[i]);
+        if (res == FR_OK)
+            res = r;
+    }
+    num_opened = 0;
+    return res;
+}
@@ -0,0 +1,102 @@
+#ifndef DATALOG_H
+#define DATALOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ff.h"
+
+/**
+ * Pipeline de gravação: um arquivo por fonte de dados inicializada
+ * (ver sensor_source.h), no formato que a fonte declara.
+ *
+ * CSV: cabeçalho "num_amostra,t_us,<canais>" e uma linha por frame.
+ * Binário: autodescritivo. O arquivo começa com datalog_file_header_t e
+ * num_channels descritores datalog_channel_t (nome, tipo e posição de cada
+ * canal no frame), seguidos de blocos com datalog_block_header_t e
+ * num_frames * frame_size bytes (valores little-endian, na ordem do esquema).
+ * ArquivosDados/decode_log.py converte o arquivo para .csv usando apenas o
+ * descritor.
+ */
+
+#ifndef DATALOG_MAX_SOURCES
+#define DATALOG_MAX_SOURCES 8
+#endif
+
+/* Espaço reservado para cada arquivo na abertura (f_expand), em bytes: um
+ * bloco contíguo alinhado à unidade de alocação do cartão. O tamanho salvo no
+ * diretório é sempre o dos dados gravados; o excedente é liberado no
+ * fechamento. 0 desliga a reserva. */
+#ifndef DATALOG_PREALLOC_BYTES
+#define DATALOG_PREALLOC_BYTES (1024 * 1024)
+#endif
+
+/* Com mais de um cartão montado, a primeira fonte binária é gravada em faixas
+ * distribuídas entre os cartões (ver stripe_log.h); 0 desliga. */
+#ifndef DATALOG_STRIPED
+#define DATALOG_STRIPED 1
+#endif
+
+/* Com DATALOG_STRIPED: grava uma cópia completa em cada cartão (espelho, para
+ * capturas que não podem ser perdidas) em vez de dividir entre eles. */
+#ifndef DATALOG_MIRRORED
+#define DATALOG_MIRRORED 0
+#endif
+
+/* Lotes guardados na RAM enquanto o cartão está ausente (datalog_suspend);
+ * o que não couber é contado como frames perdidos. */
+#ifndef DATALOG_SPOOL_BYTES
+#define DATALOG_SPOOL_BYTES (32 * 1024)
+#endif
+
+/* Intervalo entre f_sync dos arquivos abertos, em ms: limita o que se perde se
+ * o cartão for removido durante a captura; 0 desliga. */
+#ifndef DATALOG_SYNC_MS
+#define DATALOG_SYNC_MS 1000
+#endif
+
+#define DATALOG_FILE_MAGIC 0x31474C44 // "DLG1"
+#define DATALOG_FILE_VERSION 1
+#define DATALOG_NAME_LEN 24
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;   // Bytes até o primeiro bloco (cabeçalho + descritores)
+    uint16_t num_channels;
+    uint16_t frame_size;
+    uint8_t timestamp;      // timestamp_kind_t
+    uint8_t reserved[3];
+    char source[DATALOG_NAME_LEN];
+} datalog_file_header_t;
+
+typedef struct {
+    char name[DATALOG_NAME_LEN];
+    uint8_t type;           // channel_type_t
+    uint8_t size;
+    uint16_t offset;        // Posição no frame, em bytes
+} datalog_channel_t;
+
+#define DATALOG_BLOCK_MAGIC 0x304B4C42 // "BLK0"
+typedef struct {
+    uint32_t magic;
+    uint16_t num_frames;
+    uint16_t frame_size;  // Bytes por frame
+    uint32_t period_ns;   // Intervalo entre frames do bloco
+    uint32_t dropped;     // Frames perdidos antes deste bloco
+    uint64_t first_index;
+    uint64_t t0_us;
+} datalog_block_header_t;
+
+FRESULT datalog_open();
+FRESULT datalog_poll();
+FRESULT datalog_close();
+
+/* Cartão removido (ou com erro) durante a captura: as fontes continuam e os
+ * lotes vão para a RAM, começando pelo que datalog_poll() não conseguiu
+ * gravar. datalog_resume(), com o cartão remontado, grava-os em um novo
+ * segmento de arquivos ("<nome>_<n>.<ext>") e segue a captura nele. */
+void datalog_suspend();
+FRESULT datalog_resume();
+bool datalog_suspended();
+
+#endif
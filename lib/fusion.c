@@ -0,0 +1,194 @@
+#include <stdlib.h>
+
+#include "fusion.h"
+
+#if FUSION_MEASURE_CYCLES
+#include "hardware/structs/systick.h"
+#endif
+
+#define MDEG_180 180000
+#define MDEG_360 360000
+
+// 2^32 / (LSB por °/s * 1000): converte contagens * us em mdeg com um produto e um shift
+#define FUSION_GYRO_RECIP ((uint32_t)((1ULL << 32) / (FUSION_GYRO_LSB_PER_DPS * 1000ULL)))
+
+// Passos de tempo maiores que isso (ex.: pausa na captura) não são integrados
+#define FUSION_MAX_DT_US 1000000
+
+/**
+ * @brief Traz o ângulo para o intervalo [-180000, 180000)
+ */
+static inline int32_t wrap_mdeg(int32_t a)
+{
+    while (a >= MDEG_180)
+        a -= MDEG_360;
+    while (a < -MDEG_180)
+        a += MDEG_360;
+    return a;
+}
+
+/**
+ * @brief atan(z) para z em [0, 1] (Q15), em mdeg. Erro máximo ~0,1°
+ */
+static inline int32_t atan_q15_mdeg(int32_t z)
+{
+    int32_t lin = (45000 * z) >> 15;
+    int32_t curve = (z * (32768 - z)) >> 15;
+    int32_t coef = 14020 + ((3800 * z) >> 15);
+    return lin + ((curve * coef) >> 15);
+}
+
+/**
+ * @brief atan2 em ponto fixo, resultado em mdeg no intervalo [-180000, 180000].
+ * As entradas devem caber em 17 bits (leituras brutas do MPU6050 e suas normas).
+ */
+int32_t fusion_atan2_mdeg(int32_t y, int32_t x)
+{
+    uint32_t ax = (uint32_t)abs(x);
+    uint32_t ay = (uint32_t)abs(y);
+    int32_t angle;
+
+    if (ax == 0 && ay == 0)
+        return 0;
+
+    if (ax >= ay)
+        angle = atan_q15_mdeg((int32_t)((ay << 15) / ax));
+    else
+        angle = 90000 - atan_q15_mdeg((int32_t)((ax << 15) / ay));
+
+    if (x < 0)
+        angle = MDEG_180 - angle;
+    if (y < 0)
+        angle = -angle;
+    return angle;
+}
+
+/**
+ * @brief Raiz quadrada inteira (bit a bit, sem divisões)
+ */
+uint32_t fusion_isqrt(uint32_t v)
+{
+    uint32_t res = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > v)
+        bit >>= 2;
+    while (bit)
+    {
+        if (v >= res + bit)
+        {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+        {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return res;
+}
+
+/**
+ * @brief Combina a estimativa do giroscópio com a do acelerômetro
+ */
+static inline int32_t blend(int32_t gyro_est, int32_t accel_est)
+{
+    int32_t diff = wrap_mdeg(gyro_est - accel_est);
+    return wrap_mdeg(accel_est + ((diff * FUSION_ALPHA_Q10) >> 10));
+}
+
+static inline int32_t gyro_delta_mdeg(int16_t rate, uint32_t dt_us)
+{
+    return (int32_t)(((int64_t)rate * dt_us * FUSION_GYRO_RECIP) >> 32);
+}
+
+static void accel_angles(const int16_t accel[3], int32_t *roll, int32_t *pitch)
+{
+    int32_t ay = accel[1], az = accel[2];
+    uint32_t norm_yz = fusion_isqrt((uint32_t)(ay * ay) + (uint32_t)(az * az));
+
+    *roll = fusion_atan2_mdeg(ay, az);
+    *pitch = fusion_atan2_mdeg(-(int32_t)accel[0], (int32_t)norm_yz);
+}
+
+/**
+ * @brief Inicializa o estado do filtro (e o SysTick, se a medição estiver ativa)
+ */
+void fusion_init(fusion_t *f)
+{
+    f->roll = f->pitch = f->yaw = 0;
+    f->last_us = 0;
+    f->initialized = false;
+    f->updates = 0;
+    f->cycles_last = 0;
+    f->cycles_max = 0;
+    f->cycles_total = 0;
+
+#if FUSION_MEASURE_CYCLES
+    // SysTick de 24 bits contando ciclos do processador
+    if (!(systick_hw->csr & 0x1))
+    {
+        systick_hw->rvr = 0x00FFFFFF;
+        systick_hw->cvr = 0;
+        systick_hw->csr = 0x5; // CLKSOURCE = processador, ENABLE
+    }
+#endif
+}
+
+/**
+ * @brief Atualiza a orientação com uma amostra bruta do MPU6050
+ */
+void fusion_update(fusion_t *f, const int16_t accel[3], const int16_t gyro[3], uint64_t now_us)
+{
+#if FUSION_MEASURE_CYCLES
+    uint32_t start = systick_hw->cvr;
+#endif
+    int32_t roll_acc, pitch_acc;
+    accel_angles(accel, &roll_acc, &pitch_acc);
+
+    if (!f->initialized)
+    {
+        f->roll = roll_acc;
+        f->pitch = pitch_acc;
+        f->yaw = 0;
+        f->initialized = true;
+    }
+    else
+    {
+        uint64_t dt = now_us - f->last_us;
+        uint32_t dt_us = dt > FUSION_MAX_DT_US ? 0 : (uint32_t)dt;
+
+        f->roll = blend(f->roll + gyro_delta_mdeg(gyro[0], dt_us), roll_acc);
+        f->pitch = blend(f->pitch + gyro_delta_mdeg(gyro[1], dt_us), pitch_acc);
+        f->yaw = wrap_mdeg(f->yaw + gyro_delta_mdeg(gyro[2], dt_us));
+    }
+    f->last_us = now_us;
+
+#if FUSION_MEASURE_CYCLES
+    // O SysTick conta para baixo
+    uint32_t cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+    f->cycles_last = cycles;
+    if (cycles > f->cycles_max)
+        f->cycles_max = cycles;
+    f->cycles_total += cycles;
+#endif
+    f->updates++;
+}
+
+/**
+ * @brief Custo médio de uma atualização, em ciclos
+ */
+uint32_t fusion_cycles_avg(const fusion_t *f)
+{
+    return f->updates ? (uint32_t)(f->cycles_total / f->updates) : 0;
+}
+
+/**
+ * @brief Taxa máxima de atualização sustentável usando todo o núcleo
+ */
+uint32_t fusion_max_rate_hz(const fusion_t *f, uint32_t clk_sys_hz)
+{
+    uint32_t avg = fusion_cycles_avg(f);
+    return avg ? clk_sys_hz / avg : 0;
+}
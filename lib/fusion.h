@@ -0,0 +1,51 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Filtro complementar em ponto fixo para estimar a orientação do MPU6050.
+ *
+ * Todos os ângulos são inteiros em milésimos de grau (mdeg), o que evita
+ * ponto flutuante no Cortex-M0+ (que não tem FPU).
+ */
+
+// Peso do giroscópio no filtro complementar, em Q10 (1004 / 1024 ~= 0,98)
+#ifndef FUSION_ALPHA_Q10
+#define FUSION_ALPHA_Q10 1004
+#endif
+
+// Sensibilidade do giroscópio na escala padrão de ±250 °/s (LSB por °/s)
+#ifndef FUSION_GYRO_LSB_PER_DPS
+#define FUSION_GYRO_LSB_PER_DPS 131
+#endif
+
+// Mede o custo (em ciclos de clk_sys) de cada atualização com o SysTick
+#ifndef FUSION_MEASURE_CYCLES
+#define FUSION_MEASURE_CYCLES 1
+#endif
+
+typedef struct {
+    int32_t roll;   // mdeg
+    int32_t pitch;  // mdeg
+    int32_t yaw;    // mdeg (apenas integração do giroscópio, sem magnetômetro)
+    uint64_t last_us;
+    bool initialized;
+
+    // Estatísticas de custo por atualização
+    uint32_t updates;
+    uint32_t cycles_last;
+    uint32_t cycles_max;
+    uint64_t cycles_total;
+} fusion_t;
+
+void fusion_init(fusion_t *f);
+void fusion_update(fusion_t *f, const int16_t accel[3], const int16_t gyro[3], uint64_t now_us);
+uint32_t fusion_cycles_avg(const fusion_t *f);
+uint32_t fusion_max_rate_hz(const fusion_t *f, uint32_t clk_sys_hz);
+
+int32_t fusion_atan2_mdeg(int32_t y, int32_t x);
+uint32_t fusion_isqrt(uint32_t v);
+
+#endif
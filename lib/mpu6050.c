@@ -0,0 +1,218 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "mpu6050.h"
+
+#define MPU6050_REG_ACCEL_XOUT_H 0x3B
+#define MPU6050_REG_PWR_MGMT_1 0x6B
+#define MPU6050_REG_WHO_AM_I 0x75
+#define MPU6050_WHO_AM_I_VALUE 0x68
+
+// Tempo máximo para uma transação I2C (uma rajada leva ~0,4 ms a 400 kHz)
+#define MPU6050_TIMEOUT_US 2000
+
+#define NUM_I2C_BUSES 2
+
+/**
+ * @brief Inicializa o barramento (apenas uma vez, mesmo se compartilhado)
+ */
+static void i2c_bus_init(i2c_bus_t *bus)
+{
+    if (bus->initialized)
+        return;
+    if (!bus->baud_rate)
+        bus->baud_rate = 400 * 1000;
+    i2c_init(bus->hw_inst, bus->baud_rate);
+    gpio_set_function(bus->sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(bus->scl_gpio, GPIO_FUNC_I2C);
+    gpio_pull_up(bus->sda_gpio);
+    gpio_pull_up(bus->scl_gpio);
+    bus->initialized = true;
+}
+
+static bool mpu6050_write_reg(mpu6050_t *mpu, uint8_t reg, uint8_t value)
+{
+    uint8_t buf[] = {reg, value};
+    return 2 == i2c_write_timeout_us(mpu->bus->hw_inst, mpu->addr, buf, 2, false, MPU6050_TIMEOUT_US);
+}
+
+static bool mpu6050_reset(mpu6050_t *mpu)
+{
+    if (!mpu6050_write_reg(mpu, MPU6050_REG_PWR_MGMT_1, 0x80))
+        return false;
+    sleep_ms(100);
+    if (!mpu6050_write_reg(mpu, MPU6050_REG_PWR_MGMT_1, 0x00))
+        return false;
+    sleep_ms(10);
+    return true;
+}
+
+static bool mpu6050_probe(mpu6050_t *mpu)
+{
+    uint8_t reg = MPU6050_REG_WHO_AM_I, who = 0;
+    if (1 != i2c_write_timeout_us(mpu->bus->hw_inst, mpu->addr, &reg, 1, true, MPU6050_TIMEOUT_US))
+        return false;
+    if (1 != i2c_read_timeout_us(mpu->bus->hw_inst, mpu->addr, &who, 1, false, MPU6050_TIMEOUT_US))
+        return false;
+    // O WHO_AM_I não reflete o pino AD0: vale 0x68 nos dois endereços
+    return (who & 0x7E) == MPU6050_WHO_AM_I_VALUE;
+}
+
+/**
+ * @brief Inicializa os barramentos e todos os sensores da tabela
+ * @return Número de sensores que responderam
+ */
+size_t mpu6050_init_all()
+{
+    size_t found = 0;
+    for (size_t i = 0; i < mpu_get_num(); ++i)
+    {
+        mpu6050_t *mpu = mpu_get_by_num(i);
+        i2c_bus_init(mpu->bus);
+        mpu->present = mpu6050_probe(mpu) && mpu6050_reset(mpu);
+        mpu->error = !mpu->present;
+        if (mpu->present)
+            found++;
+        printf("MPU6050 %s (i2c%u, 0x%02x): %s\n", mpu->name,
+               i2c_hw_index(mpu->bus->hw_inst), mpu->addr,
+               mpu->present ? "encontrado" : "ausente");
+    }
+    return found;
+}
+
+/**
+ * @brief Enfileira no hardware uma leitura completa de 14 bytes, sem esperar.
+ *
+ * O endereço do registrador e os 14 comandos de leitura cabem na FIFO de
+ * transmissão (16 posições), então a transação segue sozinha enquanto a CPU
+ * dispara a leitura no outro barramento.
+ */
+static void mpu6050_burst_start(mpu6050_t *mpu)
+{
+    i2c_hw_t *hw = i2c_get_hw(mpu->bus->hw_inst);
+
+    hw->enable = 0;
+    hw->tar = mpu->addr;
+    hw->enable = 1;
+    (void)hw->clr_tx_abrt;
+    (void)hw->clr_stop_det;
+
+    hw->data_cmd = MPU6050_REG_ACCEL_XOUT_H;
+    for (int i = 0; i < MPU6050_BURST_LEN; i++)
+    {
+        uint32_t cmd = I2C_IC_DATA_CMD_CMD_BITS;
+        if (i == 0)
+            cmd |= I2C_IC_DATA_CMD_RESTART_BITS;
+        if (i == MPU6050_BURST_LEN - 1)
+            cmd |= I2C_IC_DATA_CMD_STOP_BITS;
+        hw->data_cmd = cmd;
+    }
+}
+
+/**
+ * @brief Aguarda o fim da rajada iniciada por mpu6050_burst_start()
+ */
+static bool mpu6050_burst_finish(mpu6050_t *mpu, mpu6050_sample_t *sample)
+{
+    i2c_hw_t *hw = i2c_get_hw(mpu->bus->hw_inst);
+    uint8_t buffer[MPU6050_BURST_LEN];
+    absolute_time_t timeout_time = make_timeout_time_us(MPU6050_TIMEOUT_US);
+    size_t n = 0;
+    bool abort = false;
+
+    while (n < MPU6050_BURST_LEN)
+    {
+        if (hw->rxflr)
+        {
+            buffer[n++] = (uint8_t)hw->data_cmd;
+            continue;
+        }
+        if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS)
+        {
+            // Sensor não reconheceu o endereço (NACK); o hardware já gerou o STOP
+            (void)hw->clr_tx_abrt;
+            abort = true;
+            break;
+        }
+        if (time_reached(timeout_time))
+        {
+            abort = true;
+            break;
+        }
+    }
+    while (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS) && !time_reached(timeout_time))
+        tight_loop_contents();
+    (void)hw->clr_stop_det;
+
+    if (abort)
+    {
+        // Descarta bytes remanescentes para a próxima transação começar limpa
+        while (hw->rxflr)
+            (void)hw->data_cmd;
+        return false;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        sample->accel[i] = (buffer[i * 2] << 8) | buffer[(i * 2) + 1];
+        sample->gyro[i] = (buffer[8 + i * 2] << 8) | buffer[8 + (i * 2) + 1];
+    }
+    sample->temp = (buffer[6] << 8) | buffer[7];
+    return true;
+}
+
+/**
+ * @brief Lê todos os sensores presentes, em paralelo entre os barramentos.
+ *
+ * Sensores em barramentos diferentes são lidos ao mesmo tempo; apenas
+ * sensores no mesmo barramento são lidos em sequência. Com 4 sensores, a
+ * latência é a de 2 rajadas, e não a de 4.
+ *
+ * @param samples Uma posição por sensor da tabela (índice de mpu_get_by_num)
+ * @param timestamp_us Instante (time_us_64) em que a primeira leitura começou
+ * @return Número de sensores lidos com sucesso
+ */
+size_t mpu6050_read_all(mpu6050_sample_t samples[], uint64_t *timestamp_us)
+{
+    bool done[MPU_MAX_SENSORS] = {false};
+    size_t num = mpu_get_num();
+    size_t ok = 0;
+
+    if (num > MPU_MAX_SENSORS)
+        num = MPU_MAX_SENSORS;
+    *timestamp_us = time_us_64();
+
+    for (;;)
+    {
+        mpu6050_t *active[NUM_I2C_BUSES] = {NULL};
+        size_t active_ix[NUM_I2C_BUSES] = {0};
+        bool any = false;
+
+        // Uma rajada por barramento nesta rodada
+        for (size_t i = 0; i < num; ++i)
+        {
+            mpu6050_t *mpu = mpu_get_by_num(i);
+            uint bus = i2c_hw_index(mpu->bus->hw_inst);
+            if (done[i] || !mpu->present || active[bus])
+                continue;
+            active[bus] = mpu;
+            active_ix[bus] = i;
+            mpu6050_burst_start(mpu);
+            any = true;
+        }
+        if (!any)
+            break;
+        for (uint bus = 0; bus < NUM_I2C_BUSES; ++bus)
+        {
+            if (!active[bus])
+                continue;
+            size_t i = active_ix[bus];
+            active[bus]->error = !mpu6050_burst_finish(active[bus], &samples[i]);
+            if (active[bus]->error)
+                memset(&samples[i], 0, sizeof samples[i]);
+            else
+                ok++;
+            done[i] = true;
+        }
+    }
+    return ok;
+}
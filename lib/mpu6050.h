@@ -0,0 +1,54 @@
+#ifndef MPU6050_H
+#define MPU6050_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+// Número máximo de sensores: 0x68/0x69 em i2c0 e i2c1
+#define MPU_MAX_SENSORS 4
+
+#define MPU6050_ADDR_AD0_LOW 0x68
+#define MPU6050_ADDR_AD0_HIGH 0x69
+
+// Leitura em rajada de ACCEL_XOUT_H (0x3B) até GYRO_ZOUT_L (0x48)
+#define MPU6050_BURST_LEN 14
+
+// "Classe" representando um barramento I2C usado pelos sensores
+typedef struct {
+    i2c_inst_t *hw_inst;
+    uint sda_gpio;
+    uint scl_gpio;
+    uint baud_rate;
+
+    // Estado
+    bool initialized;
+} i2c_bus_t;
+
+// "Classe" representando um MPU6050
+typedef struct {
+    const char *name;   // Prefixo das colunas no arquivo de log
+    i2c_bus_t *bus;     // Barramento ao qual o sensor está ligado
+    uint8_t addr;       // 0x68 (AD0 em nível baixo) ou 0x69 (AD0 em nível alto)
+
+    // Estado
+    bool present;       // Respondeu ao WHO_AM_I na inicialização
+    bool error;         // A última leitura falhou
+} mpu6050_t;
+
+typedef struct {
+    int16_t accel[3];
+    int16_t temp;
+    int16_t gyro[3];
+} mpu6050_sample_t;
+
+// Definidos em hw_config.c, junto com a configuração dos cartões SD
+size_t mpu_get_num();
+mpu6050_t *mpu_get_by_num(size_t num);
+
+size_t mpu6050_init_all();
+size_t mpu6050_read_all(mpu6050_sample_t samples[], uint64_t *timestamp_us);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef RECORD_SCHEMA_H
+#define RECORD_SCHEMA_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "sensor_source.h"
+
+/**
+ * Esquemas de registro declarativos (X-macros).
+ *
+ * Um esquema é uma lista de campos X(tipo_c, nome, tipo_canal), por exemplo:
+ *
+ *   #define IMU_RECORD_FIELDS(X)              \
+ *       X(int16_t, accel_x, CHANNEL_INT16)    \
+ *       X(int32_t, roll, CHANNEL_INT32)
+ *
+ *   RECORD_DECLARE(imu_record_t, IMU_RECORD_FIELDS)
+ *   static const channel_desc_t imu_channels[] = RECORD_CHANNELS(IMU_RECORD_FIELDS);
+ *   RECORD_DEFINE_CSV_FORMATTER(imu_format_csv, imu_record_t, IMU_RECORD_FIELDS)
+ *
+ * A struct empacotada (layout do arquivo binário), a tabela de canais (da qual
+ * saem o cabeçalho do .csv e o descritor do arquivo binário) e a string de
+ * formato do .csv são geradas pelo pré-processador a partir da mesma lista, e
+ * por isso não podem divergir. Nada é interpretado em tempo de execução.
+ */
+
+#define RECORD_FIELD_DECLARE(ctype, name, chtype) ctype name;
+#define RECORD_FIELD_CHANNEL(ctype, name, chtype) {#name, chtype},
+#define RECORD_FIELD_SIZE(ctype, name, chtype) +sizeof(ctype)
+#define RECORD_FIELD_CHANNEL_SIZE(ctype, name, chtype) +RECORD_SIZE_##chtype
+#define RECORD_FIELD_CSV_FMT(ctype, name, chtype) RECORD_CSV_FMT_##chtype
+#define RECORD_FIELD_CSV_ARG(ctype, name, chtype) , RECORD_CSV_ARG_##chtype(rec->name)
+
+// Tamanho, formato e conversão de cada tipo de canal (ver channel_type_t)
+#define RECORD_SIZE_CHANNEL_INT16 2
+#define RECORD_SIZE_CHANNEL_UINT16 2
+#define RECORD_SIZE_CHANNEL_INT32 4
+#define RECORD_CSV_FMT_CHANNEL_INT16 ",%d"
+#define RECORD_CSV_FMT_CHANNEL_UINT16 ",%u"
+#define RECORD_CSV_FMT_CHANNEL_INT32 ",%ld"
+#define RECORD_CSV_ARG_CHANNEL_INT16(v) (int)(v)
+#define RECORD_CSV_ARG_CHANNEL_UINT16(v) (unsigned)(v)
+#define RECORD_CSV_ARG_CHANNEL_INT32(v) (long)(v)
+
+/**
+ * Declara a struct empacotada do registro. O tipo C de cada campo deve ter o
+ * tamanho do seu tipo de canal, o que é verificado em tempo de compilação.
+ */
+#define RECORD_DECLARE(type, FIELDS)                                              \
+    typedef struct __attribute__((packed)) {                                      \
+        FIELDS(RECORD_FIELD_DECLARE)                                              \
+    } type;                                                                       \
+    _Static_assert(sizeof(type) == 0 FIELDS(RECORD_FIELD_CHANNEL_SIZE),           \
+                   #type ": tipo C incompatível com o tipo de canal");           \
+    _Static_assert(sizeof(type) == 0 FIELDS(RECORD_FIELD_SIZE), #type ": preenchimento inesperado");
+
+// Inicializador da tabela channel_desc_t do registro
+#define RECORD_CHANNELS(FIELDS) {FIELDS(RECORD_FIELD_CHANNEL)}
+
+// Número de campos do registro (constante de compilação)
+#define RECORD_FIELD_ONE(ctype, name, chtype) +1
+#define RECORD_NUM_FIELDS(FIELDS) (0 FIELDS(RECORD_FIELD_ONE))
+
+// String de formato do .csv (ex.: ",%d,%d,%ld"), concatenada pelo compilador
+#define RECORD_CSV_FORMAT(FIELDS) "" FIELDS(RECORD_FIELD_CSV_FMT)
+
+/**
+ * Define fn(buf, size, rec): acrescenta os campos de rec ao buffer no formato
+ * ",v1,v2,...". Retorna o número de caracteres, como snprintf.
+ */
+#define RECORD_DEFINE_CSV_FORMATTER(fn, type, FIELDS)                             \
+    static inline int fn(char *buf, size_t size, const type *rec)                 \
+    {                                                                             \
+        return snprintf(buf, size, RECORD_CSV_FORMAT(FIELDS) FIELDS(RECORD_FIELD_CSV_ARG)); \
+    }
+
+#endif
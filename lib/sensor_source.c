@@ -0,0 +1,46 @@
+#include <stdio.h>
+
+#include "sensor_source.h"
+
+size_t channel_type_size(channel_type_t type)
+{
+    switch (type)
+    {
+    case CHANNEL_INT16:
+    case CHANNEL_UINT16:
+        return 2;
+    case CHANNEL_INT32:
+    default:
+        return 4;
+    }
+}
+
+/**
+ * @brief Tamanho, em bytes, de um frame (um valor de cada canal)
+ */
+size_t sensor_source_frame_size(const sensor_source_t *src)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < src->num_channels; ++i)
+        size += channel_type_size(src->channels[i].type);
+    return size;
+}
+
+/**
+ * @brief Inicializa todas as fontes registradas
+ * @return Número de fontes prontas para captura
+ */
+size_t sensor_source_init_all()
+{
+    size_t ready = 0;
+    for (size_t i = 0; i < sensor_source_get_num(); ++i)
+    {
+        sensor_source_t *src = sensor_source_get_by_num(i);
+        src->initialized = src->init(src) && src->num_channels > 0;
+        if (src->initialized)
+            ready++;
+        printf("Fonte %s: %s (%u canais)\n", src->name,
+               src->initialized ? "pronta" : "indisponível", (unsigned)src->num_channels);
+    }
+    return ready;
+}
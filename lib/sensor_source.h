@@ -0,0 +1,90 @@
+#ifndef SENSOR_SOURCE_H
+#define SENSOR_SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Interface genérica de fonte de dados do datalogger.
+ *
+ * Cada fonte descreve seus canais (esquema), entrega os dados em lotes de
+ * "frames" (um valor por canal, na ordem do esquema) e informa como seus
+ * instantes são obtidos. O pipeline de gravação (datalog.c) consome os lotes
+ * sem conhecer a fonte, e cada fonte usa internamente o caminho mais rápido
+ * que seu hardware oferece (rajada I2C, DMA, FIFO...).
+ */
+
+typedef enum {
+    CHANNEL_INT16,
+    CHANNEL_UINT16,
+    CHANNEL_INT32,
+} channel_type_t;
+
+typedef struct {
+    const char *name; // Nome da coluna no log
+    channel_type_t type;
+} channel_desc_t;
+
+typedef enum {
+    TIMESTAMP_SOFTWARE,     // Instante da leitura pela CPU, um por lote
+    TIMESTAMP_SAMPLE_CLOCK, // Derivado do relógio de amostragem do hardware (t0 + n * período)
+} timestamp_kind_t;
+
+typedef enum {
+    LOG_FORMAT_CSV,
+    LOG_FORMAT_BINARY,
+} log_format_t;
+
+typedef struct {
+    uint64_t first_index; // Índice do primeiro frame desde start()
+    uint64_t t0_us;       // Instante do primeiro frame (base de time_us_64)
+    uint32_t period_ns;   // Intervalo entre frames do lote (0 se há um único frame)
+    uint32_t dropped;     // Frames perdidos antes deste lote
+    size_t num_frames;
+    const void *data;     // num_frames * sensor_source_frame_size() bytes
+} sensor_batch_t;
+
+typedef struct sensor_source_t sensor_source_t;
+
+// "Classe" representando uma fonte de dados
+struct sensor_source_t {
+    const char *name;
+    const char *log_name;   // Arquivo de destino no cartão SD
+    log_format_t log_format;
+    timestamp_kind_t timestamp;
+
+    // Esquema de canais; preenchido por init() quando depende do hardware encontrado
+    const channel_desc_t *channels;
+    size_t num_channels;
+
+    bool (*init)(sensor_source_t *src);
+    void (*start)(sensor_source_t *src);
+    void (*stop)(sensor_source_t *src);
+    // Retorna o número de frames do lote (0 se não há dados novos)
+    size_t (*read_batch)(sensor_source_t *src, sensor_batch_t *batch);
+    // Opcional: formata os canais de um frame como ",v1,v2,..." (gerado pelo
+    // esquema do registro, ver record_schema.h). Sem ele, o datalog formata
+    // cada canal a partir de seu tipo.
+    int (*format_csv)(const sensor_source_t *src, const void *frame, char *buf, size_t size);
+
+    // Estado
+    bool initialized;
+};
+
+// Fontes disponíveis
+extern sensor_source_t mpu6050_source;
+extern sensor_source_t orientation_source;
+extern sensor_source_t adc_source;
+
+void orientation_source_print_stats();
+
+// Registro de fontes: definido em hw_config.c
+size_t sensor_source_get_num();
+sensor_source_t *sensor_source_get_by_num(size_t num);
+
+size_t sensor_source_init_all();
+size_t channel_type_size(channel_type_t type);
+size_t sensor_source_frame_size(const sensor_source_t *src);
+
+#endif
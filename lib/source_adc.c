@@ -0,0 +1,81 @@
+#include "pico/stdlib.h"
+
+#include "adc_capture.h"
+#include "sensor_source.h"
+
+/**
+ * Fonte "adc": captura contínua do ADC (ver adc_capture.c). Cada frame é uma
+ * volta do round robin (um valor por canal habilitado).
+ */
+
+// Eixos do joystick (GPIO26/27) e sensor de temperatura interno
+#ifndef ADC_CHANNEL_MASK
+#define ADC_CHANNEL_MASK ((1 << 0) | (1 << 1) | (1 << ADC_TEMP_CHANNEL))
+#endif
+
+// Taxa total, dividida entre os canais
+#ifndef ADC_SAMPLE_RATE_HZ
+#define ADC_SAMPLE_RATE_HZ 15000
+#endif
+
+static const char *const adc_names[5] = {"adc0", "adc1", "adc2", "adc3", "temp"};
+static channel_desc_t adc_channels[5];
+
+// Comporta o buffer circular inteiro: uma leitura por ciclo esvazia tudo
+static uint16_t adc_buffer[ADC_CAPTURE_RING_SAMPLES];
+
+static bool adc_source_init(sensor_source_t *src)
+{
+    if (!adc_capture_init(ADC_CHANNEL_MASK, ADC_SAMPLE_RATE_HZ))
+        return false;
+    size_t n = 0;
+    for (uint ch = 0; ch < 5; ch++)
+    {
+        if (!(adc_capture_channel_mask() & (1u << ch)))
+            continue;
+        adc_channels[n].name = adc_names[ch];
+        adc_channels[n].type = CHANNEL_UINT16;
+        n++;
+    }
+    src->channels = adc_channels;
+    src->num_channels = n;
+    return true;
+}
+
+static void adc_source_start(sensor_source_t *src)
+{
+    adc_capture_start();
+}
+
+static void adc_source_stop(sensor_source_t *src)
+{
+    adc_capture_stop();
+}
+
+static size_t adc_source_read_batch(sensor_source_t *src, sensor_batch_t *batch)
+{
+    adc_block_t block;
+    uint nch = adc_capture_num_channels();
+    size_t n = adc_capture_read(adc_buffer, ADC_CAPTURE_RING_SAMPLES, &block);
+    if (!n)
+        return 0;
+
+    batch->first_index = block.first_index / nch;
+    batch->t0_us = block.t0_us;
+    batch->period_ns = (uint32_t)((uint64_t)adc_capture_period_cycles() * nch * 1000 / (ADC_CAPTURE_CLOCK_HZ / 1000000));
+    batch->dropped = block.dropped / nch;
+    batch->num_frames = n / nch;
+    batch->data = adc_buffer;
+    return batch->num_frames;
+}
+
+sensor_source_t adc_source = {
+    .name = "adc",
+    .log_name = "adc_data.bin",
+    .log_format = LOG_FORMAT_BINARY,
+    .timestamp = TIMESTAMP_SAMPLE_CLOCK,
+    .init = adc_source_init,
+    .start = adc_source_start,
+    .stop = adc_source_stop,
+    .read_batch = adc_source_read_batch,
+};
@@ -0,0 +1,264 @@
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+
+#include "fusion.h"
+#include "mpu6050.h"
+#include "record_schema.h"
+#include "sensor_source.h"
+
+/**
+ * Fontes "mpu6050" (dados brutos de todos os sensores presentes, um frame por
+ * leitura) e "orientacao" (ângulos do filtro complementar, um frame a cada
+ * FUSION_LOG_DIVIDER leituras).
+ */
+
+#ifndef FUSION_LOG_DIVIDER
+#define FUSION_LOG_DIVIDER 10
+#endif
+
+// Registro de cada sensor, um por sensor presente no frame; com error = 1 a leitura
+// falhou e os demais campos são 0
+#define MPU6050_RECORD_FIELDS(X)        \
+    X(int16_t, accel_x, CHANNEL_INT16)  \
+    X(int16_t, accel_y, CHANNEL_INT16)  \
+    X(int16_t, accel_z, CHANNEL_INT16)  \
+    X(int16_t, gyro_x, CHANNEL_INT16)   \
+    X(int16_t, gyro_y, CHANNEL_INT16)   \
+    X(int16_t, gyro_z, CHANNEL_INT16)   \
+    X(int16_t, temp, CHANNEL_INT16)     \
+    X(uint16_t, error, CHANNEL_UINT16)
+
+#define ORIENT_RECORD_FIELDS(X)           \
+    X(int32_t, roll_mdeg, CHANNEL_INT32)  \
+    X(int32_t, pitch_mdeg, CHANNEL_INT32) \
+    X(int32_t, yaw_mdeg, CHANNEL_INT32)
+
+RECORD_DECLARE(mpu6050_record_t, MPU6050_RECORD_FIELDS)
+RECORD_DECLARE(orient_record_t, ORIENT_RECORD_FIELDS)
+RECORD_DEFINE_CSV_FORMATTER(mpu6050_record_csv, mpu6050_record_t, MPU6050_RECORD_FIELDS)
+RECORD_DEFINE_CSV_FORMATTER(orient_record_csv, orient_record_t, ORIENT_RECORD_FIELDS)
+
+#define MPU_CHANNELS_PER_SENSOR RECORD_NUM_FIELDS(MPU6050_RECORD_FIELDS)
+#define ORIENT_CHANNELS_PER_SENSOR RECORD_NUM_FIELDS(ORIENT_RECORD_FIELDS)
+#define CHANNEL_NAME_LEN 24
+
+static const channel_desc_t mpu6050_record_channels[] = RECORD_CHANNELS(MPU6050_RECORD_FIELDS);
+static const channel_desc_t orient_record_channels[] = RECORD_CHANNELS(ORIENT_RECORD_FIELDS);
+
+static channel_desc_t mpu_channels[MPU_MAX_SENSORS * MPU_CHANNELS_PER_SENSOR];
+static char mpu_names[MPU_MAX_SENSORS * MPU_CHANNELS_PER_SENSOR][CHANNEL_NAME_LEN];
+static channel_desc_t orient_channels[MPU_MAX_SENSORS * ORIENT_CHANNELS_PER_SENSOR];
+static char orient_names[MPU_MAX_SENSORS * ORIENT_CHANNELS_PER_SENSOR][CHANNEL_NAME_LEN];
+
+static mpu6050_record_t mpu_frame[MPU_MAX_SENSORS];
+static orient_record_t orient_frame[MPU_MAX_SENSORS];
+
+static fusion_t fusion[MPU_MAX_SENSORS];
+static uint32_t read_errors[MPU_MAX_SENSORS];
+static uint64_t sample_count;
+static uint64_t orient_count;
+static uint64_t orient_t_us;
+static bool orient_pending;
+
+/**
+ * @brief Repete o esquema do registro para cada sensor presente, com colunas "<sensor>_<campo>"
+ */
+static size_t build_schema(channel_desc_t *channels, char names[][CHANNEL_NAME_LEN],
+                           const channel_desc_t *record, size_t num_fields)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < mpu_get_num() && i < MPU_MAX_SENSORS; ++i)
+    {
+        mpu6050_t *mpu = mpu_get_by_num(i);
+        if (!mpu->present)
+            continue;
+        for (size_t c = 0; c < num_fields; ++c, ++n)
+        {
+            snprintf(names[n], CHANNEL_NAME_LEN, "%s_%s", mpu->name, record[c].name);
+            channels[n].name = names[n];
+            channels[n].type = record[c].type;
+        }
+    }
+    return n;
+}
+
+static bool mpu_source_init(sensor_source_t *src)
+{
+    if (mpu6050_init_all() == 0)
+        return false;
+    src->channels = mpu_channels;
+    src->num_channels = build_schema(mpu_channels, mpu_names, mpu6050_record_channels, MPU_CHANNELS_PER_SENSOR);
+    return true;
+}
+
+static void mpu_source_start(sensor_source_t *src)
+{
+    sample_count = 0;
+    orient_count = 0;
+    orient_pending = false;
+    for (size_t i = 0; i < MPU_MAX_SENSORS; ++i)
+    {
+        fusion_init(&fusion[i]);
+        read_errors[i] = 0;
+    }
+}
+
+static void mpu_source_stop(sensor_source_t *src)
+{
+}
+
+/**
+ * @brief Lê todos os sensores (em paralelo entre barramentos) e atualiza a orientação
+ *
+ * Um sensor cuja leitura falhou entra no frame marcado (error = 1) e fica fora do
+ * filtro: a orientação dele continua a da última leitura válida.
+ */
+static size_t mpu_source_read_batch(sensor_source_t *src, sensor_batch_t *batch)
+{
+    mpu6050_sample_t samples[MPU_MAX_SENSORS];
+    uint64_t t_us;
+    size_t k = 0;
+
+    mpu6050_read_all(samples, &t_us);
+    sample_count++;
+    bool log_orientation = (sample_count % FUSION_LOG_DIVIDER) == 0;
+
+    for (size_t i = 0; i < mpu_get_num() && i < MPU_MAX_SENSORS; ++i)
+    {
+        if (!mpu_get_by_num(i)->present)
+            continue;
+        mpu6050_sample_t *s = &samples[i];
+        bool error = mpu_get_by_num(i)->error;
+        if (error)
+            read_errors[i]++;
+        else
+            fusion_update(&fusion[i], s->accel, s->gyro, t_us);
+
+        mpu_frame[k] = (mpu6050_record_t){
+            .accel_x = s->accel[0], .accel_y = s->accel[1], .accel_z = s->accel[2],
+            .gyro_x = s->gyro[0], .gyro_y = s->gyro[1], .gyro_z = s->gyro[2],
+            .temp = s->temp, .error = error,
+        };
+        if (log_orientation)
+        {
+            orient_frame[k] = (orient_record_t){
+                .roll_mdeg = fusion[i].roll, .pitch_mdeg = fusion[i].pitch, .yaw_mdeg = fusion[i].yaw,
+            };
+        }
+        k++;
+    }
+    if (log_orientation)
+    {
+        orient_pending = true;
+        orient_t_us = t_us;
+    }
+
+    batch->first_index = sample_count - 1;
+    batch->t0_us = t_us;
+    batch->period_ns = 0;
+    batch->dropped = 0;
+    batch->num_frames = 1;
+    batch->data = mpu_frame;
+    return 1;
+}
+
+static int mpu_source_format_csv(const sensor_source_t *src, const void *frame, char *buf, size_t size)
+{
+    const mpu6050_record_t *rec = frame;
+    size_t len = 0;
+    for (size_t i = 0; i < src->num_channels / MPU_CHANNELS_PER_SENSOR && len < size; ++i)
+        len += mpu6050_record_csv(buf + len, size - len, &rec[i]);
+    return (int)len;
+}
+
+sensor_source_t mpu6050_source = {
+    .name = "mpu6050",
+    .log_name = "mpu_data.csv",
+    .log_format = LOG_FORMAT_CSV,
+    .timestamp = TIMESTAMP_SOFTWARE,
+    .init = mpu_source_init,
+    .start = mpu_source_start,
+    .stop = mpu_source_stop,
+    .read_batch = mpu_source_read_batch,
+    .format_csv = mpu_source_format_csv,
+};
+
+static bool orient_source_init(sensor_source_t *src)
+{
+    // Depende da fonte mpu6050, que deve vir antes no registro
+    if (!mpu6050_source.initialized)
+        return false;
+    src->channels = orient_channels;
+    src->num_channels = build_schema(orient_channels, orient_names, orient_record_channels, ORIENT_CHANNELS_PER_SENSOR);
+    return true;
+}
+
+static void orient_source_start(sensor_source_t *src)
+{
+}
+
+static void orient_source_stop(sensor_source_t *src)
+{
+}
+
+static size_t orient_source_read_batch(sensor_source_t *src, sensor_batch_t *batch)
+{
+    if (!orient_pending)
+        return 0;
+    orient_pending = false;
+
+    batch->first_index = orient_count++;
+    batch->t0_us = orient_t_us;
+    batch->period_ns = 0;
+    batch->dropped = 0;
+    batch->num_frames = 1;
+    batch->data = orient_frame;
+    return 1;
+}
+
+static int orient_source_format_csv(const sensor_source_t *src, const void *frame, char *buf, size_t size)
+{
+    const orient_record_t *rec = frame;
+    size_t len = 0;
+    for (size_t i = 0; i < src->num_channels / ORIENT_CHANNELS_PER_SENSOR && len < size; ++i)
+        len += orient_record_csv(buf + len, size - len, &rec[i]);
+    return (int)len;
+}
+
+sensor_source_t orientation_source = {
+    .name = "orientacao",
+    .log_name = "ori_data.csv",
+    .log_format = LOG_FORMAT_CSV,
+    .timestamp = TIMESTAMP_SOFTWARE,
+    .init = orient_source_init,
+    .start = orient_source_start,
+    .stop = orient_source_stop,
+    .read_batch = orient_source_read_batch,
+    .format_csv = orient_source_format_csv,
+};
+
+/**
+ * @brief Exibe no terminal as leituras com erro de cada sensor e o custo medido do filtro
+ * de orientação
+ */
+void orientation_source_print_stats()
+{
+    uint32_t clk = clock_get_hz(clk_sys);
+    for (size_t i = 0; i < mpu_get_num() && i < MPU_MAX_SENSORS; ++i)
+    {
+        if (read_errors[i])
+            printf("[AVISO] %s: %lu leituras com erro (marcadas com error = 1 em mpu_data.csv)\n",
+                   mpu_get_by_num(i)->name, (unsigned long)read_errors[i]);
+        if (!fusion[i].updates)
+            continue;
+        printf("Filtro de orientação (%s): %lu atualizações, média %lu ciclos, máx %lu ciclos (~%lu Hz sustentáveis a %lu MHz)\n",
+               mpu_get_by_num(i)->name,
+               (unsigned long)fusion[i].updates,
+               (unsigned long)fusion_cycles_avg(&fusion[i]),
+               (unsigned long)fusion[i].cycles_max,
+               (unsigned long)fusion_max_rate_hz(&fusion[i], clk),
+               (unsigned long)(clk / 1000000));
+    }
+}
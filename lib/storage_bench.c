@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "f_util.h"
+#include "storage_bench.h"
+
+// Tamanhos de escrita, em bytes
+static const uint32_t bench_sizes[] = {16, 64, 256, 512, 1024, 4096, 16384, 65536};
+#define BENCH_MAX_SIZE 65536
+
+typedef enum
+{
+    BENCH_FWRITE,
+    BENCH_FWRITE_RANDOM,
+    BENCH_RAW,
+    BENCH_RAW_RANDOM,
+} bench_kind_t;
+
+#define BENCH_PREALLOC 0x1
+#define BENCH_BUFFERED 0x2
+#define BENCH_SYNC 0x4
+
+typedef struct
+{
+    const char *name;
+    bench_kind_t kind;
+    unsigned flags;
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+    {"f_write", BENCH_FWRITE, 0},
+    {"f_write", BENCH_FWRITE, BENCH_PREALLOC},
+    {"f_write", BENCH_FWRITE, BENCH_BUFFERED},
+    {"f_write", BENCH_FWRITE, BENCH_PREALLOC | BENCH_BUFFERED},
+    {"f_write", BENCH_FWRITE, BENCH_SYNC},
+    {"f_write", BENCH_FWRITE, BENCH_PREALLOC | BENCH_SYNC},
+    {"f_write", BENCH_FWRITE, BENCH_BUFFERED | BENCH_SYNC},
+    {"f_write", BENCH_FWRITE, BENCH_PREALLOC | BENCH_BUFFERED | BENCH_SYNC},
+    {"f_write_random", BENCH_FWRITE_RANDOM, BENCH_PREALLOC},
+    {"raw", BENCH_RAW, BENCH_PREALLOC},
+    {"raw_random", BENCH_RAW_RANDOM, BENCH_PREALLOC},
+};
+
+// Estado de uma medição
+typedef struct
+{
+    sd_card_t *sd;
+    const bench_case_t *c;
+    uint32_t size;
+    uint32_t ops;
+    uint32_t done;          // Chamadas concluídas
+    const uint8_t *data;    // BENCH_MAX_SIZE bytes
+    uint8_t *buf;           // Buffer da aplicação (BENCH_BUFFERED)
+    uint32_t buf_len;
+    uint32_t *lat_us;       // Latência de cada chamada
+    uint32_t rng;
+} bench_run_t;
+
+static uint32_t bench_rand(bench_run_t *r)
+{
+    // xorshift32: a mesma sequência em todas as plataformas
+    r->rng ^= r->rng << 13;
+    r->rng ^= r->rng >> 17;
+    r->rng ^= r->rng << 5;
+    return r->rng;
+}
+
+static FRESULT file_write(bench_run_t *r, FIL *fp, const void *data, UINT len)
+{
+    UINT bw;
+    FRESULT res = f_write(fp, data, len, &bw);
+    if (res == FR_OK && bw != len)
+        res = FR_DENIED; // Cartão cheio
+    if (res == FR_OK && (r->c->flags & BENCH_SYNC))
+        res = f_sync(fp);
+    return res;
+}
+
+static FRESULT flush_buffer(bench_run_t *r, FIL *fp)
+{
+    FRESULT res = r->buf_len ? file_write(r, fp, r->buf, r->buf_len) : FR_OK;
+    r->buf_len = 0;
+    return res;
+}
+
+// Uma chamada de escrita da aplicação, como no datalog: pelo buffer ou direto ao f_write
+static FRESULT app_write(bench_run_t *r, FIL *fp, const void *data, UINT len)
+{
+    if (!(r->c->flags & BENCH_BUFFERED))
+        return file_write(r, fp, data, len);
+    FRESULT res = FR_OK;
+    if (r->buf_len + len > STORAGE_BENCH_BUF_BYTES)
+        res = flush_buffer(r, fp);
+    if (res != FR_OK)
+        return res;
+    if (len >= STORAGE_BENCH_BUF_BYTES)
+        return file_write(r, fp, data, len);
+    memcpy(r->buf + r->buf_len, data, len);
+    r->buf_len += len;
+    return FR_OK;
+}
+
+static FRESULT run_fwrite(bench_run_t *r, const char *path)
+{
+    FIL fil;
+    FRESULT res = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK)
+        return res;
+    uint64_t bytes = (uint64_t)r->ops * r->size;
+    if (r->c->flags & BENCH_PREALLOC)
+        res = f_expand(&fil, bytes, 1);
+    for (uint32_t i = 0; i < r->ops && res == FR_OK; ++i)
+    {
+        uint64_t t0 = time_us_64();
+        if (r->c->kind == BENCH_FWRITE_RANDOM)
+            res = f_lseek(&fil, (FSIZE_t)(bench_rand(r) % r->ops) * r->size);
+        if (res == FR_OK)
+            res = app_write(r, &fil, r->data + (i * 512u) % (BENCH_MAX_SIZE - r->size + 1), r->size);
+        r->lat_us[i] = (uint32_t)(time_us_64() - t0);
+        if (res == FR_OK)
+            r->done++;
+    }
+    if (res == FR_OK)
+        res = flush_buffer(r, &fil);
+    FRESULT rc = f_close(&fil);
+    return res != FR_OK ? res : rc;
+}
+
+static FRESULT run_raw(bench_run_t *r, const char *path)
+{
+    FIL fil;
+    FRESULT res = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK)
+        return res;
+    // Os setores de um arquivo contíguo: a escrita direta não atinge o sistema de arquivos
+    uint32_t sectors = r->size / 512;
+    res = f_expand(&fil, (FSIZE_t)r->ops * r->size, 1);
+    if (res == FR_OK)
+    {
+        FATFS *fs = fil.obj.fs;
+        LBA_t lba = fs->database + (LBA_t)(fil.obj.sclust - 2) * fs->csize;
+        for (uint32_t i = 0; i < r->ops && res == FR_OK; ++i)
+        {
+            uint32_t slot = r->c->kind == BENCH_RAW_RANDOM ? bench_rand(r) % r->ops : i;
+            uint64_t t0 = time_us_64();
+            if (r->sd->write_blocks(r->sd, r->data, lba + (LBA_t)slot * sectors, sectors) !=
+                SD_BLOCK_DEVICE_ERROR_NONE)
+                res = FR_DISK_ERR;
+            r->lat_us[i] = (uint32_t)(time_us_64() - t0);
+            if (res == FR_OK)
+                r->done++;
+        }
+    }
+    FRESULT rc = f_close(&fil);
+    return res != FR_OK ? res : rc;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Percentil p (0..100) por posto mais próximo; lat ordenado
+static uint32_t percentile(const uint32_t *lat, uint32_t n, uint32_t p)
+{
+    if (!n)
+        return 0;
+    uint32_t rank = (p * n + 99) / 100;
+    return lat[rank ? rank - 1 : 0];
+}
+
+FRESULT storage_bench_run(sd_card_t *sd, const char *platform, storage_bench_put_t put, void *context)
+{
+    bench_run_t r = {.sd = sd};
+    uint8_t *data = malloc(BENCH_MAX_SIZE);
+    r.buf = malloc(STORAGE_BENCH_BUF_BYTES);
+    r.lat_us = malloc(STORAGE_BENCH_MAX_OPS * sizeof *r.lat_us);
+    if (!data || !r.buf || !r.lat_us)
+    {
+        free(data);
+        free(r.buf);
+        free(r.lat_us);
+        return FR_NOT_ENOUGH_CORE;
+    }
+    for (uint32_t i = 0; i < BENCH_MAX_SIZE; ++i)
+        data[i] = (uint8_t)(i * 7 + (i >> 8));
+    r.data = data;
+
+    char path[32], line[192];
+    snprintf(path, sizeof path, "%sbench.dat", sd->pcName);
+    put(context, "platform,card,test,size,prealloc,buffered,sync,ops,bytes,total_us,kb_s,"
+                 "p50_us,p90_us,p99_us,max_us,result");
+    FRESULT res = FR_OK;
+    for (size_t ci = 0; ci < count_of(bench_cases) && res == FR_OK; ++ci)
+    {
+        r.c = &bench_cases[ci];
+        bool raw = r.c->kind == BENCH_RAW || r.c->kind == BENCH_RAW_RANDOM;
+        for (size_t si = 0; si < count_of(bench_sizes); ++si)
+        {
+            r.size = bench_sizes[si];
+            if (raw && r.size % 512)
+                continue; // Só blocos inteiros
+            uint32_t max_ops = (r.c->flags & BENCH_SYNC) ? STORAGE_BENCH_SYNC_OPS : STORAGE_BENCH_MAX_OPS;
+            r.ops = STORAGE_BENCH_RUN_BYTES / r.size;
+            if (r.ops > max_ops)
+                r.ops = max_ops;
+            if (!r.ops)
+                r.ops = 1;
+            r.done = 0;
+            r.buf_len = 0;
+            r.rng = 0x2545F491u;
+
+            uint64_t t0 = time_us_64();
+            FRESULT rc = raw ? run_raw(&r, path) : run_fwrite(&r, path);
+            uint64_t total = time_us_64() - t0;
+            f_unlink(path);
+
+            uint64_t bytes = (uint64_t)r.done * r.size;
+            qsort(r.lat_us, r.done, sizeof *r.lat_us, compare_u32);
+            snprintf(line, sizeof line, "%s,%s,%s,%lu,%u,%u,%u,%lu,%llu,%llu,%lu,%lu,%lu,%lu,%lu,%s",
+                     platform, sd->pcName, r.c->name, (unsigned long)r.size,
+                     !!(r.c->flags & BENCH_PREALLOC), !!(r.c->flags & BENCH_BUFFERED),
+                     !!(r.c->flags & BENCH_SYNC), (unsigned long)r.done,
+                     (unsigned long long)bytes, (unsigned long long)total,
+                     (unsigned long)(total ? bytes * 1000000 / 1024 / total : 0),
+                     (unsigned long)percentile(r.lat_us, r.done, 50),
+                     (unsigned long)percentile(r.lat_us, r.done, 90),
+                     (unsigned long)percentile(r.lat_us, r.done, 99),
+                     (unsigned long)(r.done ? r.lat_us[r.done - 1] : 0), rc == FR_OK ? "ok" : FRESULT_str(rc));
+            put(context, line);
+            // Cartão com erro ou cheio: as próximas medições não valeriam
+            if (rc != FR_OK && rc != FR_DENIED)
+                res = rc;
+        }
+    }
+    free(data);
+    free(r.buf);
+    free(r.lat_us);
+    return res;
+}
@@ -0,0 +1,47 @@
+#ifndef STORAGE_BENCH_H
+#define STORAGE_BENCH_H
+
+#include "ff.h"
+#include "sd_card.h"
+
+/**
+ * Benchmark do caminho de gravação, igual no RP2040 (comando 'b' no terminal
+ * USB) e no host (host/bench_host.c, com ou sem o modelo de tempo do cartão).
+ *
+ * Para cada tamanho de escrita de 16 B a 64 KB mede vazão e latência por
+ * chamada (p50, p90, p99 e máxima) de:
+ *  - f_write sequencial, com e sem reserva (f_expand), buffer na aplicação
+ *    (STORAGE_BENCH_BUF_BYTES, só o que enche o buffer chega ao f_write) e
+ *    f_sync após cada f_write;
+ *  - f_write em posições aleatórias de um arquivo reservado;
+ *  - write_blocks direto no cartão, sequencial e aleatório (tamanhos
+ *    múltiplos de 512), nos setores de um arquivo contíguo reservado.
+ *
+ * Cada medição vira uma linha CSV (a primeira é o cabeçalho), entregue a
+ * put(context, linha) fora do trecho medido. A vazão inclui o fechamento do
+ * arquivo (esvaziar o buffer, f_close). Os arquivos de teste são apagados.
+ */
+
+// Bytes gravados por medição; cada uma faz no máximo STORAGE_BENCH_MAX_OPS chamadas
+#ifndef STORAGE_BENCH_RUN_BYTES
+#define STORAGE_BENCH_RUN_BYTES (1024 * 1024)
+#endif
+#ifndef STORAGE_BENCH_MAX_OPS
+#define STORAGE_BENCH_MAX_OPS 2048
+#endif
+// Com f_sync a cada escrita
+#ifndef STORAGE_BENCH_SYNC_OPS
+#define STORAGE_BENCH_SYNC_OPS 256
+#endif
+#ifndef STORAGE_BENCH_BUF_BYTES
+#define STORAGE_BENCH_BUF_BYTES (8 * 1024)
+#endif
+
+typedef void (*storage_bench_put_t)(void *context, const char *line);
+
+/* Executa a bateria no cartão montado sd. platform identifica a máquina no
+ * relatório ("rp2040", "host"...). Os buffers vêm do heap (malloc) e são
+ * liberados no fim: FR_NOT_ENOUGH_CORE se não houver memória. */
+FRESULT storage_bench_run(sd_card_t *sd, const char *platform, storage_bench_put_t put, void *context);
+
+#endif
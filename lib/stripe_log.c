@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "f_util.h"
+#include "crc.h"
+#include "hw_config.h"
+
+#include "stripe_log.h"
+
+_Static_assert(sizeof(stripe_log_manifest_t) == 24 + STRIPE_LOG_MANIFEST_PARTS * STRIPE_LOG_PART_NAME_LEN,
+               "stripe_log_manifest_t sem preenchimento");
+_Static_assert(sizeof(stripe_log_trailer_t) == 16, "stripe_log_trailer_t deve ter 16 bytes");
+_Static_assert(STRIPE_LOG_MAX_CARDS <= STRIPE_LOG_MANIFEST_PARTS, "STRIPE_LOG_MAX_CARDS grande demais");
+_Static_assert(STRIPE_LOG_PREALLOC_BYTES % STRIPE_LOG_UNIT_BYTES == 0,
+               "A reserva deve ser múltipla da faixa");
+
+size_t stripe_log_num_cards()
+{
+    size_t n = 0;
+    for (size_t i = 0; i < sd_get_num(); ++i)
+        if (sd_get_by_num(i)->mounted)
+            ++n;
+    return n;
+}
+
+/**
+ * @brief Fim de uma escrita assíncrona; chamada em contexto de interrupção
+ */
+static void write_done(sd_card_t *sd, int status, void *context)
+{
+    stripe_log_part_t *p = context;
+    p->status = status;
+    p->busy = false;
+}
+
+static FRESULT wait_part(stripe_log_part_t *p)
+{
+    if (p->busy)
+        sd_async_wait(p->sd);
+    if (p->status != SD_BLOCK_DEVICE_ERROR_NONE && p->retry_buf)
+    {
+        // A escrita assíncrona não se recupera sozinha: repete pela bloqueante, que tenta de novo,
+        // reduz o clock e reinicializa o cartão antes de desistir
+        p->status = p->sd->write_blocks(p->sd, p->retry_buf, p->retry_lba, p->retry_sectors);
+    }
+    p->retry_buf = NULL;
+    return p->status == SD_BLOCK_DEVICE_ERROR_NONE ? FR_OK : FR_DISK_ERR;
+}
+
+// Bytes de dados por faixa: no modo espelhado o fim da faixa é o trailer
+static uint32_t unit_payload(const stripe_log_t *sl)
+{
+    return sl->mode == STRIPE_LOG_MIRRORED ? STRIPE_LOG_UNIT_BYTES - sizeof(stripe_log_trailer_t)
+                                           : STRIPE_LOG_UNIT_BYTES;
+}
+
+/**
+ * @brief Inicia a gravação do buffer no fim do arquivo do cartão
+ *
+ * Só espera se a escrita anterior deste cartão ainda estiver em andamento;
+ * esta segue em segundo plano (DMA) enquanto a próxima faixa é preenchida.
+ */
+static FRESULT start_write(stripe_log_part_t *p, const uint8_t *buf, uint32_t sectors, uint32_t bytes)
+{
+    FRESULT res = wait_part(p);
+    if (res != FR_OK)
+        return res;
+    if (p->written + sectors > p->sectors)
+        return FR_DENIED; // Não ocorre: submit() passa antes ao próximo trecho
+    int rc;
+    if (p->sd->write_blocks_async)
+    {
+        p->busy = true;
+        rc = p->sd->write_blocks_async(p->sd, buf, p->lba + p->written, sectors, write_done, p);
+        if (rc != SD_BLOCK_DEVICE_ERROR_NONE)
+        {
+            p->busy = false; // A escrita não começou: write_done não será chamada
+            rc = p->sd->write_blocks(p->sd, buf, p->lba + p->written, sectors);
+        }
+        else
+        {
+            // O buffer não muda até a próxima espera deste cartão: serve para repetir a escrita
+            p->retry_buf = buf;
+            p->retry_lba = p->lba + p->written;
+            p->retry_sectors = sectors;
+        }
+    }
+    else
+    {
+        // Interface sem modo assíncrono (SD_IF_SDIO): grava e espera
+        rc = p->sd->write_blocks(p->sd, buf, p->lba + p->written, sectors);
+    }
+    if (rc != SD_BLOCK_DEVICE_ERROR_NONE)
+        return FR_DISK_ERR;
+    p->written += sectors;
+    p->bytes += bytes;
+    return FR_OK;
+}
+
+// A faixa não cabe no que resta da reserva do cartão da vez (espelhado: de
+// qualquer cartão em uso, pois todos gravam o mesmo)
+static bool extent_full(const stripe_log_t *sl, uint32_t sectors)
+{
+    for (size_t i = 0; i < sl->num_cards; ++i)
+    {
+        const stripe_log_part_t *p = &sl->parts[i];
+        if ((sl->mode == STRIPE_LOG_MIRRORED || i == sl->next_card) && !p->failed &&
+            p->written + sectors > p->sectors)
+            return true;
+    }
+    return false;
+}
+
+static FRESULT next_extent(stripe_log_t *sl);
+
+/**
+ * @brief Grava a faixa preenchida: no cartão da vez (em faixas) ou em todos (espelhado)
+ */
+static FRESULT submit(stripe_log_t *sl, uint32_t sectors, uint32_t bytes)
+{
+    FRESULT res = FR_OK;
+    if (!sl->num_cards)
+        return FR_INVALID_OBJECT; // Fechado por um erro ao passar de trecho
+    if (extent_full(sl, sectors))
+    {
+        res = next_extent(sl);
+        if (res != FR_OK)
+            return res;
+    }
+    stripe_log_part_t *p = &sl->parts[sl->next_card];
+    uint8_t *buf = (uint8_t *)p->buf[p->next_buf];
+    if (sl->mode == STRIPE_LOG_STRIPED)
+    {
+        res = start_write(p, buf, sectors, bytes);
+        if (res != FR_OK)
+            return res;
+        p->next_buf ^= 1;
+        sl->next_card = (sl->next_card + 1) % sl->num_cards;
+    }
+    else
+    {
+        // Faixa sempre inteira, com o trailer no fim; o buffer é o mesmo para todos os cartões
+        stripe_log_trailer_t trailer = {
+            .magic = STRIPE_LOG_TRAILER_MAGIC,
+            .seq = sl->seq,
+            .len = (uint16_t)sl->fill,
+            .crc = crc16((const char *)buf, sl->fill),
+        };
+        memset(buf + sl->fill, 0, unit_payload(sl) - sl->fill);
+        memcpy(buf + unit_payload(sl), &trailer, sizeof trailer);
+        size_t ok = 0;
+        for (size_t i = 0; i < sl->num_cards; ++i)
+        {
+            stripe_log_part_t *m = &sl->parts[i];
+            if (m->failed)
+                continue;
+            FRESULT r = start_write(m, buf, STRIPE_LOG_UNIT_SECTORS, STRIPE_LOG_UNIT_BYTES);
+            if (r != FR_OK)
+            {
+                printf("[AVISO] cartão %s abandonado no espelho: %s (%d)\n", m->sd->pcName, FRESULT_str(r), r);
+                m->failed = true;
+                res = r;
+                continue;
+            }
+            ++ok;
+        }
+        if (!ok)
+            return res; // Nenhuma cópia
+        p->next_buf ^= 1;
+    }
+    sl->total_bytes += bytes;
+    sl->fill = 0;
+    ++sl->seq;
+    return FR_OK;
+}
+
+/* Nomes dos arquivos: stripe_log_open() limita o nome a STRIPE_LOG_NAME_MAX
+ * caracteres; a precisão dos "%.*s" repete o limite para o compilador, que
+ * então vê que os nomes cabem. */
+
+// Nome do arquivo do cartão i no trecho atual, "<nome>.s<i>" ou
+// "<nome>.<trecho>.s<i>"; false se não couber em size
+static bool part_name(const stripe_log_t *sl, uint8_t i, char *buf, size_t size)
+{
+    int n;
+    if (sl->extent)
+        n = snprintf(buf, size, "%.*s.%u.s%u", STRIPE_LOG_NAME_MAX, sl->name, (unsigned)sl->extent, i);
+    else
+        n = snprintf(buf, size, "%.*s.s%u", STRIPE_LOG_NAME_MAX, sl->name, i);
+    return n > 0 && (size_t)n < size;
+}
+
+// Manifesto do trecho atual: "<nome>.man" ou "<nome>.<trecho>.man"
+static bool manifest_name(const stripe_log_t *sl, const sd_card_t *sd, char *buf, size_t size)
+{
+    int n;
+    if (sl->extent)
+        n = snprintf(buf, size, "%s%.*s.%u.man", sd->pcName, STRIPE_LOG_NAME_MAX, sl->name, (unsigned)sl->extent);
+    else
+        n = snprintf(buf, size, "%s%.*s.man", sd->pcName, STRIPE_LOG_NAME_MAX, sl->name);
+    return n > 0 && (size_t)n < size;
+}
+
+/**
+ * @brief Cria o arquivo do cartão i no trecho atual e reserva sua área contígua
+ */
+static FRESULT open_part(stripe_log_t *sl, size_t i, sd_card_t *sd)
+{
+    stripe_log_part_t *p = &sl->parts[i];
+    char part[STRIPE_LOG_PART_NAME_LEN], path[8 + STRIPE_LOG_PART_NAME_LEN];
+    part_name(sl, i, part, sizeof part);
+    snprintf(path, sizeof path, "%s%s", sd->pcName, part);
+    FRESULT res = f_open(&p->fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res == FR_OK)
+    {
+        // As faixas são gravadas direto nos setores: a área precisa ser contígua
+        res = f_expand(&p->fil, STRIPE_LOG_PREALLOC_BYTES, 1);
+        if (res != FR_OK)
+            f_close(&p->fil);
+    }
+    if (res != FR_OK)
+    {
+        printf("[ERRO] %s: %s (%d)\n", path, FRESULT_str(res), res);
+        return res;
+    }
+    FATFS *fs = p->fil.obj.fs;
+    p->sd = sd;
+    p->lba = fs->database + (LBA_t)(p->fil.obj.sclust - 2) * fs->csize;
+    p->sectors = STRIPE_LOG_PREALLOC_BYTES / FF_MAX_SS;
+    p->written = 0;
+    p->bytes = 0;
+    p->busy = false;
+    p->status = SD_BLOCK_DEVICE_ERROR_NONE;
+    p->retry_buf = NULL;
+    // Tira do cache do disco cópias antigas desses setores e deixa a área já apagada
+    LBA_t range[2] = {p->lba, p->lba + p->sectors - 1};
+    disk_ioctl(fs->pdrv, CTRL_TRIM, range);
+    return FR_OK;
+}
+
+static void close_parts(stripe_log_t *sl)
+{
+    for (size_t i = 0; i < sl->num_cards; ++i)
+    {
+        wait_part(&sl->parts[i]);
+        f_close(&sl->parts[i].fil);
+    }
+    sl->num_cards = 0;
+}
+
+/**
+ * @brief Abre um arquivo "<nome>.s<i>" em cada cartão montado e reserva sua área contígua
+ */
+FRESULT stripe_log_open(stripe_log_t *sl, const char *name, stripe_log_mode_t mode)
+{
+    sl->mode = mode;
+    sl->seq = 0;
+    sl->num_cards = 0;
+    sl->next_card = 0;
+    sl->fill = 0;
+    sl->extent = 0;
+    sl->total_bytes = 0;
+    if (strlen(name) > STRIPE_LOG_NAME_MAX)
+        return FR_INVALID_NAME;
+    strcpy(sl->name, name);
+
+    for (size_t i = 0; i < sd_get_num() && sl->num_cards < STRIPE_LOG_MAX_CARDS; ++i)
+    {
+        sd_card_t *sd = sd_get_by_num(i);
+        if (!sd->mounted)
+            continue;
+        FRESULT res = open_part(sl, sl->num_cards, sd);
+        if (res != FR_OK)
+        {
+            close_parts(sl);
+            return res;
+        }
+        sl->parts[sl->num_cards].failed = false;
+        sl->parts[sl->num_cards].next_buf = 0;
+        ++sl->num_cards;
+    }
+    if (sl->num_cards < 2)
+    {
+        close_parts(sl);
+        return FR_INVALID_DRIVE;
+    }
+    return FR_OK;
+}
+
+/**
+ * @brief Acrescenta dados ao fluxo; cada faixa completa é enviada ao seu cartão
+ */
+FRESULT stripe_log_write(stripe_log_t *sl, const void *data, UINT len, UINT *bw)
+{
+    const uint8_t *src = data;
+    *bw = 0;
+    while (len)
+    {
+        stripe_log_part_t *p = &sl->parts[sl->next_card];
+        UINT n = unit_payload(sl) - sl->fill;
+        if (n > len)
+            n = len;
+        memcpy((uint8_t *)p->buf[p->next_buf] + sl->fill, src, n);
+        sl->fill += n;
+        src += n;
+        len -= n;
+        *bw += n;
+        if (sl->fill == unit_payload(sl))
+        {
+            FRESULT res = submit(sl, STRIPE_LOG_UNIT_SECTORS, sl->fill);
+            if (res != FR_OK)
+                return res;
+        }
+    }
+    return FR_OK;
+}
+
+/**
+ * @brief Grava o manifesto em cada cartão em uso: qualquer um deles descreve a gravação
+ */
+static FRESULT write_manifest(const stripe_log_t *sl)
+{
+    stripe_log_manifest_t man = {
+        .magic = STRIPE_LOG_MANIFEST_MAGIC,
+        .version = STRIPE_LOG_MANIFEST_VERSION,
+        .num_cards = sl->num_cards,
+        .unit_bytes = STRIPE_LOG_UNIT_BYTES,
+        .mode = sl->mode,
+        .extent = sl->extent,
+        .total_bytes = sl->total_bytes,
+    };
+    for (size_t i = 0; i < sl->num_cards; ++i)
+        if (!part_name(sl, i, man.part[i], sizeof man.part[i]))
+            return FR_INVALID_NAME; // Não ocorre: stripe_log_open() limita o nome
+
+    FRESULT res = FR_OK;
+    for (size_t i = 0; i < sl->num_cards; ++i)
+    {
+        if (sl->parts[i].failed)
+            continue;
+        char path[8 + STRIPE_LOG_PART_NAME_LEN];
+        manifest_name(sl, sl->parts[i].sd, path, sizeof path);
+        FIL fil;
+        UINT bw;
+        FRESULT r = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+        if (r == FR_OK)
+        {
+            r = f_write(&fil, &man, sizeof man, &bw);
+            FRESULT c = f_close(&fil);
+            if (r == FR_OK)
+                r = c;
+        }
+        if (res == FR_OK)
+            res = r;
+    }
+    return res;
+}
+
+/**
+ * @brief Espera os cartões, ajusta o tamanho dos arquivos do trecho e grava seu manifesto
+ */
+static FRESULT close_extent(stripe_log_t *sl)
+{
+    FRESULT res = FR_OK;
+    for (size_t i = 0; i < sl->num_cards; ++i)
+    {
+        stripe_log_part_t *p = &sl->parts[i];
+        if (p->failed)
+        {
+            // Cartão abandonado no espelho: nenhuma escrita em andamento (já fechado nos trechos seguintes)
+            f_close(&p->fil);
+            continue;
+        }
+        FRESULT r = wait_part(p);
+        if (r != FR_OK && sl->mode == STRIPE_LOG_MIRRORED)
+        {
+            // A última faixa deste cartão falhou: as cópias dos outros valem
+            printf("[AVISO] cartão %s abandonado no espelho: %s (%d)\n", p->sd->pcName, FRESULT_str(r), r);
+            p->failed = true;
+        }
+        // Libera a reserva além dos dados gravados
+        if (r == FR_OK)
+            r = f_lseek(&p->fil, p->bytes);
+        if (r == FR_OK)
+            r = f_truncate(&p->fil);
+        FRESULT c = f_close(&p->fil);
+        if (res == FR_OK && !p->failed)
+            res = r != FR_OK ? r : c;
+    }
+    size_t alive = 0;
+    for (size_t i = 0; i < sl->num_cards; ++i)
+        alive += !sl->parts[i].failed;
+    if (res == FR_OK)
+        res = alive ? write_manifest(sl) : FR_DISK_ERR;
+    return res;
+}
+
+/**
+ * @brief Reserva esgotada: fecha o trecho e continua o fluxo em novos arquivos nos mesmos cartões
+ *
+ * Os buffers não mudam, e a faixa à espera de gravação segue para o novo trecho.
+ */
+static FRESULT next_extent(stripe_log_t *sl)
+{
+    FRESULT res = close_extent(sl);
+    if (res == FR_OK && sl->extent == UINT16_MAX)
+        res = FR_DENIED;
+    if (res != FR_OK)
+    {
+        sl->num_cards = 0;
+        return res;
+    }
+    ++sl->extent;
+    sl->seq = 0;
+    sl->total_bytes = 0;
+    for (size_t i = 0; i < sl->num_cards; ++i)
+    {
+        if (sl->parts[i].failed)
+            continue;
+        res = open_part(sl, i, sl->parts[i].sd);
+        if (res != FR_OK)
+        {
+            while (i--)
+                if (!sl->parts[i].failed)
+                    f_close(&sl->parts[i].fil);
+            sl->num_cards = 0;
+            return res;
+        }
+    }
+    return FR_OK;
+}
+
+/**
+ * @brief Grava a faixa incompleta, espera os cartões, ajusta o tamanho dos arquivos e grava o manifesto
+ */
+FRESULT stripe_log_close(stripe_log_t *sl)
+{
+    FRESULT res = FR_OK;
+    if (sl->fill && sl->mode == STRIPE_LOG_MIRRORED)
+    {
+        res = submit(sl, STRIPE_LOG_UNIT_SECTORS, sl->fill);
+    }
+    else if (sl->fill)
+    {
+        // Completa o último setor com zeros; o tamanho real fica no arquivo e no manifesto
+        stripe_log_part_t *p = &sl->parts[sl->next_card];
+        uint32_t sectors = (sl->fill + FF_MAX_SS - 1) / FF_MAX_SS;
+        memset((uint8_t *)p->buf[p->next_buf] + sl->fill, 0, sectors * FF_MAX_SS - sl->fill);
+        res = submit(sl, sectors, sl->fill);
+    }
+    FRESULT r = close_extent(sl);
+    if (res == FR_OK)
+        res = r;
+    sl->num_cards = 0;
+    return res;
+}
+
+/**
+ * @brief Esquece os arquivos sem acessar os cartões (cartão removido); o que
+ * já foi gravado fica com o tamanho reservado e sem manifesto
+ */
+void stripe_log_abandon(stripe_log_t *sl)
+{
+    // Uma escrita em andamento termina (com erro) no próprio driver; não é repetida
+    for (size_t i = 0; i < sl->num_cards; ++i)
+        if (sl->parts[i].busy)
+            sd_async_wait(sl->parts[i].sd);
+    sl->num_cards = 0;
+}
@@ -0,0 +1,131 @@
+#ifndef STRIPE_LOG_H
+#define STRIPE_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ff.h"
+#include "sd_card.h"
+
+/**
+ * Gravação em vários cartões SD, cada um em seu barramento SPI, em um de
+ * dois modos:
+ *
+ * STRIPE_LOG_STRIPED (RAID-0): o fluxo de bytes é dividido em faixas de
+ * STRIPE_LOG_UNIT_SECTORS setores, gravadas em rodízio: a faixa k vai para o
+ * cartão k % num_cards, na posição (k / num_cards) * unit_bytes do arquivo
+ * daquele cartão. A taxa de gravação soma a dos cartões.
+ *
+ * STRIPE_LOG_MIRRORED (RAID-1): cada faixa é gravada em todos os cartões, na
+ * posição k * unit_bytes, e termina com um stripe_log_trailer_t (número da
+ * faixa e CRC16 dos dados) que permite ao leitor escolher a cópia boa. As
+ * escritas nos cartões são simultâneas: a latência é a do cartão mais lento,
+ * não a soma. Um cartão que falha é abandonado e a gravação segue nos demais.
+ *
+ * Cada cartão recebe um arquivo contíguo reservado na abertura (f_expand), e
+ * as faixas são escritas diretamente nos setores dele com escritas
+ * assíncronas (DMA de cada barramento): enquanto os cartões gravam, a próxima
+ * faixa é preenchida.
+ *
+ * No fechamento cada arquivo é truncado no que foi gravado, e o manifesto
+ * (stripe_log_manifest_t, "<nome>.man" em cada cartão) registra o modo, a
+ * ordem dos arquivos, o tamanho da faixa e o total de bytes.
+ * ArquivosDados/join_stripes.py remonta o arquivo original a partir dele.
+ *
+ * Quando a reserva se esgota, o trecho é fechado da mesma forma e o fluxo
+ * continua em um novo trecho, com novos arquivos e reservas nos mesmos
+ * cartões: o trecho n (n >= 1) grava "<nome>.<n>.s<i>" e "<nome>.<n>.man".
+ * O join_stripes.py emenda os trechos na ordem.
+ */
+
+/* Um cartão por barramento: cartões no mesmo barramento não gravam ao mesmo tempo. */
+#ifndef STRIPE_LOG_MAX_CARDS
+#define STRIPE_LOG_MAX_CARDS 2
+#endif
+
+/* Setores por faixa; cada cartão usa dois buffers desse tamanho (um sendo
+ * gravado, outro sendo preenchido). */
+#ifndef STRIPE_LOG_UNIT_SECTORS
+#define STRIPE_LOG_UNIT_SECTORS 8
+#endif
+
+/* Reserva contígua em cada cartão por trecho, em bytes. */
+#ifndef STRIPE_LOG_PREALLOC_BYTES
+#define STRIPE_LOG_PREALLOC_BYTES (8 * 1024 * 1024)
+#endif
+
+#define STRIPE_LOG_UNIT_BYTES (STRIPE_LOG_UNIT_SECTORS * FF_MAX_SS)
+
+typedef enum {
+    STRIPE_LOG_STRIPED,
+    STRIPE_LOG_MIRRORED,
+} stripe_log_mode_t;
+
+#define STRIPE_LOG_MANIFEST_MAGIC 0x31525453 // "STR1"
+#define STRIPE_LOG_MANIFEST_VERSION 1
+#define STRIPE_LOG_MANIFEST_PARTS 4
+#define STRIPE_LOG_PART_NAME_LEN 32
+#define STRIPE_LOG_NAME_MAX (STRIPE_LOG_PART_NAME_LEN - 12) // Cabe ".<trecho>.s<i>" e o '\0' no nome de cada arquivo
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_cards;
+    uint32_t unit_bytes;    // Bytes por faixa
+    uint8_t mode;           // stripe_log_mode_t
+    uint8_t reserved;
+    uint16_t extent;        // Número do trecho (zero em arquivos anteriores aos trechos)
+    uint64_t total_bytes;   // Bytes deste trecho
+    char part[STRIPE_LOG_MANIFEST_PARTS][STRIPE_LOG_PART_NAME_LEN]; // Arquivo de cada cartão, na ordem das faixas
+} stripe_log_manifest_t;
+
+/* Fim de cada faixa no modo espelhado; os dados ocupam o início da faixa. */
+#define STRIPE_LOG_TRAILER_MAGIC 0x3152494D // "MIR1"
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // Número da faixa
+    uint16_t len;           // Bytes de dados na faixa
+    uint16_t crc;           // CRC16-CCITT dos len bytes de dados
+    uint32_t reserved;
+} stripe_log_trailer_t;
+
+typedef struct {
+    sd_card_t *sd;
+    FIL fil;
+    LBA_t lba;              // Primeiro setor do arquivo (contíguo)
+    uint32_t sectors;       // Setores reservados
+    uint32_t written;       // Setores gravados
+    uint64_t bytes;         // Bytes gravados (sem o preenchimento da última faixa)
+    volatile bool busy;     // Escrita assíncrona em andamento
+    volatile int status;    // Resultado da última escrita
+    const uint8_t *retry_buf; // Escrita assíncrona em andamento, para repeti-la se falhar
+    LBA_t retry_lba;
+    uint32_t retry_sectors;
+    bool failed;            // Modo espelhado: cartão abandonado após um erro
+    int next_buf;
+    uint32_t buf[2][STRIPE_LOG_UNIT_BYTES / 4]; // Alinhados para o DMA
+} stripe_log_part_t;
+
+typedef struct {
+    char name[STRIPE_LOG_PART_NAME_LEN];
+    stripe_log_mode_t mode;
+    size_t num_cards;
+    size_t next_card;       // Cartão da faixa sendo preenchida (no modo espelhado, sempre 0)
+    uint32_t fill;          // Bytes na faixa sendo preenchida
+    uint32_t seq;           // Número da faixa sendo preenchida, no trecho
+    uint16_t extent;        // Trecho atual
+    uint64_t total_bytes;   // Bytes do trecho atual
+    stripe_log_part_t parts[STRIPE_LOG_MAX_CARDS];
+} stripe_log_t;
+
+/* Cria um arquivo em cada cartão montado (ao menos dois); nomes com mais de
+ * STRIPE_LOG_NAME_MAX caracteres dão FR_INVALID_NAME. */
+FRESULT stripe_log_open(stripe_log_t *sl, const char *name, stripe_log_mode_t mode);
+FRESULT stripe_log_write(stripe_log_t *sl, const void *data, UINT len, UINT *bw);
+FRESULT stripe_log_close(stripe_log_t *sl);
+/* Cartão removido: descarta o arquivo sem acessar os cartões. */
+void stripe_log_abandon(stripe_log_t *sl);
+
+/* Número de cartões montados, isto é, disponíveis para stripe_log_open(). */
+size_t stripe_log_num_cards();
+
+#endif